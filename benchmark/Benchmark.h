@@ -0,0 +1,53 @@
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+
+//! Number of runs of every benchmark; the fastest one is reported
+static const unsigned int BENCHMARK_RUNS{5};
+
+//! Sink of the benchmark results
+static volatile std::size_t benchmarkSink;
+
+//!
+//! \brief Keep a result from being optimized away.
+//!
+//! \param value Result, e.g. a checksum of the benchmarked work
+//!
+inline void keep(std::size_t value)
+{
+    benchmarkSink = value;
+}
+
+//!
+//! \brief Run a benchmark and print its time per operation.
+//!
+//! The body is run BENCHMARK_RUNS times, so the first run warms up caches and
+//! pools, and the fastest run is reported.
+//!
+//! \param name Name of the benchmark
+//! \param operations Number of operations performed by every run of the body
+//! \param body Function object performing the operations
+//!
+template <typename BodyT>
+void runBenchmark(const char *name, std::size_t operations, BodyT body)
+{
+    auto best = std::chrono::steady_clock::duration::max();
+    for (unsigned int run = 0; run < BENCHMARK_RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    auto nanoseconds =
+        std::chrono::duration<double, std::nano>(best).count() / operations;
+    std::cout << std::left << std::setw(56) << name << std::right
+              << std::setw(12) << std::fixed << std::setprecision(1)
+              << nanoseconds << " ns/op" << std::endl;
+}
+
+#endif
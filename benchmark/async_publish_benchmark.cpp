@@ -0,0 +1,158 @@
+
+//
+// Time per message of publishing through an MQTT broker from 1, 4 and 16
+// producer threads.
+//
+// Messages are published by AsyncMqttTransport in asynchronous publish mode,
+// where producers push them into a lock-free queue that a publisher thread
+// hands to libmosquitto in batches. The baseline is the synchronous mode,
+// where every producer calls libmosquitto and contends with its loop thread.
+// A run lasts until the transport has received back every message it
+// published, so the time includes the delivery through the broker.
+//
+// Usage: async_publish_benchmark [server [port]]. The broker defaults to
+// localhost:1883; the benchmark is skipped when it cannot be reached.
+//
+
+#include "Benchmark.h"
+
+#include <bsf/AsyncMqttTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const std::size_t MESSAGES{48000};
+//! Size of the published messages (bytes)
+static const std::size_t MESSAGE_SIZE{16};
+//! Time to wait for the connection and for the messages (seconds)
+static const int64_t TIMEOUT_S{10};
+//! Channel of the messages
+static const char *CHANNEL{"masmusic/benchmark/async_publish"};
+
+//!
+//! \brief Wait for a condition.
+//!
+//! \param condition Condition
+//! \return Whether the condition was met before the timeout
+//!
+template <typename ConditionT>
+static bool waitFor(ConditionT condition)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::seconds{TIMEOUT_S};
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return true;
+}
+
+//!
+//! \brief Benchmark a publish mode.
+//!
+//! \param server MQTT broker address
+//! \param port MQTT broker port
+//! \param capacity Capacity of the publish queue, or zero to publish
+//!                 synchronously
+//! \return Whether the broker could be reached
+//!
+static bool benchmarkMode(const std::string &server, unsigned int port,
+                          std::size_t capacity)
+{
+    bsf::AsyncMqttTransport transport("async_publish_benchmark", server, port,
+                                      0);
+    transport.setAsyncPublish(capacity);
+    std::atomic<std::size_t> received{0};
+    transport.addSpanHandler([&received](bsf::ByteSpan)
+                             {
+                                 received++;
+                             },
+                             CHANNEL);
+    transport.start();
+
+    // The subscription is in place once a probe message comes back
+    std::vector<unsigned char> message(MESSAGE_SIZE);
+    auto subscribed = waitFor([&]
+                              {
+                                  if (transport.isConnected())
+                                  {
+                                      transport.publish(message, CHANNEL);
+                                  }
+                                  return received > 0;
+                              });
+    if (!subscribed)
+    {
+        transport.stop();
+        return false;
+    }
+    // Let the remaining probes arrive
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+    std::size_t lost{0};
+    for (std::size_t producers : {1, 4, 16}) {
+        auto name = std::string(capacity > 0 ? "Asynchronous publish"
+                                             : "Baseline synchronous publish") +
+                    " (" + std::to_string(producers) +
+                    (producers == 1 ? " producer)" : " producers)");
+        runBenchmark(
+            name.c_str(), MESSAGES,
+            [&]
+            {
+                auto expected = received + MESSAGES;
+                std::vector<std::thread> threads;
+                for (std::size_t i = 0; i < producers; i++) {
+                    threads.emplace_back([&]
+                                         {
+                                             for (std::size_t j = 0;
+                                                  j < MESSAGES / producers;
+                                                  j++) {
+                                                 transport.publish(message,
+                                                                   CHANNEL);
+                                             }
+                                         });
+                }
+                for (auto &thread : threads) {
+                    thread.join();
+                }
+                if (!waitFor([&]
+                             {
+                                 return received >= expected;
+                             }))
+                {
+                    lost += expected - received;
+                    received = expected;
+                }
+            });
+    }
+    transport.stop();
+    if (lost > 0 || transport.getDroppedCount() > 0)
+    {
+        std::cout << "  " << lost << " messages lost, "
+                  << transport.getDroppedCount() << " dropped" << std::endl;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string server{argc > 1 ? argv[1] : "localhost"};
+    unsigned int port = argc > 2 ? std::atoi(argv[2]) : 1883;
+    if (!benchmarkMode(server, port, 0))
+    {
+        std::cerr << "No MQTT broker at " << server << ":" << port
+                  << ", skipping" << std::endl;
+        return 0;
+    }
+    benchmarkMode(server, port, MESSAGES);
+    return 0;
+}
@@ -0,0 +1,97 @@
+
+//
+// Time per message of encoding and decoding Base64 with bsf::Base64.
+//
+// The codec processes bulk blocks with SSSE3 kernels when it is built for
+// SSSE3, and with lookup tables otherwise. This benchmark is built both ways:
+// base64_benchmark with the default flags, the scalar baseline on targets
+// without SSSE3, and base64_ssse3_benchmark with -mssse3. Every round trip is
+// checked to give back the original message.
+//
+
+#include "Benchmark.h"
+
+#include <bsf/Base64.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//! Bytes encoded or decoded per run, whatever the size of the messages
+static const std::size_t RUN_BYTES{16 << 20};
+
+#ifdef __SSSE3__
+static const char *CODEC{"SSSE3"};
+#else
+static const char *CODEC{"Scalar"};
+#endif
+
+//!
+//! \brief Benchmark messages of a size.
+//!
+//! \param size Size of the messages in bytes
+//! \return Whether the round trips gave back the messages
+//!
+static bool benchmarkSize(std::size_t size)
+{
+    std::vector<unsigned char> data(size);
+    for (std::size_t i = 0; i < size; i++) {
+        data[i] = static_cast<unsigned char>(i * 7 + 3);
+    }
+    std::vector<unsigned char> text(bsf::Base64::encodedSize(size));
+    std::vector<unsigned char> decoded(size);
+    std::size_t bytes{0};
+    auto messages = RUN_BYTES / size;
+    auto suffix = " (" + std::to_string(size) + " bytes)";
+
+    runBenchmark((CODEC + std::string(" encode") + suffix).c_str(), messages,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < messages; i++) {
+                         data[0] = static_cast<unsigned char>(i);
+                         bsf::Base64::encode(bsf::ByteSpan(data), text.data());
+                         bytes += text[0];
+                     }
+                 });
+
+    runBenchmark((CODEC + std::string(" decode") + suffix).c_str(), messages,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < messages; i++) {
+                         bytes += bsf::Base64::decode(bsf::ByteSpan(text),
+                                                      decoded.data());
+                     }
+                 });
+
+    auto matched = true;
+    runBenchmark((CODEC + std::string(" round trip") + suffix).c_str(),
+                 messages,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < messages; i++) {
+                         data[0] = static_cast<unsigned char>(i);
+                         bsf::Base64::encode(bsf::ByteSpan(data), text.data());
+                         auto decodedSize = bsf::Base64::decode(
+                             bsf::ByteSpan(text), decoded.data());
+                         matched &= decodedSize == size && decoded == data;
+                     }
+                 });
+    keep(bytes);
+    if (!matched)
+    {
+        std::cerr << "Round trips of " << size
+                  << " bytes did not give back the messages" << std::endl;
+    }
+    return matched;
+}
+
+int main()
+{
+    auto matched = true;
+    for (std::size_t size : {16, 64, 1024, 16384}) {
+        matched &= benchmarkSize(size);
+    }
+    return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+
+//
+// Time per message of the dispatch of received messages to channel handlers.
+//
+// Messages received with a null-terminated topic, as from mosquitto, are
+// dispatched by AbstractTransport through its channel table, and through the
+// identifier of a channel found once. The baseline is the dispatch before
+// channels were interned: a std::string built from the topic to look up an
+// unordered_map of handlers.
+//
+
+#include "Benchmark.h"
+
+#include <bsf/AbstractTransport.h>
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const std::size_t MESSAGES{1000000};
+
+//!
+//! \brief Transport exposing the dispatch of received messages.
+//!
+class DispatchTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    using bsf::AbstractTransport<std::string>::callHandlers;
+    using bsf::AbstractTransport<std::string>::findChannel;
+
+    virtual void publish(const std::vector<unsigned char> &,
+                         const std::string &)
+    {
+    }
+};
+
+//!
+//! \brief Benchmark the dispatch among a number of channels.
+//!
+//! \param channelCount Number of channels with a handler
+//!
+static void benchmarkChannels(std::size_t channelCount)
+{
+    std::vector<std::string> topics;
+    for (std::size_t i = 0; i < channelCount; i++) {
+        topics.push_back("masmusic/notes/channel/" + std::to_string(i));
+    }
+    std::vector<unsigned char> message(16);
+    std::size_t calls{0};
+    auto handler = [&calls](bsf::ByteSpan span)
+    {
+        calls += span.size();
+    };
+    auto suffix = " (" + std::to_string(channelCount) + " channels)";
+
+    std::unordered_map<std::string,
+                       std::vector<DispatchTransport::SpanHandler>> map;
+    for (const auto &topic : topics) {
+        map[topic].push_back(handler);
+    }
+    runBenchmark(("Baseline unordered_map, string key" + suffix).c_str(),
+                 MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         const char *topic = topics[i % channelCount].c_str();
+                         auto it = map.find(std::string(topic));
+                         if (it != map.end())
+                         {
+                             for (const auto &h : it->second) {
+                                 h(bsf::ByteSpan(message));
+                             }
+                         }
+                     }
+                 });
+
+    DispatchTransport transport;
+    for (const auto &topic : topics) {
+        transport.addSpanHandler(handler, topic);
+    }
+    runBenchmark(("AbstractTransport, null-terminated topic" + suffix).c_str(),
+                 MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         transport.callHandlers(
+                             bsf::ByteSpan(message),
+                             topics[i % channelCount].c_str());
+                     }
+                 });
+
+    std::vector<bsf::ChannelId> ids;
+    for (const auto &topic : topics) {
+        ids.push_back(transport.findChannel(topic));
+    }
+    runBenchmark(("AbstractTransport, channel identifier" + suffix).c_str(),
+                 MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         transport.callHandlers(bsf::ByteSpan(message),
+                                                ids[i % channelCount]);
+                     }
+                 });
+    keep(calls);
+}
+
+int main()
+{
+    benchmarkChannels(10);
+    benchmarkChannels(1000);
+    return 0;
+}
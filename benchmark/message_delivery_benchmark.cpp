@@ -0,0 +1,152 @@
+
+//
+// Time per message of delivering received messages to their handlers.
+//
+// Messages are delivered by AbstractTransport to span handlers, which see the
+// received bytes in place, and deserialized from the span as SensorClient
+// does. The baseline is the delivery before byte spans: a handler taking a
+// vector, as addHandler still allows, which copies the message, and a note
+// reading deserialized from a second copy, made by the vector taken by value
+// in the former SensorClient::processMessage.
+//
+
+#include "Benchmark.h"
+
+#include "MidiEndpointCommon.h"
+
+#include <bsf/AbstractTransport.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace midiendpoints;
+
+static const std::size_t MESSAGES{1000000};
+//! Channel of the messages
+static const char *CHANNEL{"masmusic/notes"};
+
+//!
+//! \brief Transport exposing the dispatch of received messages.
+//!
+class DispatchTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    using bsf::AbstractTransport<std::string>::callHandlers;
+
+    virtual void publish(const std::vector<unsigned char> &,
+                         const std::string &)
+    {
+    }
+};
+
+//!
+//! \brief Benchmark the delivery of raw messages of a size.
+//!
+//! \param size Size of the messages in bytes
+//!
+static void benchmarkRaw(std::size_t size)
+{
+    std::vector<unsigned char> message(size);
+    std::size_t bytes{0};
+    auto suffix = " (" + std::to_string(size) + " bytes)";
+
+    DispatchTransport vectorTransport;
+    vectorTransport.addHandler([&bytes](const std::vector<unsigned char> &m)
+                               {
+                                   bytes += m.size();
+                               },
+                               CHANNEL);
+    runBenchmark(("Baseline vector handler" + suffix).c_str(), MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         vectorTransport.callHandlers(bsf::ByteSpan(message),
+                                                      CHANNEL);
+                     }
+                 });
+
+    DispatchTransport spanTransport;
+    spanTransport.addSpanHandler([&bytes](bsf::ByteSpan m)
+                                 {
+                                     bytes += m.size();
+                                 },
+                                 CHANNEL);
+    runBenchmark(("Span handler" + suffix).c_str(), MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         spanTransport.callHandlers(bsf::ByteSpan(message),
+                                                    CHANNEL);
+                     }
+                 });
+    keep(bytes);
+}
+
+//!
+//! \brief Benchmark the delivery and deserialization of note readings.
+//!
+static void benchmarkReadings()
+{
+    TimeSpanNoteSerializer serializer;
+    TimeSpanNoteReadingFactory factory;
+    TimeSpanNoteReading note{factory.newDataReading()};
+    note->set_timestamp(1476659970000);
+    midiToPitch(60, note->mutable_pitch());
+    note->set_velocity(DEFAULT_VELOCITY);
+    note->set_duration(500);
+    note->set_instrument(0);
+    std::vector<unsigned char> message;
+    serializer.serialize(note, message);
+    std::size_t durations{0};
+
+    DispatchTransport vectorTransport;
+    auto process = [&](std::vector<unsigned char> m)
+    {
+        TimeSpanNoteReading reading{factory.newDataReading()};
+        serializer.deserialize(m, reading);
+        durations += reading->duration();
+    };
+    vectorTransport.addHandler([&process](const std::vector<unsigned char> &m)
+                               {
+                                   process(m);
+                               },
+                               CHANNEL);
+    runBenchmark("Baseline vector handler, note reading", MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         vectorTransport.callHandlers(bsf::ByteSpan(message),
+                                                      CHANNEL);
+                     }
+                 });
+
+    DispatchTransport spanTransport;
+    spanTransport.addSpanHandler([&](bsf::ByteSpan m)
+                                 {
+                                     TimeSpanNoteReading reading{
+                                         factory.newDataReading()};
+                                     bsf::deserializeSpan(serializer, m,
+                                                          reading);
+                                     durations += reading->duration();
+                                 },
+                                 CHANNEL);
+    runBenchmark("Span handler, note reading", MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         spanTransport.callHandlers(bsf::ByteSpan(message),
+                                                    CHANNEL);
+                     }
+                 });
+    keep(durations);
+}
+
+int main()
+{
+    benchmarkRaw(16);
+    benchmarkRaw(1024);
+    benchmarkRaw(16384);
+    benchmarkReadings();
+    return 0;
+}
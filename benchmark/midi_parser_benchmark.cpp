@@ -0,0 +1,91 @@
+
+//
+// Time per message of the MIDI stream parser.
+//
+// Streams of note messages are parsed with and without running status, with a
+// real-time clock byte interleaved within every message, and with a SysEx
+// message between every note.
+//
+
+#include "Benchmark.h"
+
+#include "MidiParser.h"
+
+#include <cstddef>
+#include <vector>
+
+using namespace midiendpoints;
+
+static const std::size_t MESSAGES{1000000};
+
+//!
+//! \brief Build a stream of alternating note on and note off messages.
+//!
+//! \param runningStatus Whether to omit the repeated status bytes
+//! \param clock Whether to interleave a clock byte within every message
+//! \param sysex Whether to add a SysEx message before every note
+//! \return The stream
+//!
+static std::vector<unsigned char> makeStream(bool runningStatus, bool clock,
+                                             bool sysex)
+{
+    std::vector<unsigned char> stream;
+    for (std::size_t i = 0; i < MESSAGES; i++) {
+        if (sysex)
+        {
+            stream.insert(stream.end(), {0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7});
+        }
+        if (!runningStatus || sysex || i == 0)
+        {
+            stream.push_back(0x90);
+        }
+        stream.push_back(static_cast<unsigned char>(i % 128));
+        if (clock)
+        {
+            stream.push_back(0xF8);
+        }
+        // Note off as note on with zero velocity
+        stream.push_back(i % 2 == 0 ? 100 : 0);
+    }
+    return stream;
+}
+
+//!
+//! \brief Benchmark the parsing of a stream.
+//!
+//! \param name Name of the benchmark
+//! \param stream Stream
+//!
+static void benchmarkStream(const char *name,
+                            const std::vector<unsigned char> &stream)
+{
+    runBenchmark(name, MESSAGES,
+                 [&stream]
+                 {
+                     MidiParser parser;
+                     std::size_t checksum{0};
+                     parser.parse(stream.data(), stream.data() + stream.size(),
+                                  [&checksum](const MidiEvent *events,
+                                              std::size_t count)
+                                  {
+                                      for (std::size_t i = 0; i < count; i++) {
+                                          checksum += events[i].data1 +
+                                                      events[i].data2;
+                                      }
+                                  });
+                     keep(checksum);
+                 });
+}
+
+int main()
+{
+    benchmarkStream("MidiParser note messages",
+                    makeStream(false, false, false));
+    benchmarkStream("MidiParser note messages, running status",
+                    makeStream(true, false, false));
+    benchmarkStream("MidiParser note messages, interleaved clock",
+                    makeStream(true, true, false));
+    benchmarkStream("MidiParser note messages, SysEx between notes",
+                    makeStream(false, false, true));
+    return 0;
+}
@@ -0,0 +1,138 @@
+
+//
+// Time per note event of scheduling and firing note events.
+//
+// Note events are scheduled on the timing wheel of NoteScheduler, and fired
+// from the ASIO service. The baseline is the scheduling before the timing
+// wheel: a heap-allocated ASIO timer, with its own wait, per note on and per
+// note off. Events are either all due at once, so that scheduling and firing
+// are timed, or spread over the following seconds and dropped before they are
+// due, so that only scheduling is timed.
+//
+
+#include "Benchmark.h"
+
+#include "NoteScheduler.h"
+
+#include <asio.hpp>
+#include <asio/system_timer.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace midiendpoints;
+
+//! Number of notes, each with a note on and a note off event
+static const std::size_t NOTES{10000};
+//! Time over which the notes are spread when they are not fired (milliseconds)
+static const int64_t SPREAD_MS{4000};
+
+//! \brief Note event.
+struct Event
+{
+    //! MIDI note
+    uint8_t note;
+    //! Whether the event is a note on
+    bool on;
+};
+
+//!
+//! \brief Benchmark the baseline timers.
+//!
+//! \param name Name of the benchmark
+//! \param fire Whether the events are fired; otherwise they are spread over
+//!             the following seconds and cancelled
+//!
+static void benchmarkTimers(const char *name, bool fire)
+{
+    asio::io_service asio;
+    std::size_t fired{0};
+    runBenchmark(name, 2 * NOTES,
+                 [&]
+                 {
+                     using namespace std::chrono;
+                     auto now = system_clock::now();
+                     std::vector<std::shared_ptr<asio::system_timer>> timers;
+                     for (std::size_t i = 0; i < 2 * NOTES; i++) {
+                         auto time =
+                             fire ? now
+                                  : now + milliseconds{int64_t(i) * SPREAD_MS /
+                                                       int64_t{2 * NOTES}};
+                         auto timer =
+                             std::make_shared<asio::system_timer>(asio, time);
+                         timer->async_wait(
+                             [timer, &fired](const asio::error_code &error)
+                             {
+                                 if (!error)
+                                 {
+                                     fired++;
+                                 }
+                             });
+                         if (!fire)
+                         {
+                             timers.push_back(timer);
+                         }
+                     }
+                     for (auto &timer : timers) {
+                         timer->cancel();
+                     }
+                     asio.reset();
+                     asio.run();
+                 });
+    keep(fired);
+}
+
+//!
+//! \brief Benchmark the timing wheel.
+//!
+//! \param name Name of the benchmark
+//! \param fire Whether the events are fired; otherwise they are spread over
+//!             the following seconds and dropped
+//!
+static void benchmarkWheel(const char *name, bool fire)
+{
+    typedef NoteScheduler<Event, std::chrono::system_clock> Scheduler;
+    asio::io_service asio;
+    asio::io_service::strand strand(asio);
+    std::size_t fired{0};
+    Scheduler scheduler(asio, strand,
+                        [&fired](const Event *, std::size_t count)
+                        {
+                            fired += count;
+                        },
+                        Scheduler::Duration::zero(), 2 * NOTES);
+    runBenchmark(name, 2 * NOTES,
+                 [&]
+                 {
+                     using namespace std::chrono;
+                     auto now = system_clock::now();
+                     for (std::size_t i = 0; i < 2 * NOTES; i++) {
+                         auto time =
+                             fire ? now
+                                  : now + milliseconds{int64_t(i) * SPREAD_MS /
+                                                       int64_t{2 * NOTES}};
+                         scheduler.schedule(
+                             time, Event{static_cast<uint8_t>(i % 128),
+                                         i % 2 == 0});
+                     }
+                     if (!fire)
+                     {
+                         scheduler.clear();
+                     }
+                     asio.reset();
+                     asio.run();
+                 });
+    keep(fired);
+}
+
+int main()
+{
+    benchmarkTimers("Baseline timer per event, schedule and fire", true);
+    benchmarkWheel("NoteScheduler, schedule and fire", true);
+    benchmarkTimers("Baseline timer per event, schedule and cancel", false);
+    benchmarkWheel("NoteScheduler, schedule and clear", false);
+    return 0;
+}
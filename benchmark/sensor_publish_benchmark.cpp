@@ -0,0 +1,71 @@
+
+//
+// Time per reading of publishing note readings with Sensor::publish.
+//
+// Readings are serialized into a buffer borrowed from the buffer pool of the
+// publishing thread and published through an in-process transport on a
+// channel without handlers. The baseline is the publishing before the pool: a
+// new vector serialized into for each reading.
+//
+
+#include "Benchmark.h"
+
+#include "MidiEndpointCommon.h"
+
+#include <bsf/InProcessTransport.h>
+#include <bsf/Sensor.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace midiendpoints;
+
+typedef bsf::Sensor<bsf::InProcessTransport, TimeSpanNoteReading,
+                    TimeSpanNoteSerializer, TimeSpanNoteReadingFactory>
+    NoteSensor;
+
+static const std::size_t READINGS{1000000};
+//! Channel of the readings
+static const char *CHANNEL{"masmusic/notes"};
+
+int main()
+{
+    bsf::InProcessTransport transport;
+    transport.start();
+    NoteSensor sensor(transport, CHANNEL);
+    auto reading = sensor.newDataReading();
+    reading->set_timestamp(1476659970000);
+    midiToPitch(60, reading->mutable_pitch());
+    reading->set_velocity(DEFAULT_VELOCITY);
+    reading->set_duration(500);
+    reading->set_instrument(0);
+    std::size_t bytes{0};
+
+    TimeSpanNoteSerializer serializer;
+    std::string channel{CHANNEL};
+    runBenchmark("Baseline new vector per reading", READINGS,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < READINGS; i++) {
+                         reading->set_duration(static_cast<uint32_t>(i));
+                         std::vector<unsigned char> message;
+                         serializer.serialize(reading, message);
+                         transport.publish(message, channel);
+                         bytes += message.size();
+                     }
+                 });
+
+    runBenchmark("Sensor::publish, pooled buffer", READINGS,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < READINGS; i++) {
+                         reading->set_duration(static_cast<uint32_t>(i));
+                         sensor.publish(reading);
+                     }
+                 });
+    transport.stop();
+    keep(bytes);
+    return 0;
+}
@@ -0,0 +1,169 @@
+
+//
+// Time per message of matching a topic against MQTT-style topic filters.
+//
+// Topics are matched through TopicTrie, and through the dispatch of
+// AbstractTransport with wildcard channels in use. The baseline matches the
+// topic against every filter in turn, level by level.
+//
+
+#include "Benchmark.h"
+
+#include <bsf/AbstractTransport.h>
+#include <bsf/TopicTrie.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const std::size_t MESSAGES{100000};
+//! Number of distinct topics matched
+static const std::size_t TOPICS{64};
+
+//!
+//! \brief Transport exposing the dispatch of received messages.
+//!
+class DispatchTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    using bsf::AbstractTransport<std::string>::callHandlers;
+
+    virtual void publish(const std::vector<unsigned char> &,
+                         const std::string &)
+    {
+    }
+};
+
+//!
+//! \brief Match a topic against a filter, level by level.
+//!
+//! \param filter Topic filter
+//! \param topic Null-terminated topic
+//! \return Whether the filter matches the topic
+//!
+static bool matchFilter(const std::string &filter, const char *topic)
+{
+    auto f = filter.c_str();
+    auto t = topic;
+    if (*t == '$' && (*f == '+' || *f == '#'))
+    {
+        return false;
+    }
+    while (true)
+    {
+        auto fEnd = std::strchr(f, '/');
+        auto tEnd = std::strchr(t, '/');
+        auto fSize =
+            fEnd ? static_cast<std::size_t>(fEnd - f) : std::strlen(f);
+        auto tSize =
+            tEnd ? static_cast<std::size_t>(tEnd - t) : std::strlen(t);
+        if (fSize == 1 && *f == '#')
+        {
+            return true;
+        }
+        if (!(fSize == 1 && *f == '+') &&
+            (fSize != tSize || std::strncmp(f, t, fSize) != 0))
+        {
+            return false;
+        }
+        if (!fEnd && !tEnd)
+        {
+            return true;
+        }
+        if (!fEnd || !tEnd)
+        {
+            // A trailing '#' also matches its parent level
+            return !tEnd && std::strcmp(fEnd + 1, "#") == 0;
+        }
+        f = fEnd + 1;
+        t = tEnd + 1;
+    }
+}
+
+//!
+//! \brief Benchmark matching topics against a number of filters.
+//!
+//! \param filterCount Number of filters, a fourth of them with wildcards
+//!
+static void benchmarkFilters(std::size_t filterCount)
+{
+    std::vector<std::string> filters;
+    for (std::size_t i = 0; i < filterCount; i++) {
+        auto n = std::to_string(i);
+        switch (i % 8)
+        {
+        case 0:
+            filters.push_back("masmusic/" + n + "/#");
+            break;
+        case 4:
+            filters.push_back("masmusic/+/" + n);
+            break;
+        default:
+            filters.push_back("masmusic/notes/" + n);
+            break;
+        }
+    }
+    std::vector<std::string> topics;
+    for (std::size_t i = 0; i < TOPICS; i++) {
+        topics.push_back("masmusic/notes/" + std::to_string(i * 3));
+    }
+    auto suffix = " (" + std::to_string(filterCount) + " filters)";
+    std::size_t matches{0};
+
+    runBenchmark(("Baseline linear filter scan" + suffix).c_str(), MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         auto topic = topics[i % TOPICS].c_str();
+                         for (const auto &filter : filters) {
+                             matches += matchFilter(filter, topic);
+                         }
+                     }
+                 });
+
+    bsf::TopicTrie trie;
+    for (std::size_t i = 0; i < filterCount; i++) {
+        if (bsf::TopicTrie::isFilter(filters[i]))
+        {
+            trie.add(filters[i], static_cast<bsf::ChannelId>(i));
+        }
+    }
+    runBenchmark(("TopicTrie" + suffix).c_str(), MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         trie.match(topics[i % TOPICS].c_str(),
+                                    [&matches](bsf::ChannelId)
+                                    {
+                                        matches++;
+                                    });
+                     }
+                 });
+
+    DispatchTransport transport;
+    for (const auto &filter : filters) {
+        transport.addSpanHandler([&matches](bsf::ByteSpan)
+                                 {
+                                     matches++;
+                                 },
+                                 filter);
+    }
+    std::vector<unsigned char> message(16);
+    runBenchmark(("AbstractTransport dispatch" + suffix).c_str(), MESSAGES,
+                 [&]
+                 {
+                     for (std::size_t i = 0; i < MESSAGES; i++) {
+                         transport.callHandlers(bsf::ByteSpan(message),
+                                                topics[i % TOPICS].c_str());
+                     }
+                 });
+    keep(matches);
+}
+
+int main()
+{
+    benchmarkFilters(16);
+    benchmarkFilters(256);
+    return 0;
+}
@@ -0,0 +1,26 @@
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <MidiEndpointCommon.h>
+
+#include <bsf/Sensor.h>
+#include <bsf/SensorClient.h>
+
+namespace midiendpoints
+{
+
+//! Sensor publishing clock synchronization messages
+template <typename TransportT>
+using ClockSyncSensor = bsf::Sensor<TransportT, ClockSyncReading,
+                                    ClockSyncSerializer,
+                                    ClockSyncReadingFactory>;
+
+//! Sensor client receiving clock synchronization messages
+template <typename TransportT>
+using ClockSyncSensorClient =
+    bsf::SensorClient<TransportT, ClockSyncReading, ClockSyncSerializer,
+                      ClockSyncReadingFactory>;
+}
+
+#endif
@@ -0,0 +1,160 @@
+
+#ifndef MIDICLOCK_H
+#define MIDICLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Maps MIDI stream time to wall-clock time.
+//!
+//! MIDI backends such as RtMidi report the time of each event as a delta from
+//! the previous one. Accumulating those deltas gives a stream time that is
+//! precise relative to other events, but has an arbitrary origin and may drift
+//! with respect to the system clocks.
+//!
+//! The clock is anchored to the monotonic clock on the first event, and the
+//! monotonic clock is mapped to the epoch using the system clock. Drift is
+//! corrected by periodically comparing the stream time of recently processed
+//! events against the monotonic clock: since events are always observed after
+//! they happen, the smallest observed offset over a correction window is the
+//! best estimate of the real offset, and the mapping is slewed towards it.
+//!
+//! This class is not thread-safe.
+//!
+class MidiClock
+{
+public:
+    //! Monotonic clock used as reference
+    typedef std::chrono::steady_clock Clock;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param epochShift Constant added to every timestamp (e.g. to simulate a
+    //!                   skewed system clock)
+    //!
+    explicit MidiClock(
+        std::chrono::microseconds epochShift = std::chrono::microseconds{0})
+    : m_anchored{false}
+    , m_epochShift{epochShift.count()}
+    , m_offset{0}
+    , m_epochOffset{0}
+    , m_windowMinOffset{0}
+    , m_windowStart()
+    {
+    }
+
+    //!
+    //! \brief Forget the current anchor.
+    //!
+    //! The clock will be anchored again on the next event.
+    //!
+    void reset()
+    {
+        m_anchored = false;
+    }
+
+    //!
+    //! \brief Convert a stream time into a timestamp since epoch.
+    //!
+    //! The first call anchors the stream time to the current time.
+    //!
+    //! \param streamTime Stream time in seconds
+    //! \return Timestamp since epoch in microseconds
+    //!
+    int64_t toEpochMicros(double streamTime)
+    {
+        if (!m_anchored)
+        {
+            anchor(streamTime);
+        }
+        return toMicros(streamTime) + m_offset + m_epochOffset + m_epochShift;
+    }
+
+    //!
+    //! \brief Correct the clock drift with a new observation.
+    //!
+    //! Samples the clocks, so it should be called once per batch of processed
+    //! events rather than once per event.
+    //!
+    //! \param streamTime Stream time in seconds of an event that has already
+    //!                   happened (typically, the last processed one)
+    //!
+    void correct(double streamTime)
+    {
+        if (!m_anchored)
+        {
+            return;
+        }
+        auto now = Clock::now();
+        auto offset = nowMicros(now) - toMicros(streamTime);
+        if (offset < m_windowMinOffset)
+        {
+            m_windowMinOffset = offset;
+        }
+        if (now - m_windowStart >=
+            std::chrono::seconds{int64_t{CORRECTION_WINDOW}})
+        {
+            // Slew towards the best estimate to avoid timestamp jumps
+            m_offset += (m_windowMinOffset - m_offset) / CORRECTION_GAIN;
+            m_epochOffset = epochOffset(now);
+            m_windowMinOffset = offset;
+            m_windowStart = now;
+        }
+    }
+
+private:
+    //! Duration of a drift correction window (seconds)
+    static const unsigned int CORRECTION_WINDOW{1};
+    //! Inverse of the fraction of the estimated error corrected per window
+    static const int64_t CORRECTION_GAIN{8};
+
+    //! Whether the clock has been anchored
+    bool m_anchored;
+    //! Constant added to every timestamp (microseconds)
+    int64_t m_epochShift;
+    //! Monotonic time at stream time zero (microseconds)
+    int64_t m_offset;
+    //! Epoch time at monotonic time zero (microseconds)
+    int64_t m_epochOffset;
+    //! Smallest offset observed in the current window (microseconds)
+    int64_t m_windowMinOffset;
+    //! Start of the current correction window
+    Clock::time_point m_windowStart;
+
+    void anchor(double streamTime)
+    {
+        auto now = Clock::now();
+        m_offset = nowMicros(now) - toMicros(streamTime);
+        m_epochOffset = epochOffset(now);
+        m_windowMinOffset = m_offset;
+        m_windowStart = now;
+        m_anchored = true;
+    }
+
+    static int64_t toMicros(double seconds)
+    {
+        return static_cast<int64_t>(seconds * 1e6);
+    }
+
+    static int64_t nowMicros(Clock::time_point now)
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(now.time_since_epoch()).count();
+    }
+
+    static int64_t epochOffset(Clock::time_point now)
+    {
+        using namespace std::chrono;
+        auto epochNow = duration_cast<microseconds>(
+                            system_clock::now().time_since_epoch()).count();
+        return epochNow - nowMicros(now);
+    }
+};
+}
+
+#endif
@@ -39,8 +39,8 @@ namespace midiendpoints
 //! Logger configuration file path
 const std::string LOGGER_CONF_PATH{"/etc/midiendpoints/logging.conf"};
 
-//! RtMidi API
-const RtMidi::Api MIDI_API = RtMidi::UNIX_JACK; // TODO tweak this
+//! Default RtMidi API name
+const std::string DEFAULT_MIDI_API{"jack"};
 
 //! MQTT quality of service
 const int MQTT_QOS = 0; // TODO tune this
@@ -55,6 +55,9 @@ typedef bsf::ProtobufArenaDataReadingFactory<masmusic::TimePointNote>
 typedef bsf::ProtobufPtrDataReading<masmusic::TimeSpanNote> TimeSpanNoteReading;
 typedef bsf::ProtobufArenaDataReadingFactory<masmusic::TimeSpanNote>
     TimeSpanNoteReadingFactory;
+typedef bsf::ProtobufPtrDataReading<masmusic::ClockSync> ClockSyncReading;
+typedef bsf::ProtobufArenaDataReadingFactory<masmusic::ClockSync>
+    ClockSyncReadingFactory;
 #else
 typedef bsf::ProtobufDataReading<masmusic::TimePointNote> TimePointNoteReading;
 typedef bsf::DefaultDataReadingFactory<masmusic::TimePointNote>
@@ -62,15 +65,20 @@ typedef bsf::DefaultDataReadingFactory<masmusic::TimePointNote>
 typedef bsf::ProtobufDataReading<masmusic::TimeSpanNote> TimeSpanNoteReading;
 typedef bsf::DefaultDataReadingFactory<masmusic::TimeSpanNote>
     TimeSpanNoteReadingFactory;
+typedef bsf::ProtobufDataReading<masmusic::ClockSync> ClockSyncReading;
+typedef bsf::DefaultDataReadingFactory<masmusic::ClockSync>
+    ClockSyncReadingFactory;
 #endif
 
 //! Serializer type
 #ifdef USE_BASE64
 typedef bsf::Base64Serializer<TimePointNoteReading> TimePointNoteSerializer;
 typedef bsf::Base64Serializer<TimeSpanNoteReading> TimeSpanNoteSerializer;
+typedef bsf::Base64Serializer<ClockSyncReading> ClockSyncSerializer;
 #else
 typedef bsf::DefaultSerializer<TimePointNoteReading> TimePointNoteSerializer;
 typedef bsf::DefaultSerializer<TimeSpanNoteReading> TimeSpanNoteSerializer;
+typedef bsf::DefaultSerializer<ClockSyncReading> ClockSyncSerializer;
 #endif
 
 //! MIDI default velocity
@@ -119,6 +127,37 @@ membuf<CharT, TraitsT> make_membuf(CharT *begin, CharT *end)
     return membuf<CharT, TraitsT>(begin, end);
 }
 
+//!
+//! \brief Get an RtMidi API from its name.
+//!
+//! \param name API name (jack, alsa, coremidi, winmm or dummy)
+//! \return The RtMidi API
+//!
+inline RtMidi::Api parseMidiApi(const std::string &name)
+{
+    if (name == "jack")
+    {
+        return RtMidi::UNIX_JACK;
+    }
+    else if (name == "alsa")
+    {
+        return RtMidi::LINUX_ALSA;
+    }
+    else if (name == "coremidi")
+    {
+        return RtMidi::MACOSX_CORE;
+    }
+    else if (name == "winmm")
+    {
+        return RtMidi::WINDOWS_MM;
+    }
+    else if (name == "dummy")
+    {
+        return RtMidi::RTMIDI_DUMMY;
+    }
+    throw MidiEndpointException("Unknown MIDI API '" + name + "'");
+}
+
 //!
 //! \brief Configure logging service.
 //!
@@ -0,0 +1,252 @@
+
+#ifndef MIDIPARSER_H
+#define MIDIPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Type of a MIDI channel voice message.
+//!
+//! Values follow the order of the status byte high nibble (0x8-0xE).
+//!
+enum class MidiEventType : uint8_t
+{
+    NOTE_OFF,
+    NOTE_ON,
+    POLY_PRESSURE,
+    CONTROL_CHANGE,
+    PROGRAM_CHANGE,
+    CHANNEL_PRESSURE,
+    PITCH_BEND
+};
+
+//!
+//! \brief A parsed MIDI channel voice message.
+//!
+//! For messages with a single data byte data2 is zero. Note on messages with
+//! zero velocity are reported as note off messages.
+//!
+struct MidiEvent
+{
+    //! Message type
+    MidiEventType type;
+    //! MIDI channel (0-15)
+    uint8_t channel;
+    //! First data byte
+    uint8_t data1;
+    //! Second data byte
+    uint8_t data2;
+};
+
+//!
+//! \brief Incremental MIDI byte stream parser.
+//!
+//! The parser is a finite state machine driven by a constant transition table
+//! indexed by the current state and the class of the input byte. It supports
+//! running status, real-time messages interleaved anywhere in the stream
+//! (which are ignored without disturbing the parser state), and skips SysEx
+//! and system common messages. Parsed channel voice messages are emitted in
+//! batches to a sink, without any memory allocation.
+//!
+//! The parser keeps its state between calls, so a stream may be fed in
+//! arbitrary pieces.
+//!
+//! This class is not thread-safe.
+//!
+class MidiParser
+{
+public:
+    //! Maximum number of events passed to the sink in a single call
+    static const std::size_t BATCH_SIZE{64};
+
+    //!
+    //! \brief Constructor.
+    //!
+    MidiParser()
+    : m_state{IDLE}
+    , m_status{0}
+    , m_data1{0}
+    {
+    }
+
+    //!
+    //! \brief Reset the parser state, discarding any running status.
+    //!
+    void reset()
+    {
+        m_state = IDLE;
+        m_status = 0;
+        m_data1 = 0;
+    }
+
+    //!
+    //! \brief Parse a piece of a MIDI stream.
+    //!
+    //! The sink is called as `sink(const MidiEvent *events, std::size_t n)`
+    //! with up to BATCH_SIZE events at a time, and at least once at the end of
+    //! the given data if any event was parsed.
+    //!
+    //! \param begin Beginning of the data
+    //! \param end End of the data
+    //! \param sink Callable receiving batches of parsed events
+    //!
+    template <typename SinkT>
+    void parse(const unsigned char *begin, const unsigned char *end,
+               SinkT &&sink)
+    {
+        MidiEvent batch[BATCH_SIZE];
+        std::size_t count{0};
+        for (auto p = begin; p != end; ++p) {
+            auto byte = *p;
+            const auto &transition =
+                transitionTable()[m_state][byteClass(byte)];
+            m_state = transition.next;
+            switch (transition.action)
+            {
+            case STATUS:
+                m_status = byte;
+                break;
+            case DATA1:
+                m_data1 = byte;
+                break;
+            case EMIT1:
+                batch[count++] = makeEvent(byte, 0);
+                break;
+            case EMIT2:
+                batch[count++] = makeEvent(m_data1, byte);
+                break;
+            default:
+                break;
+            }
+            if (count == BATCH_SIZE)
+            {
+                sink(static_cast<const MidiEvent *>(batch), count);
+                count = 0;
+            }
+        }
+        if (count > 0)
+        {
+            sink(static_cast<const MidiEvent *>(batch), count);
+        }
+    }
+
+private:
+    //! Parser states
+    enum State : uint8_t
+    {
+        IDLE,         //!< No running status
+        DATA1_OF_1,   //!< Expecting the data byte of a 1-byte message
+        DATA1_OF_2,   //!< Expecting the first data byte of a 2-byte message
+        DATA2,        //!< Expecting the second data byte of a 2-byte message
+        SYSEX,        //!< Skipping a SysEx message
+        SKIP1,        //!< Skipping the last data byte of a system message
+        SKIP2,        //!< Skipping two data bytes of a system message
+        STATE_COUNT
+    };
+
+    //! Input byte classes
+    enum ByteClass : uint8_t
+    {
+        DATA,         //!< Data byte (0x00-0x7F)
+        STATUS_1,     //!< Channel message with 1 data byte (0xC0-0xDF)
+        STATUS_2,     //!< Channel message with 2 data bytes
+        SYSEX_START,  //!< 0xF0
+        SYSEX_END,    //!< 0xF7
+        COMMON_0,     //!< System common message without data (or undefined)
+        COMMON_1,     //!< System common message with 1 data byte
+        COMMON_2,     //!< System common message with 2 data bytes
+        REALTIME,     //!< System real-time message (0xF8-0xFF)
+        CLASS_COUNT
+    };
+
+    //! Actions performed on a transition
+    enum Action : uint8_t
+    {
+        NONE,   //!< Do nothing
+        STATUS, //!< Store the byte as running status
+        DATA1,  //!< Store the byte as first data byte
+        EMIT1,  //!< Emit a 1-byte message with the byte as data
+        EMIT2   //!< Emit a 2-byte message with the byte as second data byte
+    };
+
+    //! \brief Parser state transition.
+    struct Transition
+    {
+        State next;
+        Action action;
+    };
+
+    //! Current parser state
+    State m_state;
+    //! Current running status
+    uint8_t m_status;
+    //! Last received first data byte
+    uint8_t m_data1;
+
+    //!
+    //! \return The state transition table, indexed by state and byte class
+    //!
+    static const Transition (&transitionTable())[STATE_COUNT][CLASS_COUNT]
+    {
+        // Status bytes behave the same in every state, except for real-time
+        // bytes, which keep the current state
+        // clang-format off
+        static constexpr Transition TABLE[STATE_COUNT][CLASS_COUNT] = {
+        //   DATA                 STATUS_1              STATUS_2              SYSEX_START    SYSEX_END     COMMON_0      COMMON_1       COMMON_2       REALTIME
+            {{IDLE, NONE},        {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {IDLE, NONE}},       // IDLE
+            {{DATA1_OF_1, EMIT1}, {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {DATA1_OF_1, NONE}}, // DATA1_OF_1
+            {{DATA2, DATA1},      {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {DATA1_OF_2, NONE}}, // DATA1_OF_2
+            {{DATA1_OF_2, EMIT2}, {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {DATA2, NONE}},      // DATA2
+            {{SYSEX, NONE},       {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {SYSEX, NONE}},      // SYSEX
+            {{IDLE, NONE},        {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {SKIP1, NONE}},      // SKIP1
+            {{SKIP1, NONE},       {DATA1_OF_1, STATUS}, {DATA1_OF_2, STATUS}, {SYSEX, NONE}, {IDLE, NONE}, {IDLE, NONE}, {SKIP1, NONE}, {SKIP2, NONE}, {SKIP2, NONE}}       // SKIP2
+        };
+        // clang-format on
+        return TABLE;
+    }
+
+    //!
+    //! \param byte A MIDI stream byte
+    //! \return The class of the byte
+    //!
+    static ByteClass byteClass(unsigned char byte)
+    {
+        static constexpr ByteClass SYSTEM_CLASSES[16] = {
+            SYSEX_START, COMMON_1, COMMON_2, COMMON_1, COMMON_0, COMMON_0,
+            COMMON_0,    SYSEX_END, REALTIME, REALTIME, REALTIME, REALTIME,
+            REALTIME,    REALTIME, REALTIME, REALTIME};
+        if (byte < 0x80)
+        {
+            return DATA;
+        }
+        if (byte < 0xF0)
+        {
+            return (byte & 0xE0) == 0xC0 ? STATUS_1 : STATUS_2;
+        }
+        return SYSTEM_CLASSES[byte & 0x0F];
+    }
+
+    //!
+    //! \brief Make an event from the running status.
+    //!
+    //! \param data1 First data byte
+    //! \param data2 Second data byte
+    //! \return The parsed event
+    //!
+    MidiEvent makeEvent(uint8_t data1, uint8_t data2) const
+    {
+        auto type = static_cast<MidiEventType>((m_status >> 4) - 8);
+        if (type == MidiEventType::NOTE_ON && data2 == 0)
+        {
+            type = MidiEventType::NOTE_OFF;
+        }
+        return {type, static_cast<uint8_t>(m_status & 0x0F), data1, data2};
+    }
+};
+}
+
+#endif
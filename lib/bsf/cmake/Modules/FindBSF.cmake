@@ -20,8 +20,13 @@ find_path(BSF_INCLUDE_DIR
   PATHS ${BSF_PKGCONF_INCLUDE_DIRS}
 )
 
-# No compiled library
-set (BSF_LIBRARY "")
+# No compiled library, but the shared memory transport needs the POSIX
+# realtime library on Linux
+if (CMAKE_SYSTEM_NAME STREQUAL "Linux")
+  set (BSF_LIBRARY rt)
+else ()
+  set (BSF_LIBRARY "")
+endif ()
 
 if (NOT BSF_VERSION)
   # TODO: find proper version string
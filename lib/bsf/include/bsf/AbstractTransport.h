@@ -3,11 +3,12 @@
 #define BSF_ABSTRACTTRANSPORT_H
 
 #include "common.h"
+#include "ChannelTable.h"
+#include "RcuCell.h"
+#include "TopicTrie.h"
 
 #include <functional>
 #include <memory>
-#include <tuple>
-#include <unordered_map>
 #include <vector>
 
 namespace bsf
@@ -20,6 +21,10 @@ namespace bsf
 //! transport. While transport implementations are not strictly required to
 //! subclass this template, it is generally convenient to do so.
 //!
+//! String channels are MQTT-style topics: handlers may be added to channels
+//! with '+' and '#' wildcards (see TopicTrie), and they are called for every
+//! message received in a matching channel.
+//!
 //! \tparam ChannelT Channel type for the transport
 //!
 template <typename ChannelT>
@@ -32,6 +37,9 @@ public:
     //! Handler type for the transport
     typedef std::function<void(const std::vector<unsigned char> &)> Handler;
 
+    //! Handler type for the transport receiving messages without copying them
+    typedef std::function<void(ByteSpan)> SpanHandler;
+
     //!
     //! \brief Constructor.
     //!
@@ -51,7 +59,12 @@ public:
     //! channel. Handlers are called in unspecific order, and, depending on the
     //! transport, they may be called from different threads.
     //!
-    //! This function is not thread-safe.
+    //! This function is thread-safe, and it may be called while messages are
+    //! being delivered, even from a handler.
+    //!
+    //! Every message is copied into a vector before calling the handler, so
+    //! addSpanHandler() should be preferred when the handler does not need to
+    //! keep the message.
     //!
     //! \param handler New handler
     //! \param channel Channel where the handler is added
@@ -59,12 +72,27 @@ public:
     HandlerToken addHandler(Handler handler,
                             const Channel &channel = Channel());
 
+    //!
+    //! \brief Add a new handler for new incoming messages in a channel.
+    //!
+    //! Same as addHandler(), but the handler receives a view of the message
+    //! owned by the transport, which is only valid during the call.
+    //!
+    //! This function is thread-safe.
+    //!
+    //! \param handler New handler
+    //! \param channel Channel where the handler is added
+    //!
+    HandlerToken addSpanHandler(SpanHandler handler,
+                                const Channel &channel = Channel());
+
     //!
     //! \brief Remove a handler for a channel in the transport.
     //!
     //! If the handler does not exist this function has no effect.
     //!
-    //! This function is not thread-safe.
+    //! This function is thread-safe. Deliveries already in progress when it is
+    //! called may still call the removed handler.
     //!
     //! \param token Token of the handler to remove
     //! \param channel Channel from where the handler is removed
@@ -82,12 +110,60 @@ public:
                          const Channel &channel = Channel()) = 0;
 
 protected:
+    //!
+    //! \brief Find the identifier of a channel.
+    //!
+    //! Channels are interned when a handler is first added to them, and their
+    //! identifiers remain valid for the lifetime of the transport. Transports
+    //! may look up incoming channels once and dispatch messages by identifier.
+    //!
+    //! \param key Channel, or a key equivalent to it (e.g. a null-terminated
+    //!            string for string channels)
+    //! \return Identifier of the channel, or INVALID_CHANNEL_ID if no handler
+    //!         was ever added to it
+    //!
+    template <typename KeyT>
+    ChannelId findChannel(const KeyT &key) const;
+
+    //!
+    //! \brief Call every handler of a channel with a message.
+    //!
+    //! Only the handlers added to that exact channel are called, not those of
+    //! wildcard channels matching it.
+    //!
+    //! \param message Message data
+    //! \param id Identifier of the channel where the message was received
+    //!
+    void callHandlers(ByteSpan message, ChannelId id) const;
+
+    //!
+    //! \brief Call every handler of a channel with a message.
+    //!
+    //! The handlers of the wildcard channels matching the channel are called
+    //! as well.
+    //!
+    //! \param message Message data
+    //! \param key Channel where the message was received, or a key equivalent
+    //!            to it (e.g. a null-terminated string for string channels)
+    //!
+    template <typename KeyT>
+    void callHandlers(ByteSpan message, const KeyT &key) const;
+
     //!
     //! \brief Call every handler of a channel with a message.
     //!
+    //! The handlers of the wildcard channels matching the channel are called
+    //! as well.
+    //!
     //! \param message Message data
     //! \param channel Channel where the message was received
     //!
+    void callHandlers(ByteSpan message,
+                      const Channel &channel = Channel()) const;
+
+    //!
+    //! \copydoc callHandlers
+    //!
     void callHandlers(const std::vector<unsigned char> &message,
                       const Channel &channel = Channel()) const;
 
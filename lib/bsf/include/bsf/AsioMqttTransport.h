@@ -0,0 +1,197 @@
+
+#ifndef BSF_ASIOMQTTTRANSPORT_H
+#define BSF_ASIOMQTTTRANSPORT_H
+
+#include "common.h"
+#include "AbstractTransport.h"
+#include "detail/MqttClient.h"
+
+#include <asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bsf
+{
+
+//!
+//! \brief MQTT transport driven by an ASIO event loop.
+//!
+//! MQTT transport for a BSF network which, unlike AsyncMqttTransport, does not
+//! start any thread: the MQTT connection is served by an ASIO service owned by
+//! the application, so network I/O, message handlers and any other work of the
+//! application can share one event loop.
+//!
+//! Message handlers are called from the ASIO service. Messages may be
+//! published from any thread.
+//!
+//! Instancing this class does not start the operation of the transport. It is
+//! necessary to call \link AsioMqttTransport::start for the transport to
+//! interact with the server.
+//!
+//! The connection is established asynchronously. If it fails or is lost, it
+//! is retried with an exponential backoff, and every channel in use is
+//! subscribed again once it is restored. Messages published while
+//! disconnected are kept in a bounded queue and sent on reconnection.
+//!
+class AsioMqttTransport : public AbstractTransport<std::string>
+{
+public:
+    //! Policies for messages published while the offline queue is full
+    typedef bsf::OverflowPolicy OverflowPolicy;
+
+    //! Default minimum delay between reconnection attempts (seconds)
+    static const unsigned int DEFAULT_RECONNECT_DELAY_MIN{1};
+    //! Default maximum delay between reconnection attempts (seconds)
+    static const unsigned int DEFAULT_RECONNECT_DELAY_MAX{30};
+    //! Default capacity of the offline queue (messages)
+    static const std::size_t DEFAULT_OFFLINE_CAPACITY{1024};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param asio ASIO service serving the connection
+    //! \param clientName Client identifier
+    //! \param server MQTT server name or address
+    //! \param port MQTT server port
+    //! \param qos MQTT QoS (0, 1 or 2)
+    //!
+    AsioMqttTransport(asio::io_service &asio, const std::string &clientName,
+                      const std::string &server, unsigned int port, int qos);
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~AsioMqttTransport();
+
+    //!
+    //! \copydoc AbstractTransport::publish
+    //!
+    void publish(const std::vector<unsigned char> &message,
+                 const Channel &channel = Channel());
+
+    //!
+    //! \brief Start the MQTT transport.
+    //!
+    //! Starts the operation of the MQTT transport in the ASIO service.
+    //!
+    void start();
+
+    //!
+    //! \brief Stop the MQTT transport.
+    //!
+    //! Stops the operation of the MQTT transport, waiting for the ASIO service
+    //! to disconnect, so the service must be running. When called from a
+    //! handler of the service, it runs the service handlers itself while
+    //! waiting, so it may be called, or the transport destroyed, from a
+    //! service run by a single thread.
+    //!
+    void stop();
+
+    //!
+    //! \brief Get the configured MQTT quality of service.
+    //!
+    //! \return The configured MQTT quality of service
+    //!
+    int getQos() const;
+
+    //!
+    //! \brief Set the MQTT quality of service.
+    //!
+    //! Changing the quality of service will only have effect on future
+    //! publications and channel subscriptions.
+    //!
+    //! \param qos The new MQTT quality of service
+    //!
+    void setQos(int qos);
+
+    //!
+    //! \brief Get the configured MQTT retainment policy.
+    //!
+    //! \return true if the messages should be retained on the server, false
+    //!         otherwise
+    //!
+    bool isRetained() const;
+
+    //!
+    //! \brief Set the MQTT retainment policy.
+    //!
+    //! \param retain true if the messages should be retained on the server,
+    //!               false otherwise
+    //!
+    void setRetained(bool retain);
+
+    //!
+    //! \brief Check whether the transport is connected to the server.
+    //!
+    //! \return true if the transport is connected, false otherwise
+    //!
+    bool isConnected() const;
+
+    //!
+    //! \brief Set the delay between reconnection attempts.
+    //!
+    //! The delay starts at the minimum and doubles after every failed attempt
+    //! up to the maximum.
+    //!
+    //! \param min Minimum delay (seconds)
+    //! \param max Maximum delay (seconds)
+    //!
+    void setReconnectDelay(unsigned int min, unsigned int max);
+
+    //!
+    //! \brief Configure the queue of messages published while disconnected.
+    //!
+    //! If the new capacity is smaller than the number of queued messages, the
+    //! oldest ones are dropped. A zero capacity disables the queue.
+    //!
+    //! \param capacity Maximum number of queued messages
+    //! \param policy Policy applied when a message is published with the
+    //!               queue full
+    //!
+    void setOfflineQueue(std::size_t capacity, OverflowPolicy policy);
+
+    //!
+    //! \brief Get the number of messages waiting for the connection.
+    //!
+    //! \return The number of queued messages
+    //!
+    std::size_t getQueuedCount() const;
+
+    //!
+    //! \brief Get the number of dropped messages.
+    //!
+    //! \return The number of messages dropped because the offline queue was
+    //!         full
+    //!
+    uint64_t getDroppedCount() const;
+
+protected:
+    //!
+    //! \brief Subscribe to a channel.
+    //!
+    //! \brief channel New channel
+    //!
+    virtual void useChannel(const Channel &channel);
+
+    //!
+    //! \brief Unsubscribe from the channel.
+    //!
+    //! \brief channel Drop channel
+    //!
+    virtual void dropChannel(const Channel &channel);
+
+private:
+    //! Pimpl
+    class Impl;
+    friend class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+} // bsf
+
+#include "detail/AsioMqttTransport.h"
+
+#endif
@@ -5,7 +5,10 @@
 #include "common.h"
 #include "AbstractTransport.h"
 #include "Singleton.h"
+#include "detail/MqttClient.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -23,11 +26,31 @@ namespace bsf
 //! necessary to call \link AsyncMqttTransport::start for the transport to
 //! interact with the server.
 //!
-//! \todo Manage connection failures and disconnections.
+//! The connection is established asynchronously. If it fails or is lost, it
+//! is retried with an exponential backoff, and every channel in use is
+//! subscribed again once it is restored. Messages published while
+//! disconnected are kept in a bounded queue and sent on reconnection.
+//!
+//! By default, messages are handed to the MQTT library from the publishing
+//! thread. In asynchronous publish mode, they are pushed into a lock-free
+//! queue instead, and a dedicated thread, which also runs the MQTT client
+//! loop, hands them over back to back and writes every batch to the socket
+//! at once; producers do not contend with the MQTT loop thread, and only wake
+//! the publisher thread up when it is idle.
 //!
 class AsyncMqttTransport : public AbstractTransport<std::string>
 {
 public:
+    //! Policies for messages published while the offline queue is full
+    typedef bsf::OverflowPolicy OverflowPolicy;
+
+    //! Default minimum delay between reconnection attempts (seconds)
+    static const unsigned int DEFAULT_RECONNECT_DELAY_MIN{1};
+    //! Default maximum delay between reconnection attempts (seconds)
+    static const unsigned int DEFAULT_RECONNECT_DELAY_MAX{30};
+    //! Default capacity of the offline queue (messages)
+    static const std::size_t DEFAULT_OFFLINE_CAPACITY{1024};
+
     //!
     //! \brief Constructor.
     //!
@@ -97,6 +120,69 @@ public:
     //!
     void setRetained(bool retain);
 
+    //!
+    //! \brief Set the publish mode.
+    //!
+    //! Must be called while the transport is stopped.
+    //!
+    //! \param capacity Capacity of the publish queue (messages), or zero to
+    //!                 publish synchronously
+    //! \throw std::logic_error if the transport is started
+    //!
+    void setAsyncPublish(std::size_t capacity);
+
+    //!
+    //! \brief Check whether the asynchronous publish mode is enabled.
+    //!
+    //! \return true if messages are published asynchronously, false otherwise
+    //!
+    bool isAsyncPublish() const;
+
+    //!
+    //! \brief Check whether the transport is connected to the server.
+    //!
+    //! \return true if the transport is connected, false otherwise
+    //!
+    bool isConnected() const;
+
+    //!
+    //! \brief Set the delay between reconnection attempts.
+    //!
+    //! The delay starts at the minimum and doubles after every failed attempt
+    //! up to the maximum.
+    //!
+    //! \param min Minimum delay (seconds)
+    //! \param max Maximum delay (seconds)
+    //!
+    void setReconnectDelay(unsigned int min, unsigned int max);
+
+    //!
+    //! \brief Configure the queue of messages published while disconnected.
+    //!
+    //! If the new capacity is smaller than the number of queued messages, the
+    //! oldest ones are dropped. A zero capacity disables the queue.
+    //!
+    //! \param capacity Maximum number of queued messages
+    //! \param policy Policy applied when a message is published with the
+    //!               queue full
+    //!
+    void setOfflineQueue(std::size_t capacity, OverflowPolicy policy);
+
+    //!
+    //! \brief Get the number of messages waiting for the connection.
+    //!
+    //! \return The number of queued messages
+    //!
+    std::size_t getQueuedCount() const;
+
+    //!
+    //! \brief Get the number of dropped messages.
+    //!
+    //! \return The number of messages dropped because the offline queue or the
+    //!         publish queue was full
+    //!
+    uint64_t getDroppedCount() const;
+
 protected:
     //!
     //! \brief Subscribe to a channel.
@@ -0,0 +1,72 @@
+
+#ifndef BSF_BASE64_H
+#define BSF_BASE64_H
+
+#include "common.h"
+
+#include <cstddef>
+
+namespace bsf
+{
+
+//!
+//! \brief Base64 codec.
+//!
+//! Encodes and decodes the standard Base64 alphabet with padding (RFC 4648)
+//! into caller-provided memory, so that the result can be written directly
+//! into its destination once its exact size is known.
+//!
+//! Bulk blocks are processed with SSSE3 instructions when the code is built
+//! for a target supporting them (e.g. with -mssse3 or -march=native), and
+//! with lookup tables otherwise.
+//!
+class Base64
+{
+public:
+    //!
+    //! \brief Get the size of the encoding of some data.
+    //!
+    //! \param size Size of the data (bytes)
+    //! \return The size of the encoded text (bytes)
+    //!
+    static std::size_t encodedSize(std::size_t size)
+    {
+        return (size + 2) / 3 * 4;
+    }
+
+    //!
+    //! \brief Get the size of the data encoded by a text.
+    //!
+    //! The size is exact for well-formed texts, and an upper bound otherwise.
+    //!
+    //! \param text Encoded text
+    //! \return The size of the decoded data (bytes)
+    //!
+    static std::size_t decodedSize(ByteSpan text);
+
+    //!
+    //! \brief Encode some data.
+    //!
+    //! \param data Data
+    //! \param out Output, of \link Base64::encodedSize bytes at least
+    //!
+    static void encode(ByteSpan data, unsigned char *out);
+
+    //!
+    //! \brief Decode a text.
+    //!
+    //! Characters out of the alphabet (e.g. line breaks) are skipped, and
+    //! decoding ends at the first padding character.
+    //!
+    //! \param text Encoded text
+    //! \param out Output, of \link Base64::decodedSize bytes at least
+    //! \return The size of the decoded data (bytes)
+    //!
+    static std::size_t decode(ByteSpan text, unsigned char *out);
+};
+
+} // bsf
+
+#include "detail/Base64.h"
+
+#endif
@@ -3,11 +3,9 @@
 #define BSF_BASE64SERIALIZER_H
 
 #include "common.h"
+#include "Base64.h"
+#include "BufferPool.h"
 
-#include <b64/encode.h>
-#include <b64/decode.h>
-
-#include <sstream>
 #include <vector>
 
 namespace bsf
@@ -17,7 +15,9 @@ namespace bsf
 //! \brief Base64 serializer.
 //!
 //! This serializer wraps the functionality of another serializer performing a
-//! Base64 encoding and decoding over the obtained byte array.
+//! Base64 encoding and decoding over the obtained byte array. The encoding is
+//! written directly into the message, and the wrapped serializer works on
+//! pooled buffers, so no memory is allocated once the buffers are warm.
 //!
 //! \note This class is thread-safe only when the given serializer type is
 //!       thread-safe.
@@ -38,39 +38,30 @@ public:
         std::vector<unsigned char> &message)
     {
         // Serialize
-        std::vector<unsigned char> decoded;
-        m_wrapped.serialize(reading, decoded);
+        auto decoded = BufferPool::acquire();
+        m_wrapped.serialize(reading, *decoded);
         // Encode message
-        auto p1 = reinterpret_cast<const char *>(decoded.data());
-        std::istringstream decodedStream(std::string(p1, decoded.size()));
-        std::stringstream encodedStream;
-        base64::encoder encoder;
-        encoder.encode(decodedStream, encodedStream);
-        // Copy encoded message to vector
-        message.resize(((decoded.size() + 2) / 3) * 4);
-        auto p2 = reinterpret_cast<char *>(message.data());
-        encodedStream.read(p2, message.size());
-        message.resize(encodedStream.gcount());
+        message.resize(Base64::encodedSize(decoded->size()));
+        Base64::encode(ByteSpan(*decoded), message.data());
     }
 
     void
     deserialize(const std::vector<unsigned char> &message,
                 typename SerializerTraits<SerializerT>::DataReading &reading)
+    {
+        deserialize(ByteSpan(message), reading);
+    }
+
+    void
+    deserialize(ByteSpan message,
+                typename SerializerTraits<SerializerT>::DataReading &reading)
     {
         // Decode message
-        auto p1 = reinterpret_cast<const char *>(message.data());
-        std::istringstream encodedStream(std::string(p1, message.size()));
-        std::stringstream decodedStream;
-        base64::decoder decoder;
-        decoder.decode(encodedStream, decodedStream);
-        // Copy decoded message to vector
-        std::vector<unsigned char> decoded;
-        decoded.resize((message.size() * 3) / 4);
-        auto p2 = reinterpret_cast<char *>(decoded.data());
-        decodedStream.read(p2, decoded.size());
-        decoded.resize(decodedStream.gcount());
+        auto decoded = BufferPool::acquire();
+        decoded->resize(Base64::decodedSize(message));
+        decoded->resize(Base64::decode(message, decoded->data()));
         // Deserialize
-        m_wrapped.deserialize(decoded, reading);
+        deserializeSpan(m_wrapped, ByteSpan(*decoded), reading);
     }
 
 private:
@@ -0,0 +1,119 @@
+
+#ifndef BSF_BUFFERPOOL_H
+#define BSF_BUFFERPOOL_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Per-thread pool of reusable byte buffers.
+//!
+//! Buffers are borrowed from the pool of the calling thread and given back,
+//! cleared but keeping their capacity, when the lease is destroyed. Once a
+//! thread has warmed its pool up, borrowing buffers for messages of similar
+//! size does not allocate memory.
+//!
+//! Several buffers may be borrowed at once by the same thread (e.g. when a
+//! message is published from a handler called while publishing another), so
+//! every lease owns its buffer exclusively.
+//!
+class BufferPool
+{
+public:
+    //! Byte buffer type.
+    typedef std::vector<unsigned char> Buffer;
+
+    //! Maximum number of idle buffers kept by every thread
+    static const std::size_t MAX_IDLE_BUFFERS{8};
+
+    //!
+    //! \brief Buffer borrowed from a pool.
+    //!
+    class Lease
+    {
+    public:
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        Lease(Lease &&other)
+        : m_buffer(std::move(other.m_buffer))
+        , m_owner{other.m_owner}
+        {
+            other.m_owner = false;
+        }
+
+        //!
+        //! \brief Destructor.
+        //!
+        //! Gives the buffer back to the pool of the calling thread.
+        //!
+        ~Lease()
+        {
+            auto &idle = BufferPool::idle();
+            if (m_owner && idle.size() < MAX_IDLE_BUFFERS)
+            {
+                m_buffer.clear();
+                idle.push_back(std::move(m_buffer));
+            }
+        }
+
+        //! \return The buffer
+        Buffer &operator*()
+        {
+            return m_buffer;
+        }
+
+        //! \return The buffer
+        Buffer *operator->()
+        {
+            return &m_buffer;
+        }
+
+    private:
+        friend class BufferPool;
+
+        explicit Lease(Buffer buffer)
+        : m_buffer(std::move(buffer))
+        , m_owner{true}
+        {
+        }
+
+        //! Borrowed buffer
+        Buffer m_buffer;
+        //! Whether the lease still owns the buffer
+        bool m_owner;
+    };
+
+    //!
+    //! \brief Borrow a buffer from the pool of the calling thread.
+    //!
+    //! \return The lease of an empty buffer
+    //!
+    static Lease acquire()
+    {
+        auto &idle = BufferPool::idle();
+        if (idle.empty())
+        {
+            return Lease(Buffer());
+        }
+        Lease lease(std::move(idle.back()));
+        idle.pop_back();
+        return lease;
+    }
+
+private:
+    //! \return The idle buffers of the calling thread
+    static std::vector<Buffer> &idle()
+    {
+        static thread_local std::vector<Buffer> buffers;
+        return buffers;
+    }
+};
+
+} // bsf
+
+#endif
@@ -0,0 +1,104 @@
+
+#ifndef BSF_BYTESPAN_H
+#define BSF_BYTESPAN_H
+
+#include <cstddef>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Non-owning view of a contiguous sequence of bytes.
+//!
+//! A span does not copy nor manage the viewed bytes, which must outlive it.
+//! It is used to hand received messages over without copying them.
+//!
+class ByteSpan
+{
+public:
+    //! Byte type.
+    typedef unsigned char value_type;
+    //! Iterator type.
+    typedef const unsigned char *const_iterator;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! Creates an empty span.
+    //!
+    ByteSpan()
+    : m_data{nullptr}
+    , m_size{0}
+    {
+    }
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param data Beginning of the bytes
+    //! \param size Number of bytes
+    //!
+    ByteSpan(const unsigned char *data, std::size_t size)
+    : m_data{data}
+    , m_size{size}
+    {
+    }
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param bytes Vector with the bytes
+    //!
+    ByteSpan(const std::vector<unsigned char> &bytes)
+    : m_data{bytes.data()}
+    , m_size{bytes.size()}
+    {
+    }
+
+    //! \return Beginning of the bytes
+    const unsigned char *data() const
+    {
+        return m_data;
+    }
+
+    //! \return Number of bytes
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    //! \return Whether the span is empty
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    //! \return Iterator to the beginning of the bytes
+    const_iterator begin() const
+    {
+        return m_data;
+    }
+
+    //! \return Iterator to the end of the bytes
+    const_iterator end() const
+    {
+        return m_data + m_size;
+    }
+
+    //! \return A copy of the bytes
+    std::vector<unsigned char> toVector() const
+    {
+        return std::vector<unsigned char>(begin(), end());
+    }
+
+private:
+    //! Beginning of the bytes
+    const unsigned char *m_data;
+    //! Number of bytes
+    std::size_t m_size;
+};
+
+} // bsf
+
+#endif
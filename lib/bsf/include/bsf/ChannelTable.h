@@ -0,0 +1,235 @@
+
+#ifndef BSF_CHANNELTABLE_H
+#define BSF_CHANNELTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bsf
+{
+
+//! Identifier of an interned channel.
+typedef unsigned int ChannelId;
+
+//! Identifier returned for channels that have not been interned.
+static const ChannelId INVALID_CHANNEL_ID{static_cast<ChannelId>(-1)};
+
+//!
+//! \brief Hash a sequence of characters (32-bit FNV-1a).
+//!
+//! \param data Beginning of the characters
+//! \param size Number of characters
+//! \return Hash of the characters
+//!
+inline std::size_t channelHash(const char *data, std::size_t size)
+{
+    uint32_t hash{2166136261u};
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//!
+//! \brief Hash a string channel.
+//!
+//! \param channel Channel
+//! \return Hash of the channel
+//!
+inline std::size_t channelHash(const std::string &channel)
+{
+    return channelHash(channel.data(), channel.size());
+}
+
+//!
+//! \brief Hash a string channel given as a null-terminated string.
+//!
+//! The hash is the same as that of the equivalent std::string, so string
+//! channels can be looked up without building a string.
+//!
+//! \param channel Channel
+//! \return Hash of the channel
+//!
+inline std::size_t channelHash(const char *channel)
+{
+    return channelHash(channel, std::strlen(channel));
+}
+
+//!
+//! \brief Hash a channel.
+//!
+//! \param channel Channel
+//! \return Hash of the channel
+//!
+template <typename ChannelT>
+std::size_t channelHash(const ChannelT &channel)
+{
+    return std::hash<ChannelT>()(channel);
+}
+
+//!
+//! \brief Table of interned channels.
+//!
+//! Maps every added channel to a small integer identifier, assigned
+//! consecutively from zero, so data indexed by channel can be kept in a
+//! vector. Identifiers are never released.
+//!
+//! Channels are looked up in a flat open addressing table with linear probing,
+//! which holds the hash of every channel so most probes only compare integers.
+//! Lookups accept any key that can be hashed with channelHash() and compared
+//! with a channel, e.g. a null-terminated string for std::string channels.
+//!
+//! This class is not thread-safe.
+//!
+//! \tparam ChannelT Channel type
+//!
+template <typename ChannelT>
+class ChannelTable
+{
+public:
+    //! Channel type
+    typedef ChannelT Channel;
+
+    //!
+    //! \brief Constructor.
+    //!
+    ChannelTable()
+    : m_channels()
+    , m_slots(INITIAL_SLOTS)
+    {
+    }
+
+    //!
+    //! \brief Intern a channel.
+    //!
+    //! \param channel Channel
+    //! \return Identifier of the channel
+    //!
+    ChannelId intern(const Channel &channel)
+    {
+        auto hash = channelHash(channel);
+        auto id = find(channel, hash);
+        if (id != INVALID_CHANNEL_ID)
+        {
+            return id;
+        }
+        // Keep the load factor under one half
+        if ((m_channels.size() + 1) * 2 > m_slots.size())
+        {
+            grow();
+        }
+        id = static_cast<ChannelId>(m_channels.size());
+        m_channels.push_back(channel);
+        insert(Slot{hash, id});
+        return id;
+    }
+
+    //!
+    //! \brief Find an interned channel.
+    //!
+    //! \param key Channel, or a key equivalent to it
+    //! \return Identifier of the channel, or INVALID_CHANNEL_ID if the channel
+    //!         has not been interned
+    //!
+    template <typename KeyT>
+    ChannelId find(const KeyT &key) const
+    {
+        return find(key, channelHash(key));
+    }
+
+    //!
+    //! \brief Get an interned channel.
+    //!
+    //! \param id Identifier of the channel
+    //! \return The channel
+    //!
+    const Channel &get(ChannelId id) const
+    {
+        return m_channels[id];
+    }
+
+    //! \return Number of interned channels
+    std::size_t size() const
+    {
+        return m_channels.size();
+    }
+
+private:
+    //! Initial number of slots (a power of two)
+    static const std::size_t INITIAL_SLOTS{16};
+
+    //! \brief Slot of the table.
+    struct Slot
+    {
+        //! Hash of the channel
+        std::size_t hash;
+        //! Identifier of the channel, or INVALID_CHANNEL_ID if empty
+        ChannelId id;
+
+        Slot()
+        : hash{0}
+        , id{INVALID_CHANNEL_ID}
+        {
+        }
+
+        Slot(std::size_t hash, ChannelId id)
+        : hash{hash}
+        , id{id}
+        {
+        }
+    };
+
+    //! Interned channels, by identifier
+    std::vector<Channel> m_channels;
+    //! Slots of the table
+    std::vector<Slot> m_slots;
+
+    template <typename KeyT>
+    ChannelId find(const KeyT &key, std::size_t hash) const
+    {
+        auto mask = m_slots.size() - 1;
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            const auto &slot = m_slots[i];
+            if (slot.id == INVALID_CHANNEL_ID)
+            {
+                return INVALID_CHANNEL_ID;
+            }
+            if (slot.hash == hash && m_channels[slot.id] == key)
+            {
+                return slot.id;
+            }
+        }
+    }
+
+    void insert(const Slot &slot)
+    {
+        auto mask = m_slots.size() - 1;
+        auto i = slot.hash & mask;
+        while (m_slots[i].id != INVALID_CHANNEL_ID)
+        {
+            i = (i + 1) & mask;
+        }
+        m_slots[i] = slot;
+    }
+
+    void grow()
+    {
+        std::vector<Slot> slots(m_slots.size() * 2);
+        slots.swap(m_slots);
+        for (const auto &slot : slots) {
+            if (slot.id != INVALID_CHANNEL_ID)
+            {
+                insert(slot);
+            }
+        }
+    }
+};
+
+} // bsf
+
+#endif
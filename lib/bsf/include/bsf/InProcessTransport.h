@@ -0,0 +1,105 @@
+
+#ifndef BSF_INPROCESSTRANSPORT_H
+#define BSF_INPROCESSTRANSPORT_H
+
+#include "common.h"
+#include "AbstractTransport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bsf
+{
+
+//!
+//! \brief Transport delivering messages within the process.
+//!
+//! Broker-less transport for sensors and clients living in the same process.
+//! Messages published to a channel are delivered to the handlers of that
+//! channel, and of the wildcard channels matching it, without leaving the
+//! process.
+//!
+//! In synchronous mode, handlers are called from the publishing thread with a
+//! view of the published message, which is never copied. In queued mode,
+//! messages are copied into a lock-free queue and delivered by a dedicated
+//! thread, so publishers never run handlers; messages published with the
+//! queue full are dropped.
+//!
+//! Instancing this class does not start the operation of the transport. It is
+//! necessary to call \link InProcessTransport::start for the transport to
+//! deliver messages; messages published while stopped are discarded.
+//!
+class InProcessTransport : public AbstractTransport<std::string>
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param queueCapacity Capacity of the delivery queue (messages), or zero
+    //!                      to deliver synchronously
+    //!
+    explicit InProcessTransport(std::size_t queueCapacity = 0);
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~InProcessTransport();
+
+    //!
+    //! \copydoc AbstractTransport::publish
+    //!
+    void publish(const std::vector<unsigned char> &message,
+                 const Channel &channel = Channel());
+
+    //!
+    //! \brief Start the transport.
+    //!
+    //! Starts delivering messages, launching the delivery thread in queued
+    //! mode.
+    //!
+    void start();
+
+    //!
+    //! \brief Stop the transport.
+    //!
+    //! Stops delivering messages. In queued mode, the messages already queued
+    //! are delivered before the delivery thread finishes.
+    //!
+    void stop();
+
+    //!
+    //! \brief Check whether messages are delivered through a queue.
+    //!
+    //! \return true in queued mode, false in synchronous mode
+    //!
+    bool isQueued() const;
+
+    //!
+    //! \brief Get the number of messages waiting for delivery.
+    //!
+    //! \return The number of queued messages
+    //!
+    std::size_t getQueuedCount() const;
+
+    //!
+    //! \brief Get the number of dropped messages.
+    //!
+    //! \return The number of messages dropped because the delivery queue was
+    //!         full
+    //!
+    uint64_t getDroppedCount() const;
+
+private:
+    //! Pimpl
+    class Impl;
+    friend class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+} // bsf
+
+#include "detail/InProcessTransport.h"
+
+#endif
@@ -46,9 +46,18 @@ public:
 
     void deserialize(const std::vector<unsigned char> &message,
                      JsonDataReading &reading) const
+    {
+        deserialize(ByteSpan(message), reading);
+    }
+
+    void deserialize(ByteSpan message, JsonDataReading &reading) const
     {
         auto begin = std::find(message.begin(), message.end(), JSON_BEGIN);
-        auto end = std::find(message.rbegin(), message.rend(), JSON_END).base();
+        auto end = std::find(std::reverse_iterator<const unsigned char *>(
+                                 message.end()),
+                             std::reverse_iterator<const unsigned char *>(
+                                 message.begin()),
+                             JSON_END).base();
         if (begin == message.end() || end == message.begin())
         {
             throw SerializationError("The message is not a JSON document");
@@ -58,7 +67,7 @@ public:
         {
             throw SerializationError("The message is not a JSON document");
         }
-        auto pBegin = reinterpret_cast<const char *>(&(*begin));
+        auto pBegin = reinterpret_cast<const char *>(begin);
         try
         {
             reading << JsonDataReading::parse(std::string(pBegin, size));
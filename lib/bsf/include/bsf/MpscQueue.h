@@ -0,0 +1,219 @@
+
+#ifndef BSF_MPSCQUEUE_H
+#define BSF_MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Bounded lock-free multiple-producer single-consumer queue.
+//!
+//! Array-based queue where every cell carries a sequence number telling
+//! whether it is ready to be written or read (after Dmitry Vyukov's bounded
+//! queue). The storage is allocated once on construction, and pushing and
+//! popping never allocate memory or take locks.
+//!
+//! Any number of threads may push concurrently, but only one thread may pop at
+//! any time.
+//!
+//! \tparam T Element type; it should be cheap to copy, or be written and read
+//!           in place
+//!
+template <typename T>
+class MpscQueue
+{
+public:
+    //! Element type.
+    typedef T Value;
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param capacity Minimum number of elements that the queue can hold; it
+    //!                 is rounded up to the next power of two
+    //!
+    explicit MpscQueue(std::size_t capacity)
+    : m_mask{roundUpPowerOfTwo(capacity) - 1}
+    , m_cells(m_mask + 1)
+    , m_headPadding()
+    , m_head{0}
+    , m_tailPadding()
+    , m_tail{0}
+    {
+        for (std::size_t i = 0; i < m_cells.size(); i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    //!
+    //! \brief Push an element into the queue.
+    //!
+    //! May be called from any thread.
+    //!
+    //! \param value Element to push
+    //! \return true if the element was pushed, false if the queue was full
+    //!
+    bool tryPush(const T &value)
+    {
+        return tryPushWith([&value](T &cell)
+                           {
+                               cell = value;
+                           });
+    }
+
+    //!
+    //! \brief Push an element into the queue, writing it in place.
+    //!
+    //! The cell keeps the element popped from it in the previous lap, so
+    //! elements owning memory (e.g. vectors) can be assigned without
+    //! allocating once their capacity has grown enough.
+    //!
+    //! May be called from any thread.
+    //!
+    //! \param write Function object called with a reference to the cell
+    //! \return true if the element was pushed, false if the queue was full
+    //!
+    template <typename F>
+    bool tryPushWith(F write)
+    {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) -
+                        static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                // Cell is free, try to claim it
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Cell still holds an element from the previous lap
+                return false;
+            }
+            else
+            {
+                // Another producer claimed the cell
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        write(cell->value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //!
+    //! \brief Pop an element from the queue.
+    //!
+    //! Must only be called from the consumer thread.
+    //!
+    //! \param value Popped element
+    //! \return true if an element was popped, false if the queue was empty
+    //!
+    bool tryPop(T &value)
+    {
+        return tryPopWith([&value](const T &cell)
+                          {
+                              value = cell;
+                          });
+    }
+
+    //!
+    //! \brief Pop an element from the queue, reading it in place.
+    //!
+    //! The cell is not released until the function returns.
+    //!
+    //! Must only be called from the consumer thread.
+    //!
+    //! \param read Function object called with a reference to the cell
+    //! \return true if an element was popped, false if the queue was empty
+    //!
+    template <typename F>
+    bool tryPopWith(F read)
+    {
+        auto pos = m_head.load(std::memory_order_relaxed);
+        auto &cell = m_cells[pos & m_mask];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            return false;
+        }
+        read(cell.value);
+        cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //!
+    //! \brief Get the number of elements in the queue.
+    //!
+    //! The value is only approximate when read while the queue is in use.
+    //!
+    //! \return The number of elements in the queue
+    //!
+    std::size_t size() const
+    {
+        auto tail = m_tail.load(std::memory_order_acquire);
+        auto head = m_head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    //! \return Maximum number of elements the queue can hold
+    std::size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    //! Assumed cache line size, used to avoid false sharing
+    static const std::size_t CACHE_LINE_SIZE{64};
+
+    //! \brief Queue cell.
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static std::size_t roundUpPowerOfTwo(std::size_t value)
+    {
+        std::size_t result{1};
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    //! Index mask (capacity - 1)
+    const std::size_t m_mask;
+    //! Element storage
+    std::vector<Cell> m_cells;
+    //! Padding between the shared fields and the consumer position; padding
+    //! rather than alignment keeps the queue heap-allocatable in C++11
+    char m_headPadding[CACHE_LINE_SIZE];
+    //! Next position to read (owned by the consumer)
+    std::atomic<std::size_t> m_head;
+    //! Padding between the consumer and the producer positions
+    char m_tailPadding[CACHE_LINE_SIZE];
+    //! Next position to write (shared by the producers)
+    std::atomic<std::size_t> m_tail;
+};
+
+} // bsf
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "common.h"
 
+#include <cstddef>
 #include <utility>
 #include <vector>
 
@@ -86,20 +87,29 @@ public:
     void serialize(const ProtobufDataReading<MessageT> &reading,
                    std::vector<unsigned char> &message) const
     {
-        message.resize(reading->ByteSize());
-        auto ok = reading->SerializeToArray(message.data(), message.size());
-        if (!ok)
+        if (!reading->IsInitialized())
         {
             message.clear();
             throw SerializationError(
                 "Could not serialize protocol buffers message");
         }
+        // Sizes are computed once and cached for the serialization; the
+        // message keeps its capacity, so a reused one is not reallocated
+        message.resize(static_cast<std::size_t>(reading->ByteSize()));
+        reading->SerializeWithCachedSizesToArray(message.data());
     }
 
     void deserialize(const std::vector<unsigned char> &message,
                      ProtobufDataReading<MessageT> &reading) const
     {
-        auto ok = reading->ParseFromArray(message.data(), message.size());
+        deserialize(ByteSpan(message), reading);
+    }
+
+    void deserialize(ByteSpan message,
+                     ProtobufDataReading<MessageT> &reading) const
+    {
+        auto ok = reading->ParseFromArray(message.data(),
+                                          static_cast<int>(message.size()));
         if (!ok)
         {
             throw SerializationError(
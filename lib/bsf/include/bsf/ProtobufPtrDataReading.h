@@ -7,6 +7,7 @@
 #include <google/protobuf/arena.h>
 
 #include <memory>
+#include <cstddef>
 #include <utility>
 #include <vector>
 
@@ -92,20 +93,29 @@ public:
     void serialize(const ProtobufPtrDataReading<MessageT> &reading,
                    std::vector<unsigned char> &message) const
     {
-        message.resize(reading->ByteSize());
-        auto ok = reading->SerializeToArray(message.data(), message.size());
-        if (!ok)
+        if (!reading->IsInitialized())
         {
             message.clear();
             throw SerializationError(
                 "Could not serialize protocol buffers message");
         }
+        // Sizes are computed once and cached for the serialization; the
+        // message keeps its capacity, so a reused one is not reallocated
+        message.resize(static_cast<std::size_t>(reading->ByteSize()));
+        reading->SerializeWithCachedSizesToArray(message.data());
     }
 
     void deserialize(const std::vector<unsigned char> &message,
                      ProtobufPtrDataReading<MessageT> &reading) const
     {
-        auto ok = reading->ParseFromArray(message.data(), message.size());
+        deserialize(ByteSpan(message), reading);
+    }
+
+    void deserialize(ByteSpan message,
+                     ProtobufPtrDataReading<MessageT> &reading) const
+    {
+        auto ok = reading->ParseFromArray(message.data(),
+                                          static_cast<int>(message.size()));
         if (!ok)
         {
             throw SerializationError(
@@ -0,0 +1,227 @@
+
+#ifndef BSF_RCUCELL_H
+#define BSF_RCUCELL_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Copy-on-write cell read through immutable snapshots.
+//!
+//! Readers access the current value without locking: they register in one of
+//! two reader counters, selected by the parity of an epoch, and load an atomic
+//! pointer to an immutable snapshot. Writers are serialized by a mutex; each
+//! update copies the current snapshot, modifies the copy and publishes it
+//! atomically.
+//!
+//! Replaced snapshots are not deleted right away but retired along with the
+//! epoch in which they were replaced. Writers advance the epoch whenever no
+//! reader is registered with the parity of the next one, and delete the
+//! retired snapshots that no reader can be using anymore. Updates never wait
+//! for readers, so they may be performed from within a read section (e.g. a
+//! handler removing itself), at the cost of keeping retired snapshots alive
+//! until a later update or the destruction of the cell.
+//!
+//! \tparam T Value type (copy-constructible)
+//!
+template <typename T>
+class RcuCell
+{
+public:
+    //!
+    //! \brief Read section.
+    //!
+    //! Gives access to a snapshot of the value, which remains valid and
+    //! unchanged until the section is destroyed.
+    //!
+    class ReadGuard
+    {
+    public:
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+
+        ReadGuard(ReadGuard &&other)
+        : m_counter{other.m_counter}
+        , m_value{other.m_value}
+        {
+            other.m_counter = nullptr;
+        }
+
+        ~ReadGuard()
+        {
+            if (m_counter != nullptr)
+            {
+                m_counter->fetch_sub(1);
+            }
+        }
+
+        //! \return The snapshot
+        const T &operator*() const
+        {
+            return *m_value;
+        }
+
+        //! \return The snapshot
+        const T *operator->() const
+        {
+            return m_value;
+        }
+
+    private:
+        friend class RcuCell<T>;
+
+        ReadGuard(std::atomic<unsigned int> *counter, const T *value)
+        : m_counter{counter}
+        , m_value{value}
+        {
+        }
+
+        //! Reader counter where the section is registered
+        std::atomic<unsigned int> *m_counter;
+        //! Snapshot
+        const T *m_value;
+    };
+
+    RcuCell(const RcuCell &) = delete;
+    RcuCell &operator=(const RcuCell &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param value Initial value
+    //!
+    explicit RcuCell(T value = T())
+    : m_current{new T(std::move(value))}
+    , m_epoch{0}
+    , m_readers()
+    , m_writeMutex()
+    , m_retired()
+    {
+        m_readers[0] = 0;
+        m_readers[1] = 0;
+    }
+
+    //!
+    //! \brief Destructor.
+    //!
+    //! There must be no read section alive.
+    //!
+    ~RcuCell()
+    {
+        for (const auto &retired : m_retired) {
+            delete retired.first;
+        }
+        delete m_current.load();
+    }
+
+    //!
+    //! \brief Start a read section.
+    //!
+    //! This function is lock-free and may be called from any thread.
+    //!
+    //! \return The read section
+    //!
+    ReadGuard read() const
+    {
+        while (true)
+        {
+            auto epoch = m_epoch.load();
+            auto &counter = m_readers[epoch & 1];
+            counter.fetch_add(1);
+            // The epoch may have advanced before the registration was visible
+            if (m_epoch.load() == epoch)
+            {
+                return ReadGuard(&counter, m_current.load());
+            }
+            counter.fetch_sub(1);
+        }
+    }
+
+    //!
+    //! \brief Update the value.
+    //!
+    //! Copies the current snapshot, applies a modification to the copy and
+    //! publishes it. Concurrent updates are serialized. If the modification
+    //! throws, the copy is discarded.
+    //!
+    //! \param modify Function object called with a non-const reference to the
+    //!               copy
+    //!
+    template <typename F>
+    void update(F modify)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::unique_ptr<T> value(new T(*m_current.load()));
+        modify(*value);
+        publish(value.release());
+    }
+
+private:
+    //! Current snapshot
+    std::atomic<const T *> m_current;
+    //! Current epoch
+    std::atomic<unsigned int> m_epoch;
+    //! Number of readers registered with each epoch parity
+    mutable std::atomic<unsigned int> m_readers[2];
+    //! Writer mutex
+    std::mutex m_writeMutex;
+    //! Retired snapshots and the epochs in which they were replaced
+    std::vector<std::pair<const T *, unsigned int>> m_retired;
+
+    //!
+    //! \brief Publish a snapshot and reclaim the unused ones.
+    //!
+    //! Must be called with the writer mutex locked.
+    //!
+    //! \param value New snapshot
+    //!
+    void publish(const T *value)
+    {
+        auto previous = m_current.exchange(value);
+        m_retired.emplace_back(previous, m_epoch.load());
+        reclaim();
+    }
+
+    //!
+    //! \brief Advance the epoch if possible and delete unused snapshots.
+    //!
+    //! A snapshot replaced in epoch e can only be used by readers registered
+    //! in epoch e or earlier. Readers of earlier epochs with the parity of e+1
+    //! are gone once the epoch advances to e+1, so the snapshot is unused once
+    //! the epoch is e+2, or e+1 with no reader left with the parity of e.
+    //!
+    //! Must be called with the writer mutex locked.
+    //!
+    void reclaim()
+    {
+        auto epoch = m_epoch.load();
+        if (m_readers[(epoch + 1) & 1].load() == 0)
+        {
+            m_epoch.store(++epoch);
+        }
+        auto previousDrained = m_readers[(epoch + 1) & 1].load() == 0;
+        auto end = m_retired.begin();
+        for (auto it = m_retired.begin(); it != m_retired.end(); ++it) {
+            auto age = epoch - it->second;
+            if (age >= 2 || (age == 1 && previousDrained))
+            {
+                delete it->first;
+            }
+            else
+            {
+                *end++ = *it;
+            }
+        }
+        m_retired.erase(end, m_retired.end());
+    }
+};
+
+} // bsf
+
+#endif
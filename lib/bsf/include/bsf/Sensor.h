@@ -3,6 +3,7 @@
 #define BSF_SENSOR_H
 
 #include "common.h"
+#include "BufferPool.h"
 
 #include <utility>
 
@@ -114,15 +115,19 @@ public:
     //!
     //! \brief Publish a data reading to the communication channel.
     //!
+    //! The reading is serialized into a buffer borrowed from the pool of the
+    //! calling thread, so publishing does not allocate memory once the pool is
+    //! warm (as long as the serializer and the transport do not).
+    //!
     //! \param reading The data reading to publish
     //!
     void publish(const DataReading &reading)
     {
         try
         {
-            std::vector<unsigned char> message;
-            m_serializer.serialize(reading, message);
-            m_transport.publish(message, m_channel);
+            auto message = BufferPool::acquire();
+            m_serializer.serialize(reading, *message);
+            m_transport.publish(*message, m_channel);
         }
         catch (const SerializationError &)
         {
@@ -3,6 +3,7 @@
 #define BSF_SENSORCLIENT_H
 
 #include "common.h"
+#include "RcuCell.h"
 
 #include <functional>
 #include <unordered_map>
@@ -60,8 +61,7 @@ public:
     , m_serializer{std::move(serializer)}
     , m_factory{std::move(factory)}
     , m_handlers()
-    , m_currentToken{0}
-    , m_transportToken(m_transport.addHandler(
+    , m_transportToken(m_transport.addSpanHandler(
           std::bind(&SensorClient<Transport, DataReading, Serializer,
                                   DataReadingFactory>::processMessage,
                     this, std::placeholders::_1),
@@ -74,7 +74,7 @@ public:
     //!
     virtual ~SensorClient()
     {
-        m_transport.removeHandler(m_transportToken);
+        m_transport.removeHandler(m_transportToken, m_channel);
     }
 
     //!
@@ -116,16 +116,20 @@ public:
     //! Handlers are called in unspecific order, and, depending on the
     //! transport, they may be called from different threads.
     //!
-    //! This function is not thread-safe.
+    //! This function is thread-safe, and it may be called while readings are
+    //! being delivered, even from a handler.
     //!
     //! \param handler New handler
     //! \return A token of the registration to be used on handler removal
     //!
     HandlerToken addHandler(Handler handler)
     {
-        HandlerToken assignedToken = m_currentToken;
-        m_handlers[assignedToken] = std::move(handler);
-        m_currentToken++;
+        HandlerToken assignedToken;
+        m_handlers.update([&](Handlers &handlers)
+                          {
+                              assignedToken = handlers.currentToken++;
+                              handlers.map[assignedToken] = std::move(handler);
+                          });
         return assignedToken;
     }
 
@@ -134,13 +138,17 @@ public:
     //!
     //! If the handler does not exist this function has no effect.
     //!
-    //! This function is not thread-safe.
+    //! This function is thread-safe. Deliveries already in progress when it is
+    //! called may still call the removed handler.
     //!
     //! \param token Token of the handler to remove
     //!
     void removeHandler(const HandlerToken token)
     {
-        m_handlers.erase(token);
+        m_handlers.update([token](Handlers &handlers)
+                          {
+                              handlers.map.erase(token);
+                          });
     }
 
 protected:
@@ -161,6 +169,21 @@ protected:
     }
 
 private:
+    //! \brief Registered handlers.
+    struct Handlers
+    {
+        Handlers()
+        : map()
+        , currentToken{0}
+        {
+        }
+
+        //! Handlers by token
+        std::unordered_map<HandlerToken, Handler> map;
+        //! Next handler token to be assigned
+        HandlerToken currentToken;
+    };
+
     //! Transport for the sensor client
     Transport m_transport;
     //! Channel for the sensor client
@@ -169,10 +192,8 @@ private:
     Serializer m_serializer;
     //! Data reading factory
     DataReadingFactory m_factory;
-    //! Handlers for the received readings
-    std::unordered_map<HandlerToken, Handler> m_handlers;
-    //! Next handler token to be assigned
-    HandlerToken m_currentToken;
+    //! Handlers for the received readings, read without locking on delivery
+    RcuCell<Handlers> m_handlers;
     //! Token of the registered callback in the transport
     const HandlerToken m_transportToken;
 
@@ -180,20 +201,22 @@ private:
     //! \brief Process a received message.
     //!
     //! Makes a data reading out of the received message and calls every
-    //! handler.
+    //! handler. The message is not copied unless the serializer cannot
+    //! deserialize byte spans.
     //!
     //! \param message Message data
     //!
-    void processMessage(const std::vector<unsigned char> message)
+    void processMessage(ByteSpan message)
     {
         try
         {
             DataReading reading{m_factory.newDataReading()};
-            m_serializer.deserialize(message, reading);
+            deserializeSpan(m_serializer, message, reading);
             auto runHandlers = onDataReading(reading);
             if (runHandlers)
             {
-                for (const auto &handler : m_handlers) {
+                auto handlers = m_handlers.read();
+                for (const auto &handler : handlers->map) {
                     (handler.second)(reading);
                 }
             }
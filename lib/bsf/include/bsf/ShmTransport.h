@@ -0,0 +1,142 @@
+
+#ifndef BSF_SHMTRANSPORT_H
+#define BSF_SHMTRANSPORT_H
+
+#include "common.h"
+#include "AbstractTransport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bsf
+{
+
+//!
+//! \brief Shared memory transport for processes on the same host.
+//!
+//! Every channel is a ring of fixed-size slots in a POSIX shared memory
+//! segment, named after the transport namespace and the channel, which is
+//! created by the first process using it and never removed. Any number of
+//! processes may publish to and receive from the same channel.
+//!
+//! Publishers take a ticket from an atomic counter, claim the slot of the
+//! ticket and copy the message into it. Receivers follow the ring with a
+//! cursor of their own, one thread per channel in use, and sleep on a futex in
+//! the segment while there are no new messages, so a message is delivered
+//! with a single copy on each side and no system call unless a receiver is
+//! sleeping.
+//!
+//! The ring never blocks publishers: a receiver lagging a whole ring behind
+//! skips the overwritten messages, which are counted as lost. Messages larger
+//! than a slot are dropped, as are messages whose slot is still being written
+//! by a publisher lagging a whole ring behind; receivers skip them.
+//!
+//! Messages are received from exactly named channels only. Handlers added to
+//! wildcard channels are called for the messages of matching channels that
+//! are in use as well, but they do not open any channel by themselves.
+//!
+//! Instancing this class does not start the operation of the transport. It is
+//! necessary to call \link ShmTransport::start for the transport to receive
+//! messages; messages published while stopped are discarded.
+//!
+//! This transport is only available on Linux.
+//!
+class ShmTransport : public AbstractTransport<std::string>
+{
+public:
+    //! Default transport namespace
+    static constexpr const char *DEFAULT_NAMESPACE = "bsf";
+    //! Default number of slots of the ring of every channel
+    static const std::size_t DEFAULT_SLOT_COUNT{1024};
+    //! Default size of the slots (bytes)
+    static const std::size_t DEFAULT_SLOT_SIZE{1024};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! The slot count and size only apply to the channels created by this
+    //! transport; channels already created by another process keep their
+    //! geometry.
+    //!
+    //! \param name Transport namespace, shared by the processes of a network
+    //! \param slotCount Number of slots of the ring of every channel (rounded
+    //!                  up to a power of two)
+    //! \param slotSize Size of the slots (bytes)
+    //!
+    explicit ShmTransport(const std::string &name = DEFAULT_NAMESPACE,
+                          std::size_t slotCount = DEFAULT_SLOT_COUNT,
+                          std::size_t slotSize = DEFAULT_SLOT_SIZE);
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~ShmTransport();
+
+    //!
+    //! \copydoc AbstractTransport::publish
+    //!
+    //! \throw std::system_error if the channel segment cannot be opened
+    //!
+    void publish(const std::vector<unsigned char> &message,
+                 const Channel &channel = Channel());
+
+    //!
+    //! \brief Start the transport.
+    //!
+    //! Starts receiving messages from the channels in use.
+    //!
+    //! \throw std::system_error if a channel segment cannot be opened
+    //!
+    void start();
+
+    //!
+    //! \brief Stop the transport.
+    //!
+    //! Stops receiving messages. Must not be called from a handler.
+    //!
+    void stop();
+
+    //!
+    //! \brief Get the number of dropped messages.
+    //!
+    //! \return The number of published messages dropped because they did not
+    //!         fit in a slot or their slot was busy
+    //!
+    uint64_t getDroppedCount() const;
+
+    //!
+    //! \brief Get the number of lost messages.
+    //!
+    //! \return The number of messages overwritten before being received
+    //!
+    uint64_t getLostCount() const;
+
+protected:
+    //!
+    //! \brief Start receiving from a channel.
+    //!
+    //! \brief channel New channel
+    //!
+    virtual void useChannel(const Channel &channel);
+
+    //!
+    //! \brief Stop receiving from a channel.
+    //!
+    //! \brief channel Drop channel
+    //!
+    virtual void dropChannel(const Channel &channel);
+
+private:
+    //! Pimpl
+    class Impl;
+    friend class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+} // bsf
+
+#include "detail/ShmTransport.h"
+
+#endif
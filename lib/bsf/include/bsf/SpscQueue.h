@@ -0,0 +1,154 @@
+
+#ifndef BSF_SPSCQUEUE_H
+#define BSF_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Bounded lock-free single-producer single-consumer queue.
+//!
+//! The storage is allocated once on construction, so pushing and popping never
+//! allocate memory, take locks or block. This makes the queue suitable for
+//! handing data out of real-time threads (e.g. audio or MIDI callbacks).
+//!
+//! Exactly one thread may push and exactly one thread may pop at any time.
+//!
+//! \tparam T Element type; it should be cheap to copy
+//!
+template <typename T>
+class SpscQueue
+{
+public:
+    //! Element type.
+    typedef T Value;
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param capacity Minimum number of elements that the queue can hold; it
+    //!                 is rounded up to the next power of two
+    //!
+    explicit SpscQueue(std::size_t capacity)
+    : m_mask{roundUpPowerOfTwo(capacity) - 1}
+    , m_buffer(m_mask + 1)
+    , m_head{0}
+    , m_tail{0}
+    {
+    }
+
+    //!
+    //! \brief Push an element into the queue.
+    //!
+    //! Must only be called from the producer thread.
+    //!
+    //! \param value Element to push
+    //! \return true if the element was pushed, false if the queue was full
+    //!
+    bool tryPush(const T &value)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+        {
+            return false;
+        }
+        m_buffer[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //!
+    //! \brief Check whether several elements can be pushed.
+    //!
+    //! Must only be called from the producer thread, for which the result
+    //! holds until it pushes.
+    //!
+    //! \param count Number of elements
+    //! \return true if the queue has room for that many elements
+    //!
+    bool hasRoom(std::size_t count) const
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        return m_mask + 1 - (tail - m_head.load(std::memory_order_acquire)) >=
+               count;
+    }
+
+    //!
+    //! \brief Pop an element from the queue.
+    //!
+    //! Must only be called from the consumer thread.
+    //!
+    //! \param value Popped element
+    //! \return true if an element was popped, false if the queue was empty
+    //!
+    bool tryPop(T &value)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = m_buffer[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //!
+    //! \brief Get the number of elements in the queue.
+    //!
+    //! The value is only approximate when read while the queue is in use.
+    //!
+    //! \return The number of elements in the queue
+    //!
+    std::size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) -
+               m_head.load(std::memory_order_acquire);
+    }
+
+    //! \return Whether the queue is empty
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    //! \return Maximum number of elements the queue can hold
+    std::size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    //! Assumed cache line size, used to avoid false sharing
+    static const std::size_t CACHE_LINE_SIZE{64};
+
+    static std::size_t roundUpPowerOfTwo(std::size_t value)
+    {
+        std::size_t result{1};
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    //! Index mask (capacity - 1)
+    const std::size_t m_mask;
+    //! Element storage
+    std::vector<T> m_buffer;
+    //! Next position to read (owned by the consumer)
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head;
+    //! Next position to write (owned by the producer)
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail;
+};
+
+} // bsf
+
+#endif
@@ -0,0 +1,366 @@
+
+#ifndef BSF_TOPICTRIE_H
+#define BSF_TOPICTRIE_H
+
+#include "ChannelTable.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bsf
+{
+
+//!
+//! \brief Trie of MQTT-style topic filters.
+//!
+//! Topics are sequences of levels separated by '/'. In a filter, a '+' level
+//! matches any single level, and a '#' level (which must be the last one)
+//! matches any number of remaining levels, including none. As in MQTT,
+//! wildcards at the first level do not match topics starting with '$'.
+//!
+//! Every filter is stored with the identifier of its channel. Matching a topic
+//! walks the trie level by level, so it takes time proportional to the depth
+//! of the topic (times the number of wildcard branches followed), regardless
+//! of the number of filters.
+//!
+//! Filters are never removed; this class is meant to be indexed alongside a
+//! ChannelTable, whose identifiers are never released either.
+//!
+//! This class is not thread-safe.
+//!
+class TopicTrie
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    TopicTrie()
+    : m_nodes(1)
+    , m_size{0}
+    {
+    }
+
+    //!
+    //! \brief Check whether a topic contains wildcards.
+    //!
+    //! \param topic Topic
+    //! \return true if any level of the topic is '+' or '#'; false otherwise
+    //!
+    static bool isFilter(const std::string &topic)
+    {
+        std::size_t begin{0};
+        while (begin <= topic.size())
+        {
+            auto end = topic.find('/', begin);
+            if (end == std::string::npos)
+            {
+                end = topic.size();
+            }
+            if (end - begin == 1 && (topic[begin] == '+' || topic[begin] == '#'))
+            {
+                return true;
+            }
+            begin = end + 1;
+        }
+        return false;
+    }
+
+    //!
+    //! \brief Add a topic filter.
+    //!
+    //! Levels after a '#' level are ignored.
+    //!
+    //! \param filter Topic filter
+    //! \param id Identifier of the filter channel
+    //!
+    void add(const std::string &filter, ChannelId id)
+    {
+        std::size_t node{0};
+        std::size_t begin{0};
+        while (true)
+        {
+            auto end = filter.find('/', begin);
+            if (end == std::string::npos)
+            {
+                end = filter.size();
+            }
+            auto level = filter.substr(begin, end - begin);
+            if (level == "#")
+            {
+                m_nodes[node].multiLevelIds.push_back(id);
+                break;
+            }
+            node = level == "+" ? singleLevelChild(node) : child(node, level);
+            if (end == filter.size())
+            {
+                m_nodes[node].ids.push_back(id);
+                break;
+            }
+            begin = end + 1;
+        }
+        m_size++;
+    }
+
+    //!
+    //! \brief Find the filters matching a topic.
+    //!
+    //! \param topic Beginning of the topic
+    //! \param size Length of the topic
+    //! \param callback Function object called with the identifier of every
+    //!                 matching filter
+    //!
+    template <typename CallbackT>
+    void match(const char *topic, std::size_t size, CallbackT &&callback) const
+    {
+        if (m_size == 0)
+        {
+            return;
+        }
+        auto wildcards = size == 0 || topic[0] != '$';
+        match(0, topic, topic + size, wildcards, callback);
+    }
+
+    //!
+    //! \copydoc match
+    //!
+    template <typename CallbackT>
+    void match(const std::string &topic, CallbackT &&callback) const
+    {
+        match(topic.data(), topic.size(), callback);
+    }
+
+    //!
+    //! \copydoc match
+    //!
+    template <typename CallbackT>
+    void match(const char *topic, CallbackT &&callback) const
+    {
+        match(topic, std::strlen(topic), callback);
+    }
+
+    //! \return Number of filters
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    //! Index meaning that a node has no child
+    static const std::size_t NONE{static_cast<std::size_t>(-1)};
+
+    //! \brief Node of the trie.
+    struct Node
+    {
+        Node()
+        : children()
+        , singleLevelChild{NONE}
+        , ids()
+        , multiLevelIds()
+        {
+        }
+
+        //! Children by level, sorted by level
+        std::vector<std::pair<std::string, std::size_t>> children;
+        //! Child for the '+' level
+        std::size_t singleLevelChild;
+        //! Filters ending at this node
+        std::vector<ChannelId> ids;
+        //! Filters ending with a '#' level after this node
+        std::vector<ChannelId> multiLevelIds;
+    };
+
+    //! Nodes; the first one is the root
+    std::vector<Node> m_nodes;
+    //! Number of filters
+    std::size_t m_size;
+
+    //!
+    //! \brief Compare a child level with a level of a topic.
+    //!
+    static int compare(const std::string &level, const char *begin,
+                       const char *end)
+    {
+        return level.compare(0, std::string::npos, begin,
+                             static_cast<std::size_t>(end - begin));
+    }
+
+    std::size_t child(std::size_t node, const std::string &level)
+    {
+        auto &children = m_nodes[node].children;
+        auto it = std::lower_bound(
+            children.begin(), children.end(), level,
+            [](const std::pair<std::string, std::size_t> &entry,
+               const std::string &key)
+            {
+                return entry.first < key;
+            });
+        if (it != children.end() && it->first == level)
+        {
+            return it->second;
+        }
+        auto index = m_nodes.size();
+        children.emplace(it, level, index);
+        m_nodes.emplace_back();
+        return index;
+    }
+
+    std::size_t singleLevelChild(std::size_t node)
+    {
+        if (m_nodes[node].singleLevelChild == NONE)
+        {
+            m_nodes[node].singleLevelChild = m_nodes.size();
+            m_nodes.emplace_back();
+        }
+        return m_nodes[node].singleLevelChild;
+    }
+
+    std::size_t findChild(std::size_t node, const char *begin,
+                          const char *end) const
+    {
+        const auto &children = m_nodes[node].children;
+        std::size_t low{0};
+        auto high = children.size();
+        while (low < high)
+        {
+            auto middle = (low + high) / 2;
+            auto result = compare(children[middle].first, begin, end);
+            if (result == 0)
+            {
+                return children[middle].second;
+            }
+            if (result < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return NONE;
+    }
+
+    //!
+    //! \brief Match the remaining levels of a topic from a node.
+    //!
+    //! \param node Current node
+    //! \param begin Beginning of the remaining levels
+    //! \param end End of the topic
+    //! \param wildcards Whether wildcards may match the next level
+    //! \param callback Function object called for every matching filter
+    //!
+    template <typename CallbackT>
+    void match(std::size_t node, const char *begin, const char *end,
+               bool wildcards, CallbackT &callback) const
+    {
+        const auto &current = m_nodes[node];
+        if (wildcards)
+        {
+            for (auto id : current.multiLevelIds) {
+                callback(id);
+            }
+        }
+        auto levelEnd = std::find(begin, end, '/');
+        auto child = findChild(node, begin, levelEnd);
+        auto last = levelEnd == end;
+        if (child != NONE)
+        {
+            matchChild(child, levelEnd, end, last, callback);
+        }
+        if (wildcards && current.singleLevelChild != NONE)
+        {
+            matchChild(current.singleLevelChild, levelEnd, end, last, callback);
+        }
+    }
+
+    template <typename CallbackT>
+    void matchChild(std::size_t node, const char *levelEnd, const char *end,
+                    bool last, CallbackT &callback) const
+    {
+        if (last)
+        {
+            for (auto id : m_nodes[node].ids) {
+                callback(id);
+            }
+            // A trailing '#' also matches its parent level
+            for (auto id : m_nodes[node].multiLevelIds) {
+                callback(id);
+            }
+        }
+        else
+        {
+            match(node, levelEnd + 1, end, true, callback);
+        }
+    }
+};
+
+//!
+//! \brief Index of wildcard channels.
+//!
+//! Channels of most types have no wildcards, so this index never matches.
+//! String channels are interpreted as MQTT-style topics (see TopicTrie).
+//!
+//! \tparam ChannelT Channel type
+//!
+template <typename ChannelT>
+class WildcardIndex
+{
+public:
+    //!
+    //! \brief Add a channel if it contains wildcards.
+    //!
+    //! \param channel Channel
+    //! \param id Identifier of the channel
+    //!
+    void add(const ChannelT & /*channel*/, ChannelId /*id*/)
+    {
+    }
+
+    //!
+    //! \brief Find the wildcard channels matching a channel.
+    //!
+    //! \param key Channel, or a key equivalent to it
+    //! \param callback Function object called with the identifier of every
+    //!                 matching wildcard channel
+    //!
+    template <typename KeyT, typename CallbackT>
+    void match(const KeyT & /*key*/, CallbackT && /*callback*/) const
+    {
+    }
+};
+
+//!
+//! \brief Index of wildcard string channels.
+//!
+template <>
+class WildcardIndex<std::string>
+{
+public:
+    //! \copydoc WildcardIndex::add
+    void add(const std::string &channel, ChannelId id)
+    {
+        if (TopicTrie::isFilter(channel))
+        {
+            m_trie.add(channel, id);
+        }
+    }
+
+    //! \copydoc WildcardIndex::match
+    template <typename KeyT, typename CallbackT>
+    void match(const KeyT &key, CallbackT &&callback) const
+    {
+        m_trie.match(key, callback);
+    }
+
+private:
+    //! Wildcard channels
+    TopicTrie m_trie;
+};
+
+} // bsf
+
+#endif
@@ -0,0 +1,158 @@
+
+#ifndef BSF_UDPMULTICASTTRANSPORT_H
+#define BSF_UDPMULTICASTTRANSPORT_H
+
+#include "common.h"
+#include "AbstractTransport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bsf
+{
+
+//!
+//! \brief UDP multicast transport for a local network.
+//!
+//! Broker-less transport sending every message as a UDP datagram to a
+//! multicast group. Each channel is mapped to one group of a range by its
+//! hash, and every endpoint joins the groups of the channels in use, so
+//! messages are sent once and fanned out by the network. Datagrams carry the
+//! channel name, so channels sharing a group are told apart.
+//!
+//! Delivery is unreliable and unordered, as with MQTT QoS 0 but without
+//! head-of-line blocking. Every message carries a sequence number per sender
+//! and channel: receivers count gaps as lost messages, and drop messages
+//! older than the last one delivered, counting them as reordered instead if
+//! they were counted as lost, so that no message is counted twice.
+//!
+//! Channels may be configured with a redundancy depth: every datagram then
+//! also carries up to that many previous messages of the channel, from which
+//! receivers recover messages lost within that window.
+//!
+//! Messages are received by a managed thread, which calls the handlers.
+//! Messages are received from exactly named channels only. Handlers added to
+//! wildcard channels are called for the messages of matching channels that
+//! are in use as well, but they do not join any group by themselves.
+//!
+//! Instancing this class does not start the operation of the transport. It is
+//! necessary to call \link UdpMulticastTransport::start for the transport to
+//! send and receive messages; messages published while stopped are discarded.
+//!
+class UdpMulticastTransport : public AbstractTransport<std::string>
+{
+public:
+    //! Default first multicast group of the range (organization-local scope)
+    static constexpr const char *DEFAULT_GROUP = "239.255.77.0";
+    //! Default number of multicast groups of the range
+    static const unsigned int DEFAULT_GROUP_COUNT{256};
+    //! Default UDP port
+    static const unsigned short DEFAULT_PORT{45000};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param group First multicast group of the range
+    //! \param groupCount Number of multicast groups of the range
+    //! \param port UDP port
+    //! \param localInterface Address of the local network interface, or an
+    //!                       empty string for the default one
+    //!
+    explicit UdpMulticastTransport(const std::string &group = DEFAULT_GROUP,
+                                   unsigned int groupCount = DEFAULT_GROUP_COUNT,
+                                   unsigned short port = DEFAULT_PORT,
+                                   const std::string &localInterface = "");
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~UdpMulticastTransport();
+
+    //!
+    //! \copydoc AbstractTransport::publish
+    //!
+    void publish(const std::vector<unsigned char> &message,
+                 const Channel &channel = Channel());
+
+    //!
+    //! \brief Start the transport.
+    //!
+    //! Opens the sockets and joins the groups of the channels in use.
+    //!
+    //! \throw std::system_error if the sockets cannot be opened
+    //!
+    void start();
+
+    //!
+    //! \brief Stop the transport.
+    //!
+    //! Closes the sockets. Must not be called from a handler.
+    //!
+    void stop();
+
+    //!
+    //! \brief Set the redundancy depth of a channel.
+    //!
+    //! Every message published to the channel is followed in its datagram by
+    //! up to the given number of previous messages of the channel, as long as
+    //! the datagram fits in a typical Ethernet frame.
+    //!
+    //! \param channel Channel
+    //! \param depth Number of previous messages repeated (0 to disable)
+    //!
+    void setRedundancy(const Channel &channel, unsigned int depth);
+
+    //!
+    //! \brief Get the number of dropped messages.
+    //!
+    //! \return The number of published messages dropped because they did not
+    //!         fit in a datagram or could not be sent
+    //!
+    uint64_t getDroppedCount() const;
+
+    //!
+    //! \brief Get the number of lost messages.
+    //!
+    //! \return The number of messages skipped in the sequence of a sender and
+    //!         channel, not recovered from redundancy and not received later
+    //!
+    uint64_t getLostCount() const;
+
+    //!
+    //! \brief Get the number of reordered messages.
+    //!
+    //! \return The number of messages received after a newer message of the
+    //!         same sender and channel, which are not delivered; duplicates
+    //!         and messages more than 64 behind are not counted
+    //!
+    uint64_t getReorderedCount() const;
+
+protected:
+    //!
+    //! \brief Join the group of a channel.
+    //!
+    //! \brief channel New channel
+    //!
+    virtual void useChannel(const Channel &channel);
+
+    //!
+    //! \brief Leave the group of a channel.
+    //!
+    //! \brief channel Drop channel
+    //!
+    virtual void dropChannel(const Channel &channel);
+
+private:
+    //! Pimpl
+    class Impl;
+    friend class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+} // bsf
+
+#include "detail/UdpMulticastTransport.h"
+
+#endif
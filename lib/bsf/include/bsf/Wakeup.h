@@ -0,0 +1,140 @@
+
+#ifndef BSF_WAKEUP_H
+#define BSF_WAKEUP_H
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+namespace bsf
+{
+
+//!
+//! \brief Wakeup of a consumer thread sleeping while its queue is empty.
+//!
+//! The consumer announces that it is about to sleep with prepareWait(), checks
+//! its queue once more, and then either sleeps with wait() or calls
+//! cancelWait(). Producers call notify() after pushing; it only makes a system
+//! call when the consumer is sleeping or about to, i.e. when the queue went
+//! empty as seen by the consumer, so a busy queue costs them one atomic
+//! exchange.
+//!
+//! The wakeup is an eventfd, so the consumer may also sleep on it along with
+//! other file descriptors, polling fd() for reading and calling clear() once
+//! it is readable.
+//!
+//! Only one thread may wait at any time.
+//!
+class Wakeup
+{
+public:
+    Wakeup(const Wakeup &) = delete;
+    Wakeup &operator=(const Wakeup &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \throw std::system_error if the eventfd cannot be created
+    //!
+    Wakeup()
+    : m_fd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+    , m_sleeping{false}
+    {
+        if (m_fd < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Could not create eventfd");
+        }
+    }
+
+    ~Wakeup()
+    {
+        close(m_fd);
+    }
+
+    //!
+    //! \brief Wake the consumer up if it is sleeping.
+    //!
+    //! May be called from any thread, after making the new work visible.
+    //!
+    void notify()
+    {
+        // Either this exchange follows the one in prepareWait() and sees the
+        // consumer sleeping, or it precedes it and the consumer sees the work
+        if (m_sleeping.exchange(false, std::memory_order_acq_rel))
+        {
+            uint64_t one{1};
+            while (write(m_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+            {
+            }
+        }
+    }
+
+    //!
+    //! \brief Announce that the consumer is about to sleep.
+    //!
+    //! The consumer must check for work after this call, and then call either
+    //! wait() or cancelWait().
+    //!
+    void prepareWait()
+    {
+        m_sleeping.exchange(true, std::memory_order_acq_rel);
+    }
+
+    //!
+    //! \brief Give up sleeping after prepareWait(), as there is work to do.
+    //!
+    void cancelWait()
+    {
+        m_sleeping.exchange(false, std::memory_order_acq_rel);
+    }
+
+    //!
+    //! \brief Sleep until notified, after prepareWait().
+    //!
+    //! \param timeout Maximum time to sleep (milliseconds), or -1 to sleep
+    //!                until notified
+    //!
+    void wait(int timeout = -1)
+    {
+        pollfd descriptor{m_fd, POLLIN, 0};
+        poll(&descriptor, 1, timeout);
+        clear();
+    }
+
+    //!
+    //! \brief Consume the pending notification, if any.
+    //!
+    //! For consumers polling fd() themselves.
+    //!
+    void clear()
+    {
+        uint64_t count;
+        while (read(m_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+        {
+        }
+        m_sleeping.exchange(false, std::memory_order_acq_rel);
+    }
+
+    //! \return File descriptor, readable while a notification is pending
+    int fd() const
+    {
+        return m_fd;
+    }
+
+private:
+    //! Event file descriptor
+    const int m_fd;
+    //! Whether the consumer is sleeping or about to; only changed through
+    //! exchanges, so that every change synchronizes with the previous ones
+    std::atomic<bool> m_sleeping;
+};
+
+} // bsf
+
+#endif
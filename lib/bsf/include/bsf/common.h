@@ -2,9 +2,12 @@
 #ifndef BSF_COMMON_H
 #define BSF_COMMON_H
 
+#include "ByteSpan.h"
+
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace bsf
@@ -19,11 +22,18 @@ typedef unsigned int HandlerToken;
 //! Serializers must implement the operations:
 //!   - `void serialize(const DataReadingT &reading,
 //!      std::vector<unsigned char> &message)`: Serializes a data reading as a
-//!      vector of bytes.
+//!      vector of bytes. The message vector may be reused between calls, so
+//!      serializers should overwrite it in place (e.g. resizing it and writing
+//!      into its data) to take advantage of its capacity.
 //!   - `void deserialize(const std::vector<unsigned char> &message,
 //!      DataReadingT &reading)`: Deserializes a data reading from a vector of
 //!      bytes.
 //!
+//! Serializers may also implement the operation:
+//!   - `void deserialize(ByteSpan message, DataReadingT &reading)`:
+//!      Deserializes a data reading from a span of bytes, so received messages
+//!      do not need to be copied into a vector.
+//!
 //! \tparam The generated data reading type
 //!
 template <typename DataReadingT>
@@ -63,6 +73,60 @@ public:
     static const bool value = sizeof(test<SerializerT>(nullptr)) == sizeof(yes);
 };
 
+//!
+//! \brief Static type checking type for serializers deserializing byte spans.
+//!
+//! \tparam SerializerT A serializer type
+//! \tparam DataReadingT The data reading type of the serializer
+//!
+template <typename SerializerT, typename DataReadingT>
+struct HasSpanDeserialize
+{
+private:
+    typedef char(&yes)[1];
+    typedef char(&no)[2];
+    template <typename S>
+    static yes test(decltype(std::declval<S &>().deserialize(
+        std::declval<ByteSpan>(), std::declval<DataReadingT &>())) *);
+    template <typename S>
+    static no test( ... );
+
+public:
+    //! True if the serializer can deserialize byte spans; false otherwise.
+    static const bool value = sizeof(test<SerializerT>(nullptr)) == sizeof(yes);
+};
+
+//!
+//! \brief Deserialize a data reading from a span of bytes.
+//!
+//! Uses the span deserialization of the serializer if available, and falls
+//! back to copying the bytes into a vector otherwise.
+//!
+//! \param serializer Serializer
+//! \param message Serialized message
+//! \param reading Deserialized data reading
+//!
+template <typename SerializerT, typename DataReadingT>
+typename std::enable_if<
+    HasSpanDeserialize<SerializerT, DataReadingT>::value>::type
+deserializeSpan(SerializerT &serializer, ByteSpan message,
+                DataReadingT &reading)
+{
+    serializer.deserialize(message, reading);
+}
+
+//!
+//! \copydoc deserializeSpan
+//!
+template <typename SerializerT, typename DataReadingT>
+typename std::enable_if<
+    !HasSpanDeserialize<SerializerT, DataReadingT>::value>::type
+deserializeSpan(SerializerT &serializer, ByteSpan message,
+                DataReadingT &reading)
+{
+    serializer.deserialize(message.toVector(), reading);
+}
+
 //!
 //! \brief Traits of the default serializer of a data reading type.
 //!
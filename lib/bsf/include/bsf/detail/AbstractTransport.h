@@ -4,6 +4,10 @@
 
 #include "../AbstractTransport.h"
 
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
 namespace bsf
 {
 
@@ -14,8 +18,8 @@ class AbstractTransport<ChannelT>::Impl
 public:
     explicit Impl(AbstractTransport<Channel> *obj)
     : m_obj(obj)
-    , m_handlers()
-    , m_currentToken{0}
+    , m_state()
+    , m_channelMutex()
     {
     }
 
@@ -23,70 +27,146 @@ public:
     {
     }
 
-    HandlerToken addHandler(Handler handler,
+    HandlerToken addHandler(SpanHandler handler,
                             const Channel &channel = Channel())
     {
-        HandlerToken assignedToken = m_currentToken;
-        auto channelEntry = m_handlers.find(channel);
-        if (channelEntry == m_handlers.end())
+        // Serializes channel notifications with the handler updates
+        std::lock_guard<std::mutex> lock(m_channelMutex);
+        HandlerToken assignedToken;
+        bool newChannel;
+        m_state.update([&](State &state)
+                       {
+                           auto channelCount = state.channels.size();
+                           auto id = state.channels.intern(channel);
+                           if (state.channels.size() != channelCount)
+                           {
+                               state.wildcards.add(channel, id);
+                           }
+                           if (id >= state.handlers.size())
+                           {
+                               state.handlers.resize(id + 1);
+                           }
+                           auto &channelHandlers = state.handlers[id];
+                           assignedToken = state.currentToken++;
+                           channelHandlers.emplace_back(assignedToken,
+                                                        std::move(handler));
+                           newChannel = channelHandlers.size() == 1;
+                       });
+        if (newChannel)
         {
-            m_handlers[channel] = {{assignedToken, std::move(handler)}};
             m_obj->useChannel(channel);
         }
-        else
-        {
-            channelEntry->second[assignedToken] = std::move(handler);
-        }
-        m_currentToken++;
         return assignedToken;
     }
 
     void removeHandler(const HandlerToken token,
                        const Channel &channel = Channel())
     {
-        auto channelEntry = m_handlers.find(channel);
-        if (channelEntry == m_handlers.end())
+        std::lock_guard<std::mutex> lock(m_channelMutex);
+        bool droppedChannel{false};
+        m_state.update([&](State &state)
+                       {
+                           auto id = state.channels.find(channel);
+                           if (id == INVALID_CHANNEL_ID)
+                           {
+                               return;
+                           }
+                           auto &channelHandlers = state.handlers[id];
+                           auto handlerEntry = std::find_if(
+                               channelHandlers.begin(), channelHandlers.end(),
+                               [token](const HandlerEntry &entry)
+                               {
+                                   return entry.first == token;
+                               });
+                           if (handlerEntry == channelHandlers.end())
+                           {
+                               return;
+                           }
+                           channelHandlers.erase(handlerEntry);
+                           droppedChannel = channelHandlers.empty();
+                       });
+        if (droppedChannel)
         {
-            return;
-        }
-        auto &channelHandlers = channelEntry->second;
-        channelHandlers.erase(token);
-        if (channelHandlers.empty())
-        {
-            m_handlers.erase(channelEntry);
             m_obj->dropChannel(channel);
         }
     }
 
-    void callHandlers(const std::vector<unsigned char> &message,
-                      const Channel &channel = Channel()) const
+    template <typename KeyT>
+    ChannelId findChannel(const KeyT &key) const
     {
-        const auto &channelEntry = m_handlers.find(channel);
-        if (channelEntry == m_handlers.end())
-        {
-            return;
-        }
-        for (const auto &handlerEntry : channelEntry->second) {
-            (handlerEntry.second)(message);
-        }
+        return m_state.read()->channels.find(key);
+    }
+
+    void callHandlers(ByteSpan message, ChannelId id) const
+    {
+        callHandlers(*m_state.read(), message, id);
+    }
+
+    template <typename KeyT>
+    void callHandlers(ByteSpan message, const KeyT &key) const
+    {
+        auto state = m_state.read();
+        callHandlers(*state, message, state->channels.find(key));
+        state->wildcards.match(key, [&](ChannelId id)
+                               {
+                                   callHandlers(*state, message, id);
+                               });
     }
 
     std::vector<Channel> getChannelsInUse() const
     {
+        auto state = m_state.read();
         std::vector<Channel> channels;
-        channels.reserve(m_handlers.size());
-        for (const auto &channelEntry : m_handlers) {
-            channels.push_back(channelEntry.first);
+        for (std::size_t id = 0; id < state->handlers.size(); id++) {
+            if (!state->handlers[id].empty())
+            {
+                channels.push_back(state->channels.get(id));
+            }
         }
         return channels;
     }
 
 private:
-    typedef std::unordered_map<HandlerToken, Handler> Handlers;
+    typedef std::pair<HandlerToken, SpanHandler> HandlerEntry;
+    typedef std::vector<HandlerEntry> Handlers;
+
+    //! \brief Registered handlers.
+    struct State
+    {
+        State()
+        : channels()
+        , handlers()
+        , currentToken{0}
+        , wildcards()
+        {
+        }
+
+        //! Interned channels
+        ChannelTable<Channel> channels;
+        //! Handlers by channel identifier
+        std::vector<Handlers> handlers;
+        //! Next handler token to be assigned
+        HandlerToken currentToken;
+        //! Interned channels with wildcards
+        WildcardIndex<Channel> wildcards;
+    };
+
+    static void callHandlers(const State &state, ByteSpan message, ChannelId id)
+    {
+        if (id >= state.handlers.size())
+        {
+            return;
+        }
+        for (const auto &handlerEntry : state.handlers[id]) {
+            (handlerEntry.second)(message);
+        }
+    }
 
     AbstractTransport<Channel> *m_obj;
-    std::unordered_map<Channel, Handlers> m_handlers;
-    HandlerToken m_currentToken;
+    //! Registered handlers, read without locking on dispatch
+    RcuCell<State> m_state;
+    //! Mutex for handler updates and channel notifications
+    std::mutex m_channelMutex;
 };
 
 template <typename ChannelT>
@@ -104,6 +184,20 @@ template <typename ChannelT>
 HandlerToken AbstractTransport<ChannelT>::addHandler(
     typename AbstractTransport<ChannelT>::Handler handler,
     const ChannelT &channel)
+{
+    // Copy every message for handlers expecting vectors
+    return m_impl->addHandler(
+        [handler](ByteSpan message)
+        {
+            handler(message.toVector());
+        },
+        channel);
+}
+
+template <typename ChannelT>
+HandlerToken AbstractTransport<ChannelT>::addSpanHandler(
+    typename AbstractTransport<ChannelT>::SpanHandler handler,
+    const ChannelT &channel)
 {
     return m_impl->addHandler(std::move(handler), channel);
 }
@@ -115,11 +209,40 @@ void AbstractTransport<ChannelT>::removeHandler(const HandlerToken token,
     m_impl->removeHandler(token, channel);
 }
 
+template <typename ChannelT>
+template <typename KeyT>
+ChannelId AbstractTransport<ChannelT>::findChannel(const KeyT &key) const
+{
+    return m_impl->findChannel(key);
+}
+
+template <typename ChannelT>
+void AbstractTransport<ChannelT>::callHandlers(ByteSpan message,
+                                               ChannelId id) const
+{
+    m_impl->callHandlers(message, id);
+}
+
+template <typename ChannelT>
+template <typename KeyT>
+void AbstractTransport<ChannelT>::callHandlers(ByteSpan message,
+                                               const KeyT &key) const
+{
+    m_impl->callHandlers(message, key);
+}
+
+template <typename ChannelT>
+void AbstractTransport<ChannelT>::callHandlers(ByteSpan message,
+                                               const Channel &channel) const
+{
+    m_impl->callHandlers(message, channel);
+}
+
 template <typename ChannelT>
 void AbstractTransport<ChannelT>::callHandlers(
     const std::vector<unsigned char> &message, const Channel &channel) const
 {
-    m_impl->callHandlers(message, channel);
+    callHandlers(ByteSpan(message), channel);
 }
 
 template <typename ChannelT>
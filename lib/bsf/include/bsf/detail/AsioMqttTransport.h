@@ -0,0 +1,487 @@
+
+#ifndef BSF_ASIOMQTTTRANSPORT_DETAIL_H
+#define BSF_ASIOMQTTTRANSPORT_DETAIL_H
+
+#include "../AsioMqttTransport.h"
+
+#include <asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+
+namespace bsf
+{
+
+//! \brief Implementation.
+struct AsioMqttTransport::Impl : public detail::MqttClient,
+                                 public std::enable_shared_from_this<Impl>
+{
+    //! Interval between client housekeeping calls (milliseconds)
+    static const unsigned int MISC_INTERVAL{1000};
+
+    Impl(AsioMqttTransport *obj, asio::io_service &asio,
+         const std::string &clientName, const std::string &server,
+         unsigned int port, int qos)
+    : detail::MqttClient(clientName, server, port, qos,
+                         DEFAULT_OFFLINE_CAPACITY)
+    , m_obj{obj}
+    , m_asio(asio)
+    , m_strand(asio)
+    , m_socket(asio)
+    , m_miscTimer(asio)
+    , m_reconnectTimer(asio)
+    , m_startRequested{false}
+    , m_started{false}
+    , m_writing{false}
+    , m_writeRequested{false}
+    , m_reconnectDelayMin{DEFAULT_RECONNECT_DELAY_MIN}
+    , m_reconnectDelayMax{DEFAULT_RECONNECT_DELAY_MAX}
+    , m_reconnectDelay{DEFAULT_RECONNECT_DELAY_MIN}
+    {
+    }
+
+    void publish(const std::vector<unsigned char> &message,
+                 const std::string &channel)
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        publishMessage(message, channel);
+        // Whatever could not be written at once is written from the service
+        if (want_write())
+        {
+            requestWrite();
+        }
+    }
+
+    void start()
+    {
+        m_startRequested = true;
+        auto self = shared_from_this();
+        m_strand.dispatch([self]
+                          {
+                              self->doStart();
+                          });
+    }
+
+    void stop()
+    {
+        // A start not run yet by the service is cancelled
+        if (!m_startRequested.exchange(false))
+        {
+            return;
+        }
+        if (m_strand.running_in_this_thread() || m_asio.stopped())
+        {
+            doStop();
+            return;
+        }
+        auto self = shared_from_this();
+        if (!m_started)
+        {
+            // The service may never run; in case the start is running right
+            // now, stop after it without waiting
+            m_strand.post([self]
+                          {
+                              self->doStop();
+                          });
+            return;
+        }
+        // The service has run the start, so it is running and will run this
+        std::promise<void> done;
+        auto stopped = done.get_future();
+        m_strand.post([self, &done]
+                      {
+                          self->doStop();
+                          done.set_value();
+                      });
+        if (!runningInService())
+        {
+            stopped.wait();
+            return;
+        }
+        // This thread may be the only one running the service, so it runs the
+        // service handlers itself until the transport has stopped
+        while (stopped.wait_for(std::chrono::seconds::zero()) !=
+                   std::future_status::ready &&
+               !m_asio.stopped())
+        {
+            if (m_asio.poll_one() == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    //!
+    //! \brief Check whether the current thread is running the service.
+    //!
+    bool runningInService()
+    {
+        // Dispatched handlers are run at once from within the service, and
+        // posted otherwise
+        auto running = std::make_shared<std::atomic<bool>>(false);
+        m_asio.dispatch([running]
+                        {
+                            *running = true;
+                        });
+        return *running;
+    }
+
+    void doStart()
+    {
+        if (m_started || !m_startRequested)
+        {
+            return;
+        }
+        m_started = true;
+        m_reconnectDelay = m_reconnectDelayMin;
+        // Channels are subscribed on connection
+        if (connect_async(getServer().c_str(), getPort()) == MOSQ_ERR_SUCCESS)
+        {
+            watchSocket();
+        }
+        else
+        {
+            scheduleReconnect();
+        }
+        scheduleMisc();
+    }
+
+    void doStop()
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        m_started = false;
+        m_miscTimer.cancel();
+        m_reconnectTimer.cancel();
+        disconnectClient();
+        releaseSocket();
+    }
+
+    //!
+    //! \brief Start serving the client socket.
+    //!
+    void watchSocket()
+    {
+        asio::error_code error;
+        m_socket.assign(socket(), error);
+        if (error)
+        {
+            connectionLost();
+            return;
+        }
+        waitRead();
+        waitWrite();
+    }
+
+    //!
+    //! \brief Stop serving the client socket, which is owned by mosquitto.
+    //!
+    void releaseSocket()
+    {
+        if (m_socket.is_open())
+        {
+            m_socket.cancel();
+            m_socket.release();
+        }
+        m_writing = false;
+    }
+
+    void waitRead()
+    {
+        auto self = shared_from_this();
+        m_socket.async_read_some(
+            asio::null_buffers(),
+            m_strand.wrap([self](const asio::error_code &error, std::size_t)
+                          {
+                              self->onReadable(error);
+                          }));
+    }
+
+    void waitWrite()
+    {
+        if (m_writing || !m_socket.is_open() || !want_write())
+        {
+            return;
+        }
+        m_writing = true;
+        auto self = shared_from_this();
+        m_socket.async_write_some(
+            asio::null_buffers(),
+            m_strand.wrap([self](const asio::error_code &error, std::size_t)
+                          {
+                              self->onWritable(error);
+                          }));
+    }
+
+    void requestWrite()
+    {
+        if (m_strand.running_in_this_thread())
+        {
+            waitWrite();
+            return;
+        }
+        // Coalesce the requests of concurrent publishers
+        if (!m_writeRequested.exchange(true))
+        {
+            auto self = shared_from_this();
+            m_strand.post([self]
+                          {
+                              self->m_writeRequested = false;
+                              self->waitWrite();
+                          });
+        }
+    }
+
+    void onReadable(const asio::error_code &error)
+    {
+        if (error || !m_started)
+        {
+            return;
+        }
+        if (loop_read() != MOSQ_ERR_SUCCESS)
+        {
+            connectionLost();
+            return;
+        }
+        // Reading may queue acknowledgements, subscriptions or publications
+        waitWrite();
+        waitRead();
+    }
+
+    void onWritable(const asio::error_code &error)
+    {
+        if (error == asio::error::operation_aborted || !m_started)
+        {
+            return;
+        }
+        m_writing = false;
+        if (error || loop_write() != MOSQ_ERR_SUCCESS)
+        {
+            connectionLost();
+            return;
+        }
+        waitWrite();
+    }
+
+    void connectionLost()
+    {
+        releaseSocket();
+        // As the mosquitto loop does when a read or write fails
+        on_disconnect(MOSQ_ERR_CONN_LOST);
+        scheduleReconnect();
+    }
+
+    void scheduleReconnect()
+    {
+        auto self = shared_from_this();
+        m_reconnectTimer.expires_from_now(
+            std::chrono::seconds{int64_t{m_reconnectDelay}});
+        m_reconnectTimer.async_wait(
+            m_strand.wrap([self](const asio::error_code &error)
+                          {
+                              if (!error && self->m_started)
+                              {
+                                  self->reconnectNow();
+                              }
+                          }));
+        m_reconnectDelay =
+            std::min(m_reconnectDelay * 2, m_reconnectDelayMax.load());
+    }
+
+    void reconnectNow()
+    {
+        if (reconnect_async() == MOSQ_ERR_SUCCESS)
+        {
+            watchSocket();
+        }
+        else
+        {
+            scheduleReconnect();
+        }
+    }
+
+    void scheduleMisc()
+    {
+        auto self = shared_from_this();
+        m_miscTimer.expires_from_now(
+            std::chrono::milliseconds{int64_t{MISC_INTERVAL}});
+        m_miscTimer.async_wait(
+            m_strand.wrap([self](const asio::error_code &error)
+                          {
+                              if (!error && self->m_started)
+                              {
+                                  self->onMisc();
+                              }
+                          }));
+    }
+
+    void onMisc()
+    {
+        // Keep-alive pings; the client closes the socket on timeout
+        loop_misc();
+        if (m_socket.is_open() && socket() != m_socket.native_handle())
+        {
+            connectionLost();
+        }
+        else
+        {
+            waitWrite();
+        }
+        scheduleMisc();
+    }
+
+    virtual void on_connect(int rc)
+    {
+        detail::MqttClient::on_connect(rc);
+        if (rc == 0)
+        {
+            m_reconnectDelay = m_reconnectDelayMin;
+        }
+    }
+
+    AsioMqttTransport *const m_obj;
+    asio::io_service &m_asio;
+    asio::io_service::strand m_strand;
+    asio::posix::stream_descriptor m_socket;
+    asio::steady_timer m_miscTimer;
+    asio::steady_timer m_reconnectTimer;
+    std::atomic<bool> m_startRequested;
+    std::atomic<bool> m_started;
+    bool m_writing;
+    std::atomic<bool> m_writeRequested;
+    // Set from any thread
+    std::atomic<unsigned int> m_reconnectDelayMin;
+    std::atomic<unsigned int> m_reconnectDelayMax;
+    // Only used from within the strand
+    unsigned int m_reconnectDelay;
+
+protected:
+    virtual std::vector<std::string> getChannelsInUse() const
+    {
+        return m_obj->getChannelsInUse();
+    }
+
+    virtual void deliver(ByteSpan message, const char *topic)
+    {
+        m_obj->callHandlers(message, topic);
+    }
+};
+
+inline AsioMqttTransport::AsioMqttTransport(asio::io_service &asio,
+                                            const std::string &clientName,
+                                            const std::string &server,
+                                            unsigned int port, int qos)
+: AbstractTransport<AsioMqttTransport::Channel>()
+, m_impl(std::make_shared<AsioMqttTransport::Impl>(this, asio, clientName,
+                                                   server, port, qos))
+{
+}
+
+inline AsioMqttTransport::~AsioMqttTransport()
+{
+    // Copies share the implementation, which calls the handlers of this
+    // transport; they must not be called once it is being destroyed
+    if (m_impl->m_obj == this)
+    {
+        m_impl->stop();
+    }
+}
+
+inline void AsioMqttTransport::publish(
+    const std::vector<unsigned char> &message,
+    const AsioMqttTransport::Channel &channel)
+{
+    m_impl->publish(message, channel);
+}
+
+inline void AsioMqttTransport::start()
+{
+    m_impl->start();
+}
+
+inline void AsioMqttTransport::stop()
+{
+    m_impl->stop();
+}
+
+inline int AsioMqttTransport::getQos() const
+{
+    return m_impl->getQos();
+}
+
+inline void AsioMqttTransport::setQos(int qos)
+{
+    m_impl->setQos(qos);
+}
+
+inline bool AsioMqttTransport::isRetained() const
+{
+    return m_impl->isRetained();
+}
+
+inline void AsioMqttTransport::setRetained(bool retain)
+{
+    m_impl->setRetained(retain);
+}
+
+inline bool AsioMqttTransport::isConnected() const
+{
+    return m_impl->isConnected();
+}
+
+inline void AsioMqttTransport::setReconnectDelay(unsigned int min,
+                                                 unsigned int max)
+{
+    m_impl->m_reconnectDelayMin = min;
+    m_impl->m_reconnectDelayMax = max;
+}
+
+inline void AsioMqttTransport::setOfflineQueue(std::size_t capacity,
+                                               OverflowPolicy policy)
+{
+    m_impl->setOfflineQueue(capacity, policy);
+}
+
+inline std::size_t AsioMqttTransport::getQueuedCount() const
+{
+    return m_impl->getQueuedCount();
+}
+
+inline uint64_t AsioMqttTransport::getDroppedCount() const
+{
+    return m_impl->getDroppedCount();
+}
+
+inline void AsioMqttTransport::useChannel(
+    const AsioMqttTransport::Channel &channel)
+{
+    m_impl->useChannel(channel);
+    if (m_impl->want_write())
+    {
+        m_impl->requestWrite();
+    }
+}
+
+inline void AsioMqttTransport::dropChannel(
+    const AsioMqttTransport::Channel &channel)
+{
+    m_impl->dropChannel(channel);
+    if (m_impl->want_write())
+    {
+        m_impl->requestWrite();
+    }
+}
+
+} // bsf
+
+#endif
@@ -3,54 +3,51 @@
 #define BSF_ASYNCMQTTTRANSPORT_DETAIL_H
 
 #include "../AsyncMqttTransport.h"
+#include "../MpscQueue.h"
+#include "../Wakeup.h"
 
-#include <mosquittopp.h>
+#include <poll.h>
 
-namespace bsf
-{
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
 
-namespace detail
+namespace bsf
 {
 
-//! \brief Mosquitto initalization and cleanup manager.
-class MqttInitializer
+//! \brief Implementation.
+struct AsyncMqttTransport::Impl : public detail::MqttClient
 {
-public:
-    MqttInitializer(const MqttInitializer &) = delete;
-    MqttInitializer &operator=(const MqttInitializer &) = delete;
-
-private:
-    friend class WeakSingleton<MqttInitializer>;
-
-    MqttInitializer()
-    {
-        mosqpp::lib_init();
-    }
+    //! Interval between client housekeeping calls (milliseconds)
+    static const unsigned int MISC_INTERVAL{1000};
 
-    virtual ~MqttInitializer()
+    //! \brief Message waiting in the publish queue.
+    struct PendingPublish
     {
-        mosqpp::lib_cleanup();
-    }
-};
-
-}
-
-//! \brief Implementation.
-struct AsyncMqttTransport::Impl : public mosqpp::mosquittopp
-{
-    Impl(const Impl &) = delete;
-    Impl &operator=(const Impl &) = delete;
+        //! Channel of the message
+        std::string channel;
+        //! Message data
+        std::vector<unsigned char> message;
+    };
 
     Impl(AsyncMqttTransport *obj, const std::string &clientName,
          const std::string &server, unsigned int port, int qos)
-    : mosqpp::mosquittopp(clientName.c_str())
+    : detail::MqttClient(clientName, server, port, qos,
+                         DEFAULT_OFFLINE_CAPACITY)
     , m_obj{obj}
     , m_started{false}
-    , m_server{server}
-    , m_port{port}
-    , m_qos{qos}
-    , m_retain{false}
-    , m_init(WeakSingleton<detail::MqttInitializer>::getInstance())
+    , m_reconnectDelayMin{DEFAULT_RECONNECT_DELAY_MIN}
+    , m_reconnectDelayMax{DEFAULT_RECONNECT_DELAY_MAX}
+    , m_publishQueue()
+    , m_publishing{false}
+    , m_publisherThread()
+    , m_wakeup()
+    , m_socket{-1}
+    , m_reconnectDelay{DEFAULT_RECONNECT_DELAY_MIN}
+    , m_reconnectTime()
     {
     }
 
@@ -62,24 +59,51 @@ struct AsyncMqttTransport::Impl : public mosqpp::mosquittopp
     void publish(const std::vector<unsigned char> &message,
                  const std::string &channel)
     {
-        if (m_started)
+        if (!m_started)
+        {
+            return;
+        }
+        if (m_publishQueue)
         {
-            mosqpp::mosquittopp::publish(nullptr, channel.c_str(),
-                                         message.size(), message.data(), m_qos,
-                                         m_retain);
+            auto pushed = m_publishQueue->tryPushWith(
+                [&](PendingPublish &pending)
+                {
+                    pending.channel.assign(channel);
+                    pending.message.assign(message.begin(), message.end());
+                });
+            if (!pushed)
+            {
+                countDropped();
+                return;
+            }
+            m_wakeup.notify();
+            return;
         }
+        publishMessage(message, channel);
     }
 
     void start()
     {
         if (!m_started)
         {
-            connect(m_server.c_str(), m_port);
-            loop_start();
-            for (const auto &channel : m_obj->getChannelsInUse()) {
-                subscribe(nullptr, channel.c_str(), m_qos);
-            }
             m_started = true;
+            if (m_publishQueue)
+            {
+                // The publisher thread runs the client loop; the client only
+                // queues packets, which the thread writes once per batch
+                threaded_set(true);
+                m_publishing = true;
+                m_publisherThread = std::thread([this]
+                                                {
+                                                    runPublisher();
+                                                });
+                return;
+            }
+            reconnect_delay_set(m_reconnectDelayMin, m_reconnectDelayMax, true);
+            // Failed attempts are retried by the loop thread; channels are
+            // subscribed on connection
+            connect_async(getServer().c_str(), getPort());
+            loop_start();
         }
     }
 
@@ -87,45 +111,214 @@ struct AsyncMqttTransport::Impl : public mosqpp::mosquittopp
     {
         if (m_started)
         {
-            for (const auto &channel : m_obj->getChannelsInUse()) {
-                unsubscribe(nullptr, channel.c_str());
+            if (m_publishQueue)
+            {
+                // The publisher drains the queue and disconnects before
+                // finishing
+                m_publishing = false;
+                m_wakeup.notify();
+                m_publisherThread.join();
+            }
+            else
+            {
+                disconnectClient();
+                loop_stop();
             }
-            disconnect();
-            loop_stop();
             m_started = false;
         }
     }
 
-    void useChannel(const std::string &channel)
+    //!
+    //! \brief Wake the publisher thread up to write the packets queued by the
+    //!        client from another thread (e.g. subscriptions).
+    //!
+    void requestWrite()
     {
-        if (m_started)
+        if (m_publishQueue)
         {
-            subscribe(nullptr, channel.c_str(), m_qos);
+            m_wakeup.notify();
         }
     }
 
-    void dropChannel(const std::string &channel)
+    void runPublisher()
     {
-        if (m_started)
+        using namespace std::chrono;
+
+        auto firstAttempt = true;
+        m_reconnectDelay = m_reconnectDelayMin;
+        m_reconnectTime = steady_clock::now();
+        auto miscTime =
+            steady_clock::now() + milliseconds{int64_t{MISC_INTERVAL}};
+        // Keep draining after stop until the queue is empty
+        while (m_publishing || m_publishQueue->size() > 0)
+        {
+            auto now = steady_clock::now();
+            if (m_socket < 0 && now >= m_reconnectTime)
+            {
+                // Channels are subscribed on connection
+                auto rc = firstAttempt
+                              ? connect_async(getServer().c_str(), getPort())
+                              : reconnect_async();
+                firstAttempt = false;
+                if (rc == MOSQ_ERR_SUCCESS && socket() >= 0)
+                {
+                    m_socket = socket();
+                }
+                else
+                {
+                    scheduleReconnect();
+                }
+            }
+            if (now >= miscTime)
+            {
+                // Keep-alive pings; the client closes the socket on timeout
+                loop_misc();
+                if (m_socket >= 0 && socket() != m_socket)
+                {
+                    connectionLost();
+                }
+                miscTime = now + milliseconds{int64_t{MISC_INTERVAL}};
+            }
+
+            // Hand a batch of messages over back to back, and write it at once
+            for (std::size_t i = 0; i < m_publishQueue->capacity(); i++) {
+                auto popped = m_publishQueue->tryPopWith(
+                    [this](PendingPublish &pending)
+                    {
+                        publishMessage(pending.message, pending.channel);
+                    });
+                if (!popped)
+                {
+                    break;
+                }
+            }
+            if (m_socket >= 0 && want_write() &&
+                loop_write() != MOSQ_ERR_SUCCESS)
+            {
+                connectionLost();
+            }
+
+            waitForWork(miscTime);
+        }
+        disconnectClient();
+        if (m_socket >= 0)
+        {
+            loop_write();
+            m_socket = -1;
+        }
+    }
+
+    //!
+    //! \brief Wait until there is something to publish, the socket is ready
+    //!        or a timer is due.
+    //!
+    //! \param miscTime Time of the next housekeeping call
+    //!
+    void waitForWork(std::chrono::steady_clock::time_point miscTime)
+    {
+        using namespace std::chrono;
+
+        pollfd descriptors[2];
+        descriptors[0] = pollfd{m_wakeup.fd(), POLLIN, 0};
+        descriptors[1] = pollfd{
+            m_socket, static_cast<short>(POLLIN | (want_write() ? POLLOUT : 0)),
+            0};
+        nfds_t count = m_socket >= 0 ? 2 : 1;
+
+        auto timeout = 0;
+        m_wakeup.prepareWait();
+        if (m_publishing && m_publishQueue->size() == 0)
+        {
+            auto deadline = miscTime;
+            if (m_socket < 0)
+            {
+                deadline = std::min(deadline, m_reconnectTime);
+            }
+            auto remaining = duration_cast<milliseconds>(
+                deadline - steady_clock::now() + milliseconds{1});
+            timeout = static_cast<int>(
+                std::max(remaining.count(), static_cast<int64_t>(0)));
+        }
+        else
+        {
+            m_wakeup.cancelWait();
+        }
+        poll(descriptors, count, timeout);
+        if ((descriptors[0].revents & POLLIN) != 0)
+        {
+            m_wakeup.clear();
+        }
+        else
         {
-            unsubscribe(nullptr, channel.c_str());
+            m_wakeup.cancelWait();
         }
+
+        if (count < 2)
+        {
+            return;
+        }
+        if ((descriptors[1].revents &
+             (POLLIN | POLLERR | POLLHUP | POLLNVAL)) != 0 &&
+            loop_read() != MOSQ_ERR_SUCCESS)
+        {
+            connectionLost();
+            return;
+        }
+        if ((descriptors[1].revents & POLLOUT) != 0 && m_socket >= 0 &&
+            loop_write() != MOSQ_ERR_SUCCESS)
+        {
+            connectionLost();
+        }
+    }
+
+    void connectionLost()
+    {
+        m_socket = -1;
+        // As the mosquitto loop does when a read or write fails
+        on_disconnect(MOSQ_ERR_CONN_LOST);
+        scheduleReconnect();
+    }
+
+    void scheduleReconnect()
+    {
+        m_reconnectTime = std::chrono::steady_clock::now() +
+                          std::chrono::seconds{int64_t{m_reconnectDelay}};
+        m_reconnectDelay =
+            std::min(m_reconnectDelay * 2, m_reconnectDelayMax.load());
     }
 
-    virtual void on_message(const struct mosquitto_message *message)
+    virtual void on_connect(int rc)
     {
-        auto payload = reinterpret_cast<unsigned char *>(message->payload);
-        std::vector<unsigned char> data(payload, payload + message->payloadlen);
-        m_obj->callHandlers(std::move(data), message->topic);
+        detail::MqttClient::on_connect(rc);
+        if (rc == 0)
+        {
+            m_reconnectDelay = m_reconnectDelayMin;
+        }
     }
 
     AsyncMqttTransport *const m_obj;
-    bool m_started;
-    std::string m_server;
-    unsigned int m_port;
-    int m_qos;
-    bool m_retain;
-    std::shared_ptr<detail::MqttInitializer> m_init;
+    std::atomic<bool> m_started;
+    std::atomic<unsigned int> m_reconnectDelayMin;
+    std::atomic<unsigned int> m_reconnectDelayMax;
+    std::unique_ptr<MpscQueue<PendingPublish>> m_publishQueue;
+    std::atomic<bool> m_publishing;
+    std::thread m_publisherThread;
+    Wakeup m_wakeup;
+    // Client loop state, only used by the publisher thread
+    int m_socket;
+    unsigned int m_reconnectDelay;
+    std::chrono::steady_clock::time_point m_reconnectTime;
+
+protected:
+    virtual std::vector<std::string> getChannelsInUse() const
+    {
+        return m_obj->getChannelsInUse();
+    }
+
+    virtual void deliver(ByteSpan message, const char *topic)
+    {
+        m_obj->callHandlers(message, topic);
+    }
 };
 
 AsyncMqttTransport::AsyncMqttTransport(const std::string &clientName,
@@ -159,32 +352,85 @@ void AsyncMqttTransport::stop()
 
 int AsyncMqttTransport::getQos() const
 {
-    return m_impl->m_qos;
+    return m_impl->getQos();
 }
 
 void AsyncMqttTransport::setQos(int qos)
 {
-    m_impl->m_qos = qos;
+    m_impl->setQos(qos);
 }
 
 bool AsyncMqttTransport::isRetained() const
 {
-    return m_impl->m_retain;
+    return m_impl->isRetained();
 }
 
 void AsyncMqttTransport::setRetained(bool retain)
 {
-    m_impl->m_retain = retain;
+    m_impl->setRetained(retain);
+}
+
+void AsyncMqttTransport::setAsyncPublish(std::size_t capacity)
+{
+    if (m_impl->m_started)
+    {
+        throw std::logic_error(
+            "The publish mode cannot be changed while the transport is started");
+    }
+    if (capacity == 0)
+    {
+        m_impl->m_publishQueue.reset();
+    }
+    else
+    {
+        m_impl->m_publishQueue.reset(
+            new MpscQueue<Impl::PendingPublish>(capacity));
+    }
+}
+
+bool AsyncMqttTransport::isAsyncPublish() const
+{
+    return static_cast<bool>(m_impl->m_publishQueue);
+}
+
+bool AsyncMqttTransport::isConnected() const
+{
+    return m_impl->isConnected();
+}
+
+void AsyncMqttTransport::setReconnectDelay(unsigned int min, unsigned int max)
+{
+    m_impl->m_reconnectDelayMin = min;
+    m_impl->m_reconnectDelayMax = max;
+    m_impl->reconnect_delay_set(min, max, true);
+}
+
+void AsyncMqttTransport::setOfflineQueue(std::size_t capacity,
+                                         OverflowPolicy policy)
+{
+    m_impl->setOfflineQueue(capacity, policy);
+}
+
+std::size_t AsyncMqttTransport::getQueuedCount() const
+{
+    return m_impl->getQueuedCount();
+}
+
+uint64_t AsyncMqttTransport::getDroppedCount() const
+{
+    return m_impl->getDroppedCount();
 }
 
 void AsyncMqttTransport::useChannel(const AsyncMqttTransport::Channel &channel)
 {
     m_impl->useChannel(channel);
+    m_impl->requestWrite();
 }
 
 void AsyncMqttTransport::dropChannel(const AsyncMqttTransport::Channel &channel)
 {
     m_impl->dropChannel(channel);
+    m_impl->requestWrite();
 }
 
 } // bsf
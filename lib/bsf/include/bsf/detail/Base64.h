@@ -0,0 +1,252 @@
+
+#ifndef BSF_BASE64_DETAIL_H
+#define BSF_BASE64_DETAIL_H
+
+#include "../Base64.h"
+
+#include <cstdint>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+namespace bsf
+{
+
+namespace detail
+{
+
+//! Value of the characters out of the Base64 alphabet
+static const unsigned char BASE64_INVALID{0xff};
+
+//! \return The Base64 alphabet
+inline const char *base64Alphabet()
+{
+    return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+//! \return The values of the characters (BASE64_INVALID out of the alphabet)
+inline const unsigned char *base64Values()
+{
+    static const unsigned char values[256] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+        0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+        0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+        0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24,
+        0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+        0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff
+    };
+    return values;
+}
+
+#ifdef __SSSE3__
+//!
+//! \brief Encode blocks of 12 bytes with SSSE3 instructions.
+//!
+//! Every block is loaded with 16 bytes, so the last 4 bytes of the data are
+//! left to the caller.
+//!
+//! \param in Data, advanced past the encoded blocks
+//! \param end End of the data
+//! \param out Output, advanced past the encoded blocks
+//!
+inline void base64EncodeSsse3(const unsigned char *&in,
+                              const unsigned char *end,
+                              unsigned char *&out)
+{
+    // Spread every 3 bytes over a 32-bit lane (b1 b0 b2 b1)
+    const __m128i spread =
+        _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    // Offsets from the 6-bit values to the characters, indexed by range
+    const __m128i offsets =
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    while (end - in >= 16) {
+        auto block = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), spread);
+        // Move every 6-bit field to a byte of its own
+        auto high = _mm_mulhi_epu16(
+            _mm_and_si128(block, _mm_set1_epi32(0x0fc0fc00)),
+            _mm_set1_epi32(0x04000040));
+        auto low = _mm_mullo_epi16(
+            _mm_and_si128(block, _mm_set1_epi32(0x003f03f0)),
+            _mm_set1_epi32(0x01000010));
+        auto values = _mm_or_si128(high, low);
+        // Range of every value: 13 for 0-25, 0 for 26-51, 1-12 for 52-63
+        auto ranges = _mm_subs_epu8(values, _mm_set1_epi8(51));
+        auto upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+        ranges = _mm_or_si128(ranges, _mm_and_si128(upper, _mm_set1_epi8(13)));
+        auto text =
+            _mm_add_epi8(values, _mm_shuffle_epi8(offsets, ranges));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), text);
+        in += 12;
+        out += 16;
+    }
+}
+
+//!
+//! \brief Decode blocks of 16 characters with SSSE3 instructions.
+//!
+//! Every block is stored with 16 bytes, so the last 8 characters of the text
+//! are left to the caller. Decoding stops at the first block with characters
+//! out of the alphabet (including padding).
+//!
+//! \param in Text, advanced past the decoded blocks
+//! \param end End of the text
+//! \param out Output, advanced past the decoded blocks
+//!
+inline void base64DecodeSsse3(const unsigned char *&in,
+                              const unsigned char *end,
+                              unsigned char *&out)
+{
+    // Classification of the characters by their low and high nibbles: a
+    // character is valid if the masks of its nibbles do not intersect
+    const __m128i lowMasks =
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                      0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i highMasks =
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // Offsets from the characters to the 6-bit values, indexed by high
+    // nibble ('/' shares its high nibble with '+' and is indexed apart)
+    const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                          0, 0, 0, 0, 0, 0, 0);
+    // Gather the 3 bytes of every 32-bit lane at the beginning of the block
+    const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13,
+                                         12, -1, -1, -1, -1);
+    while (end - in >= 24) {
+        auto text = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        auto highNibbles =
+            _mm_and_si128(_mm_srli_epi32(text, 4), _mm_set1_epi8(0x0f));
+        auto lowNibbles = _mm_and_si128(text, _mm_set1_epi8(0x0f));
+        auto invalid =
+            _mm_and_si128(_mm_shuffle_epi8(lowMasks, lowNibbles),
+                          _mm_shuffle_epi8(highMasks, highNibbles));
+        if (_mm_movemask_epi8(
+                _mm_cmpgt_epi8(invalid, _mm_setzero_si128())) != 0)
+        {
+            return;
+        }
+        auto slashes = _mm_cmpeq_epi8(text, _mm_set1_epi8('/'));
+        auto values = _mm_add_epi8(
+            text,
+            _mm_shuffle_epi8(offsets, _mm_add_epi8(slashes, highNibbles)));
+        // Merge every 4 6-bit values into 3 bytes
+        auto pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        auto lanes = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                         _mm_shuffle_epi8(lanes, gather));
+        in += 16;
+        out += 12;
+    }
+}
+#endif
+
+} // detail
+
+inline std::size_t Base64::decodedSize(ByteSpan text)
+{
+    auto size = text.size();
+    std::size_t padding{0};
+    if (size >= 4 && size % 4 == 0)
+    {
+        padding = (text.data()[size - 1] == '=')
+                  + (text.data()[size - 2] == '=');
+    }
+    return size / 4 * 3 + size % 4 * 3 / 4 - padding;
+}
+
+inline void Base64::encode(ByteSpan data, unsigned char *out)
+{
+    auto in = data.data();
+    auto end = in + data.size();
+#ifdef __SSSE3__
+    detail::base64EncodeSsse3(in, end, out);
+#endif
+    auto alphabet = detail::base64Alphabet();
+    for (; end - in >= 3; in += 3, out += 4) {
+        uint32_t bits =
+            (uint32_t{in[0]} << 16) | (uint32_t{in[1]} << 8) | in[2];
+        out[0] = alphabet[bits >> 18];
+        out[1] = alphabet[(bits >> 12) & 0x3f];
+        out[2] = alphabet[(bits >> 6) & 0x3f];
+        out[3] = alphabet[bits & 0x3f];
+    }
+    if (in != end)
+    {
+        uint32_t bits = uint32_t{in[0]} << 16;
+        if (end - in == 2)
+        {
+            bits |= uint32_t{in[1]} << 8;
+        }
+        out[0] = alphabet[bits >> 18];
+        out[1] = alphabet[(bits >> 12) & 0x3f];
+        out[2] = (end - in == 2) ? alphabet[(bits >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+}
+
+inline std::size_t Base64::decode(ByteSpan text, unsigned char *out)
+{
+    auto in = text.data();
+    auto end = in + text.size();
+    auto begin = out;
+#ifdef __SSSE3__
+    detail::base64DecodeSsse3(in, end, out);
+#endif
+    // Whole quanta, until the first character out of the alphabet
+    auto values = detail::base64Values();
+    for (; end - in >= 4; in += 4, out += 3) {
+        uint32_t a = values[in[0]];
+        uint32_t b = values[in[1]];
+        uint32_t c = values[in[2]];
+        uint32_t d = values[in[3]];
+        if (((a | b | c | d) & 0x80) != 0)
+        {
+            break;
+        }
+        uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<unsigned char>(bits >> 16);
+        out[1] = static_cast<unsigned char>(bits >> 8);
+        out[2] = static_cast<unsigned char>(bits);
+    }
+    // Rest of the text, skipping characters out of the alphabet
+    uint32_t bits{0};
+    unsigned int count{0};
+    for (; in != end && *in != '='; ++in) {
+        auto value = values[*in];
+        if (value == detail::BASE64_INVALID)
+        {
+            continue;
+        }
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            *out++ = static_cast<unsigned char>(bits >> count);
+        }
+    }
+    return out - begin;
+}
+
+} // bsf
+
+#endif
@@ -0,0 +1,191 @@
+
+#ifndef BSF_INPROCESSTRANSPORT_DETAIL_H
+#define BSF_INPROCESSTRANSPORT_DETAIL_H
+
+#include "../InProcessTransport.h"
+#include "../MpscQueue.h"
+#include "../Wakeup.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace bsf
+{
+
+//! \brief Implementation.
+struct InProcessTransport::Impl
+{
+    //! \brief Message waiting in the delivery queue.
+    struct PendingDelivery
+    {
+        //! Channel of the message
+        std::string channel;
+        //! Message data
+        std::vector<unsigned char> message;
+    };
+
+    Impl(InProcessTransport *obj, std::size_t queueCapacity)
+    : m_obj{obj}
+    , m_started{false}
+    , m_queue()
+    , m_delivering{false}
+    , m_deliveryThread()
+    , m_wakeup()
+    , m_droppedCount{0}
+    {
+        if (queueCapacity > 0)
+        {
+            m_queue.reset(new MpscQueue<PendingDelivery>(queueCapacity));
+        }
+    }
+
+    ~Impl()
+    {
+        stop();
+    }
+
+    void publish(const std::vector<unsigned char> &message,
+                 const std::string &channel)
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        if (!m_queue)
+        {
+            m_obj->callHandlers(ByteSpan(message), channel);
+            return;
+        }
+        auto pushed = m_queue->tryPushWith(
+            [&](PendingDelivery &pending)
+            {
+                pending.channel.assign(channel);
+                pending.message.assign(message.begin(), message.end());
+            });
+        if (!pushed)
+        {
+            m_droppedCount++;
+            return;
+        }
+        m_wakeup.notify();
+    }
+
+    void start()
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            if (m_queue)
+            {
+                m_delivering = true;
+                m_deliveryThread = std::thread([this]
+                                               {
+                                                   runDelivery();
+                                               });
+            }
+        }
+    }
+
+    void stop()
+    {
+        if (m_started)
+        {
+            m_started = false;
+            if (m_queue)
+            {
+                // The delivery thread drains the queue before finishing
+                m_delivering = false;
+                m_wakeup.notify();
+                m_deliveryThread.join();
+            }
+        }
+    }
+
+    void runDelivery()
+    {
+        // Keep draining after stop until the queue is empty
+        while (m_delivering || m_queue->size() > 0)
+        {
+            auto popped = m_queue->tryPopWith(
+                [this](PendingDelivery &pending)
+                {
+                    m_obj->callHandlers(ByteSpan(pending.message),
+                                        pending.channel);
+                });
+            if (!popped)
+            {
+                // Sleep until a message is pushed or the transport stopped
+                m_wakeup.prepareWait();
+                if (m_delivering && m_queue->size() == 0)
+                {
+                    m_wakeup.wait();
+                }
+                else
+                {
+                    m_wakeup.cancelWait();
+                }
+            }
+        }
+    }
+
+    InProcessTransport *const m_obj;
+    std::atomic<bool> m_started;
+    std::unique_ptr<MpscQueue<PendingDelivery>> m_queue;
+    std::atomic<bool> m_delivering;
+    std::thread m_deliveryThread;
+    Wakeup m_wakeup;
+    std::atomic<uint64_t> m_droppedCount;
+};
+
+inline InProcessTransport::InProcessTransport(std::size_t queueCapacity)
+: AbstractTransport<InProcessTransport::Channel>()
+, m_impl(std::make_shared<InProcessTransport::Impl>(this, queueCapacity))
+{
+}
+
+inline InProcessTransport::~InProcessTransport()
+{
+    // Copies share the implementation, which calls the handlers of this
+    // transport; they must not be called once it is being destroyed
+    if (m_impl->m_obj == this)
+    {
+        m_impl->stop();
+    }
+}
+
+inline void InProcessTransport::publish(
+    const std::vector<unsigned char> &message,
+    const InProcessTransport::Channel &channel)
+{
+    m_impl->publish(message, channel);
+}
+
+inline void InProcessTransport::start()
+{
+    m_impl->start();
+}
+
+inline void InProcessTransport::stop()
+{
+    m_impl->stop();
+}
+
+inline bool InProcessTransport::isQueued() const
+{
+    return static_cast<bool>(m_impl->m_queue);
+}
+
+inline std::size_t InProcessTransport::getQueuedCount() const
+{
+    return m_impl->m_queue ? m_impl->m_queue->size() : 0;
+}
+
+inline uint64_t InProcessTransport::getDroppedCount() const
+{
+    return m_impl->m_droppedCount;
+}
+
+} // bsf
+
+#endif
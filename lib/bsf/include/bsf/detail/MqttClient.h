@@ -0,0 +1,441 @@
+
+#ifndef BSF_MQTTCLIENT_DETAIL_H
+#define BSF_MQTTCLIENT_DETAIL_H
+
+#include "../common.h"
+#include "../Singleton.h"
+
+#include <mosquittopp.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bsf
+{
+
+//! Policies for messages published while a bounded queue is full
+enum class OverflowPolicy
+{
+    //! Drop the oldest queued message
+    DROP_OLDEST,
+    //! Drop the new message
+    DROP_NEWEST
+};
+
+namespace detail
+{
+
+//! \brief Mosquitto initalization and cleanup manager.
+class MqttInitializer
+{
+public:
+    MqttInitializer(const MqttInitializer &) = delete;
+    MqttInitializer &operator=(const MqttInitializer &) = delete;
+
+private:
+    friend class WeakSingleton<MqttInitializer>;
+
+    MqttInitializer()
+    {
+        mosqpp::lib_init();
+    }
+
+    virtual ~MqttInitializer()
+    {
+        mosqpp::lib_cleanup();
+    }
+};
+
+//!
+//! \brief Bounded ring of messages published while disconnected.
+//!
+//! The storage of every slot is reused, so once the ring has been filled no
+//! more memory is allocated for messages of similar size.
+//!
+class OfflineQueue
+{
+public:
+    explicit OfflineQueue(std::size_t capacity)
+    : m_slots(capacity)
+    , m_head{0}
+    , m_size{0}
+    {
+    }
+
+    //!
+    //! \brief Add a message.
+    //!
+    //! \param channel Channel of the message
+    //! \param message Message data
+    //! \param policy Policy applied if the ring is full
+    //! \return false if a message was dropped; true otherwise
+    //!
+    bool push(const std::string &channel,
+              const std::vector<unsigned char> &message,
+              OverflowPolicy policy)
+    {
+        auto dropped = false;
+        if (m_size == m_slots.size())
+        {
+            if (policy == OverflowPolicy::DROP_NEWEST ||
+                m_slots.empty())
+            {
+                return false;
+            }
+            m_head = (m_head + 1) % m_slots.size();
+            m_size--;
+            dropped = true;
+        }
+        auto &slot = m_slots[(m_head + m_size) % m_slots.size()];
+        slot.first.assign(channel);
+        slot.second.assign(message.begin(), message.end());
+        m_size++;
+        return !dropped;
+    }
+
+    //!
+    //! \brief Remove the oldest message.
+    //!
+    //! \param channel Channel of the message
+    //! \param message Message data
+    //! \return false if the ring was empty; true otherwise
+    //!
+    bool pop(std::string &channel, std::vector<unsigned char> &message)
+    {
+        if (m_size == 0)
+        {
+            return false;
+        }
+        auto &slot = m_slots[m_head];
+        channel.swap(slot.first);
+        message.swap(slot.second);
+        m_head = (m_head + 1) % m_slots.size();
+        m_size--;
+        return true;
+    }
+
+    //!
+    //! \brief Change the capacity of the ring.
+    //!
+    //! The oldest messages are dropped if they do not fit.
+    //!
+    //! \param capacity New capacity
+    //! \return Number of dropped messages
+    //!
+    std::size_t resize(std::size_t capacity)
+    {
+        std::vector<std::pair<std::string, std::vector<unsigned char>>> slots(
+            capacity);
+        std::size_t dropped{0};
+        while (m_size > capacity)
+        {
+            m_head = (m_head + 1) % m_slots.size();
+            m_size--;
+            dropped++;
+        }
+        auto size = m_size;
+        for (std::size_t i = 0; i < size; i++) {
+            pop(slots[i].first, slots[i].second);
+        }
+        m_slots.swap(slots);
+        m_head = 0;
+        m_size = size;
+        return dropped;
+    }
+
+    //! \return Number of messages
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    //! Channel and data of the messages
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> m_slots;
+    //! Index of the oldest message
+    std::size_t m_head;
+    //! Number of messages
+    std::size_t m_size;
+};
+
+//!
+//! \brief Mosquitto client shared by the MQTT transports.
+//!
+//! Keeps the subscriptions and the messages published while disconnected.
+//! Every channel in use is subscribed on connection, and the messages queued
+//! while disconnected are sent then, in order. How the client loop is run is
+//! up to subclasses.
+//!
+class MqttClient : public mosqpp::mosquittopp
+{
+public:
+    MqttClient(const MqttClient &) = delete;
+    MqttClient &operator=(const MqttClient &) = delete;
+
+    MqttClient(const std::string &clientName, const std::string &server,
+               unsigned int port, int qos, std::size_t offlineCapacity)
+    : mosqpp::mosquittopp(clientName.c_str())
+    , m_connected{false}
+    , m_server{server}
+    , m_port{port}
+    , m_qos{qos}
+    , m_retain{false}
+    , m_subscriptionMutex()
+    , m_subscribed{false}
+    , m_offlineMutex()
+    , m_offline(offlineCapacity)
+    , m_overflowPolicy{OverflowPolicy::DROP_OLDEST}
+    , m_droppedCount{0}
+    , m_init(WeakSingleton<MqttInitializer>::getInstance())
+    {
+    }
+
+    virtual ~MqttClient()
+    {
+    }
+
+    //!
+    //! \brief Publish a message, or queue it if disconnected.
+    //!
+    void publishMessage(const std::vector<unsigned char> &message,
+                        const std::string &channel)
+    {
+        auto attempted = false;
+        if (m_connected)
+        {
+            auto rc = publish(nullptr, channel.c_str(), message.size(),
+                              message.data(), m_qos, m_retain);
+            if (rc != MOSQ_ERR_NO_CONN && rc != MOSQ_ERR_CONN_LOST)
+            {
+                return;
+            }
+            attempted = true;
+        }
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        // The connection may have been restored and the queue flushed
+        if (m_connected && !attempted)
+        {
+            publish(nullptr, channel.c_str(), message.size(), message.data(),
+                    m_qos, m_retain);
+            return;
+        }
+        if (!m_offline.push(channel, message, m_overflowPolicy))
+        {
+            m_droppedCount++;
+        }
+    }
+
+    void useChannel(const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+        if (m_subscribed)
+        {
+            subscribe(nullptr, channel.c_str(), m_qos);
+        }
+    }
+
+    void dropChannel(const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+        if (m_subscribed)
+        {
+            unsubscribe(nullptr, channel.c_str());
+        }
+    }
+
+    //!
+    //! \brief Unsubscribe from every channel in use and disconnect.
+    //!
+    void disconnectClient()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+            if (m_subscribed)
+            {
+                for (const auto &channel : getChannelsInUse()) {
+                    unsubscribe(nullptr, channel.c_str());
+                }
+            }
+            m_subscribed = false;
+        }
+        disconnect();
+        m_connected = false;
+    }
+
+    void setOfflineQueue(std::size_t capacity, OverflowPolicy policy)
+    {
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        m_droppedCount += m_offline.resize(capacity);
+        m_overflowPolicy = policy;
+    }
+
+    std::size_t getQueuedCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        return m_offline.size();
+    }
+
+    //! \return Quality of service of the publications and subscriptions
+    int getQos() const
+    {
+        return m_qos;
+    }
+
+    //!
+    //! \brief Set the quality of service.
+    //!
+    //! Channels already subscribed keep their quality of service until the
+    //! next connection.
+    //!
+    //! \param qos Quality of service
+    //!
+    void setQos(int qos)
+    {
+        m_qos = qos;
+    }
+
+    //! \return Whether messages are published as retained
+    bool isRetained() const
+    {
+        return m_retain;
+    }
+
+    //!
+    //! \brief Set whether messages are published as retained.
+    //!
+    //! \param retain Whether messages are retained
+    //!
+    void setRetained(bool retain)
+    {
+        m_retain = retain;
+    }
+
+    //! \return Whether the client is connected
+    bool isConnected() const
+    {
+        return m_connected;
+    }
+
+    //! \return Number of messages dropped since construction
+    uint64_t getDroppedCount() const
+    {
+        return m_droppedCount;
+    }
+
+    virtual void on_connect(int rc)
+    {
+        if (rc != 0)
+        {
+            return;
+        }
+        {
+            // A channel used meanwhile is either in the snapshot or
+            // subscribed by useChannel(), possibly both
+            std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+            m_subscribed = true;
+            for (const auto &channel : getChannelsInUse()) {
+                subscribe(nullptr, channel.c_str(), m_qos);
+            }
+        }
+        // Flush the messages published while disconnected, in order
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        std::string channel;
+        std::vector<unsigned char> message;
+        while (m_offline.pop(channel, message))
+        {
+            publish(nullptr, channel.c_str(), message.size(), message.data(),
+                    m_qos, m_retain);
+        }
+        m_connected = true;
+    }
+
+    virtual void on_disconnect(int /*rc*/)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+            m_subscribed = false;
+        }
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        m_connected = false;
+    }
+
+    virtual void on_message(const struct mosquitto_message *message)
+    {
+        // The payload is owned by mosquitto and valid during the callback
+        auto payload =
+            reinterpret_cast<const unsigned char *>(message->payload);
+        // Match the topic without building a string
+        auto topic = static_cast<const char *>(message->topic);
+        deliver(ByteSpan(payload, message->payloadlen), topic);
+    }
+
+protected:
+    //! \return Address of the MQTT broker
+    const std::string &getServer() const
+    {
+        return m_server;
+    }
+
+    //! \return Port of the MQTT broker
+    unsigned int getPort() const
+    {
+        return m_port;
+    }
+
+    //!
+    //! \brief Count a message dropped before reaching the client.
+    //!
+    void countDropped()
+    {
+        m_droppedCount++;
+    }
+
+    //! \return The channels in use by the transport
+    virtual std::vector<std::string> getChannelsInUse() const = 0;
+
+    //!
+    //! \brief Deliver a received message to the transport handlers.
+    //!
+    //! \param message Message data
+    //! \param topic Channel where the message was received
+    //!
+    virtual void deliver(ByteSpan message, const char *topic) = 0;
+
+private:
+    //! Whether the client is connected and the offline queue flushed
+    std::atomic<bool> m_connected;
+    //! MQTT broker address
+    const std::string m_server;
+    //! MQTT broker port
+    const unsigned int m_port;
+    //! Quality of service
+    std::atomic<int> m_qos;
+    //! Whether messages are retained
+    std::atomic<bool> m_retain;
+    //! Serializes the subscriptions on connection with the channel updates
+    std::mutex m_subscriptionMutex;
+    //! Whether the channels in use are subscribed
+    bool m_subscribed;
+    //! Protects the offline queue and its policy
+    mutable std::mutex m_offlineMutex;
+    //! Messages published while disconnected
+    OfflineQueue m_offline;
+    //! Policy applied when the offline queue is full
+    OverflowPolicy m_overflowPolicy;
+    //! Number of dropped messages
+    std::atomic<uint64_t> m_droppedCount;
+    //! Mosquitto library initializer
+    std::shared_ptr<MqttInitializer> m_init;
+};
+
+}
+
+} // bsf
+
+#endif
@@ -0,0 +1,721 @@
+
+#ifndef BSF_SHMTRANSPORT_DETAIL_H
+#define BSF_SHMTRANSPORT_DETAIL_H
+
+#include "../ShmTransport.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+
+namespace bsf
+{
+
+namespace detail
+{
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "Shared memory rings require lock-free atomics");
+
+//!
+//! \brief Ring of message slots in a POSIX shared memory segment.
+//!
+//! Every slot is guarded by a sequence number, as in a seqlock: ticket t is
+//! being written while the sequence is 2t+1 and complete once it is 2t+2.
+//! Readers copy a slot and check that its sequence did not change meanwhile.
+//!
+//! Publishers take a ticket from the head and claim its slot by swapping an
+//! even sequence of an earlier ticket for 2t+1, so that a slot is written by a
+//! single publisher at a time. A publisher finding the slot still being written
+//! by a publisher a whole ring behind, or already claimed by one a whole ring
+//! ahead, drops its message and marks the ticket as dropped in the slot for
+//! the readers to skip it.
+//!
+class ShmRing
+{
+public:
+    //! Result of reading a slot
+    enum class ReadResult
+    {
+        //! The message was read
+        READY,
+        //! The message has not been published yet
+        EMPTY,
+        //! The message was overwritten
+        OVERRUN,
+        //! The message was dropped by its publisher
+        DROPPED
+    };
+
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    //!
+    //! \brief Open a ring, creating it if it does not exist.
+    //!
+    //! \param name Segment name
+    //! \param slotCount Number of slots, if created (a power of two)
+    //! \param slotSize Size of the slots, if created (bytes)
+    //! \throw std::system_error if the segment cannot be opened
+    //!
+    ShmRing(const std::string &name, std::size_t slotCount,
+            std::size_t slotSize)
+    : m_memory{nullptr}
+    , m_size{0}
+    , m_header{nullptr}
+    {
+        auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0)
+        {
+            create(fd, name, slotCount, slotSize);
+        }
+        else if (errno == EEXIST)
+        {
+            fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd < 0)
+            {
+                fail("shm_open " + name);
+            }
+            attach(fd, name);
+        }
+        else
+        {
+            fail("shm_open " + name);
+        }
+    }
+
+    ~ShmRing()
+    {
+        munmap(m_memory, m_size);
+    }
+
+    //! \return Number of slots
+    std::size_t slotCount() const
+    {
+        return m_header->slotCount;
+    }
+
+    //! \return Size of the slots (bytes)
+    std::size_t slotSize() const
+    {
+        return m_header->slotSize;
+    }
+
+    //! \return Ticket of the next message to be published
+    uint64_t head() const
+    {
+        return m_header->head.load();
+    }
+
+    //!
+    //! \brief Publish a message.
+    //!
+    //! \param message Message data
+    //! \return false if the message was dropped, as it does not fit in a slot
+    //!         or its slot is busy; true otherwise
+    //!
+    bool write(ByteSpan message)
+    {
+        if (message.size() > m_header->slotSize)
+        {
+            return false;
+        }
+        auto ticket = m_header->head.fetch_add(1);
+        auto &slot = this->slot(ticket);
+        auto sequence = slot.sequence.load(std::memory_order_relaxed);
+        do
+        {
+            if (sequence % 2 != 0 || sequence >= 2 * ticket + 2)
+            {
+                drop(slot, ticket);
+                return false;
+            }
+        } while (!slot.sequence.compare_exchange_weak(
+            sequence, 2 * ticket + 1, std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.size = static_cast<uint32_t>(message.size());
+        std::memcpy(data(slot), message.data(), message.size());
+        slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+        signal();
+        return true;
+    }
+
+    //!
+    //! \brief Read a message.
+    //!
+    //! \param ticket Ticket of the message
+    //! \param buffer Buffer of at least slotSize() bytes
+    //! \param size Set to the size of the message if ready
+    //! \return The result of the read
+    //!
+    ReadResult read(uint64_t ticket, unsigned char *buffer,
+                    std::size_t &size) const
+    {
+        const auto &slot = this->slot(ticket);
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence < 2 * ticket + 2)
+        {
+            return isDropped(slot, ticket) ? ReadResult::DROPPED
+                                           : ReadResult::EMPTY;
+        }
+        if (sequence > 2 * ticket + 2)
+        {
+            return ReadResult::OVERRUN;
+        }
+        size = std::min<std::size_t>(slot.size, m_header->slotSize);
+        std::memcpy(buffer, data(slot), size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            return ReadResult::OVERRUN;
+        }
+        return ReadResult::READY;
+    }
+
+    //!
+    //! \brief Sleep until a message is published after a ticket.
+    //!
+    //! May return spuriously.
+    //!
+    //! \param ticket Ticket of the awaited message
+    //! \param timeout Maximum sleep time
+    //!
+    void wait(uint64_t ticket, std::chrono::milliseconds timeout)
+    {
+        m_header->waiters.fetch_add(1);
+        auto notify = m_header->notify.load();
+        const auto &slot = this->slot(ticket);
+        if (slot.sequence.load() < 2 * ticket + 2 && !isDropped(slot, ticket))
+        {
+            struct timespec time;
+            time.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+            time.tv_nsec = static_cast<long>(timeout.count() % 1000) * 1000000;
+            syscall(SYS_futex, futexWord(), FUTEX_WAIT, notify, &time,
+                    nullptr, 0);
+        }
+        m_header->waiters.fetch_sub(1);
+    }
+
+    //!
+    //! \brief Wake every reader sleeping on the ring.
+    //!
+    void wake()
+    {
+        syscall(SYS_futex, futexWord(), FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+                0);
+    }
+
+private:
+    //! Value identifying an initialized segment
+    static const uint32_t MAGIC{0x42534652};
+    //! Time allowed for the creator to initialize a segment (milliseconds)
+    static const unsigned int ATTACH_TIMEOUT{1000};
+
+    //! \brief Segment header.
+    struct Header
+    {
+        //! MAGIC once the segment is initialized
+        std::atomic<uint32_t> magic;
+        //! Number of slots
+        uint32_t slotCount;
+        //! Size of the slots
+        uint32_t slotSize;
+        //! Futex word, incremented on every publication
+        std::atomic<uint32_t> notify;
+        //! Number of sleeping readers
+        std::atomic<uint32_t> waiters;
+        //! Padding keeping the head on its own cache line
+        unsigned char padding[44];
+        //! Ticket of the next message to be published
+        std::atomic<uint64_t> head;
+    };
+
+    //! \brief Slot header, followed by the slot data.
+    struct Slot
+    {
+        //! Sequence number of the slot
+        std::atomic<uint64_t> sequence;
+        //! Latest ticket dropped in the slot plus one, or 0
+        std::atomic<uint64_t> dropped;
+        //! Size of the message
+        uint32_t size;
+        //! Padding
+        uint32_t padding;
+    };
+
+    //! Mapped segment
+    void *m_memory;
+    //! Size of the mapped segment
+    std::size_t m_size;
+    //! Segment header
+    Header *m_header;
+
+    static void fail(const std::string &what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    static std::size_t stride(std::size_t slotSize)
+    {
+        // Keep the slot headers aligned
+        return sizeof(Slot) + (slotSize + 7) / 8 * 8;
+    }
+
+    static std::size_t segmentSize(std::size_t slotCount, std::size_t slotSize)
+    {
+        return sizeof(Header) + slotCount * stride(slotSize);
+    }
+
+    void map(int fd, const std::string &name, std::size_t size)
+    {
+        auto memory =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            auto error = errno;
+            close(fd);
+            errno = error;
+            fail("mmap " + name);
+        }
+        m_memory = memory;
+        m_size = size;
+        m_header = static_cast<Header *>(memory);
+    }
+
+    void create(int fd, const std::string &name, std::size_t slotCount,
+                std::size_t slotSize)
+    {
+        auto size = segmentSize(slotCount, slotSize);
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            auto error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            errno = error;
+            fail("ftruncate " + name);
+        }
+        map(fd, name, size);
+        close(fd);
+        // The segment is zero-filled, so every slot starts with sequence 0
+        auto header = new (m_memory) Header();
+        header->slotCount = static_cast<uint32_t>(slotCount);
+        header->slotSize = static_cast<uint32_t>(slotSize);
+        header->notify.store(0);
+        header->waiters.store(0);
+        header->head.store(0);
+        header->magic.store(MAGIC, std::memory_order_release);
+    }
+
+    void attach(int fd, const std::string &name)
+    {
+        // Wait for the creator to size and initialize the segment
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds{int64_t{ATTACH_TIMEOUT}};
+        struct stat status;
+        while (fstat(fd, &status) == 0 &&
+               static_cast<std::size_t>(status.st_size) < sizeof(Header))
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                close(fd);
+                errno = ETIMEDOUT;
+                fail("attach " + name);
+            }
+            std::this_thread::yield();
+        }
+        map(fd, name, static_cast<std::size_t>(status.st_size));
+        close(fd);
+        while (m_header->magic.load(std::memory_order_acquire) != MAGIC)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                errno = ETIMEDOUT;
+                fail("attach " + name);
+            }
+            std::this_thread::yield();
+        }
+        if (m_size < segmentSize(m_header->slotCount, m_header->slotSize) ||
+            (m_header->slotCount & (m_header->slotCount - 1)) != 0)
+        {
+            errno = EINVAL;
+            fail("attach " + name);
+        }
+    }
+
+    //!
+    //! \brief Mark a ticket as dropped and wake the readers waiting for it.
+    //!
+    void drop(Slot &slot, uint64_t ticket)
+    {
+        auto dropped = slot.dropped.load(std::memory_order_relaxed);
+        while (dropped < ticket + 1 &&
+               !slot.dropped.compare_exchange_weak(dropped, ticket + 1,
+                                                   std::memory_order_release))
+        {
+        }
+        signal();
+    }
+
+    //!
+    //! \brief Check whether a ticket not written in its slot is never to be.
+    //!
+    //! Marks of later tickets count too: the ticket may only be written after
+    //! them if its publisher is lagging a whole ring behind, and then it would
+    //! be overrun soon anyway.
+    //!
+    static bool isDropped(const Slot &slot, uint64_t ticket)
+    {
+        return slot.dropped.load(std::memory_order_acquire) > ticket;
+    }
+
+    //!
+    //! \brief Notify the readers of a change in a slot.
+    //!
+    void signal()
+    {
+        // Paired with the registration of sleeping readers in wait()
+        m_header->notify.fetch_add(1);
+        if (m_header->waiters.load() > 0)
+        {
+            wake();
+        }
+    }
+
+    Slot &slot(uint64_t ticket) const
+    {
+        auto index = ticket & (m_header->slotCount - 1);
+        auto base = static_cast<unsigned char *>(m_memory) + sizeof(Header);
+        return *reinterpret_cast<Slot *>(base +
+                                         index * stride(m_header->slotSize));
+    }
+
+    static unsigned char *data(const Slot &slot)
+    {
+        return reinterpret_cast<unsigned char *>(const_cast<Slot *>(&slot) + 1);
+    }
+
+    uint32_t *futexWord() const
+    {
+        return reinterpret_cast<uint32_t *>(&m_header->notify);
+    }
+};
+
+} // detail
+
+//! \brief Implementation.
+struct ShmTransport::Impl
+{
+    //! Maximum time a receiver sleeps without checking whether it is stopped
+    //! (milliseconds)
+    static const unsigned int RECEIVER_WAIT{1000};
+
+    //! \brief Receiver thread of a channel.
+    struct Receiver
+    {
+        //! Channel
+        std::string channel;
+        //! Ring of the channel
+        std::shared_ptr<detail::ShmRing> ring;
+        //! Whether the receiver should keep running
+        std::atomic<bool> running;
+        //! Receiver thread
+        std::thread thread;
+    };
+
+    Impl(ShmTransport *obj, const std::string &name, std::size_t slotCount,
+         std::size_t slotSize)
+    : m_obj{obj}
+    , m_prefix{"/" + escape(name) + "."}
+    , m_slotCount{roundUpPowerOfTwo(slotCount)}
+    , m_slotSize{slotSize}
+    , m_started{false}
+    , m_mutex()
+    , m_ringMutex()
+    , m_rings()
+    , m_receivers()
+    , m_retired()
+    , m_droppedCount{0}
+    , m_lostCount{0}
+    {
+    }
+
+    ~Impl()
+    {
+        stop();
+    }
+
+    void publish(const std::vector<unsigned char> &message,
+                 const std::string &channel)
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        if (!ring(channel)->write(ByteSpan(message)))
+        {
+            m_droppedCount++;
+        }
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_started)
+        {
+            m_started = true;
+            for (const auto &channel : m_obj->getChannelsInUse()) {
+                startReceiver(channel);
+            }
+        }
+    }
+
+    void stop()
+    {
+        std::vector<std::unique_ptr<Receiver>> receivers;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_started)
+            {
+                return;
+            }
+            m_started = false;
+            receivers.swap(m_retired);
+            for (auto &entry : m_receivers) {
+                receivers.push_back(std::move(entry.second));
+            }
+            m_receivers.clear();
+        }
+        for (auto &receiver : receivers) {
+            stopReceiver(*receiver);
+            receiver->thread.join();
+        }
+    }
+
+    void useChannel(const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_started)
+        {
+            startReceiver(channel);
+        }
+    }
+
+    void dropChannel(const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_receivers.find(channel);
+        if (it != m_receivers.end())
+        {
+            // The receiver may be dropping its own channel from a handler, so
+            // it is joined when the transport stops
+            stopReceiver(*it->second);
+            m_retired.push_back(std::move(it->second));
+            m_receivers.erase(it);
+        }
+    }
+
+    //!
+    //! \brief Get the ring of a channel, opening it if necessary.
+    //!
+    std::shared_ptr<detail::ShmRing> ring(const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        auto &ring = m_rings[channel];
+        if (!ring)
+        {
+            ring = std::make_shared<detail::ShmRing>(
+                m_prefix + escape(channel), m_slotCount, m_slotSize);
+        }
+        return ring;
+    }
+
+    //!
+    //! \brief Start receiving from a channel.
+    //!
+    //! Must be called with the mutex locked.
+    //!
+    void startReceiver(const std::string &channel)
+    {
+        if (TopicTrie::isFilter(channel) || m_receivers.count(channel) > 0)
+        {
+            return;
+        }
+        std::unique_ptr<Receiver> receiver(new Receiver());
+        receiver->channel = channel;
+        receiver->ring = ring(channel);
+        receiver->running = true;
+        auto current = receiver.get();
+        receiver->thread = std::thread([this, current]
+                                       {
+                                           runReceiver(*current);
+                                       });
+        m_receivers[channel] = std::move(receiver);
+    }
+
+    void stopReceiver(Receiver &receiver)
+    {
+        receiver.running = false;
+        receiver.ring->wake();
+    }
+
+    void runReceiver(Receiver &receiver)
+    {
+        auto &ring = *receiver.ring;
+        std::vector<unsigned char> buffer(ring.slotSize());
+        // Only messages published from now on are received
+        auto ticket = ring.head();
+        while (receiver.running)
+        {
+            std::size_t size{0};
+            switch (ring.read(ticket, buffer.data(), size))
+            {
+            case detail::ShmRing::ReadResult::READY:
+                m_obj->callHandlers(ByteSpan(buffer.data(), size),
+                                    receiver.channel);
+                ticket++;
+                break;
+            case detail::ShmRing::ReadResult::OVERRUN:
+            {
+                // Skip to the oldest message that may still be available
+                auto head = ring.head();
+                auto oldest =
+                    head > ring.slotCount() ? head - ring.slotCount() + 1 : 0;
+                auto next = std::max(ticket + 1, oldest);
+                m_lostCount += next - ticket;
+                ticket = next;
+                break;
+            }
+            case detail::ShmRing::ReadResult::DROPPED:
+                // Already counted by its publisher
+                ticket++;
+                break;
+            case detail::ShmRing::ReadResult::EMPTY:
+                ring.wait(ticket,
+                          std::chrono::milliseconds{int64_t{RECEIVER_WAIT}});
+                break;
+            }
+        }
+    }
+
+    //!
+    //! \brief Escape a name for use in a shared memory segment name.
+    //!
+    static std::string escape(const std::string &name)
+    {
+        static const char *const HEX = "0123456789ABCDEF";
+        std::string escaped;
+        for (auto c : name) {
+            if (c == '/' || c == '%')
+            {
+                escaped += '%';
+                escaped += HEX[(c >> 4) & 0xf];
+                escaped += HEX[c & 0xf];
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    static std::size_t roundUpPowerOfTwo(std::size_t value)
+    {
+        std::size_t result{1};
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    ShmTransport *const m_obj;
+    const std::string m_prefix;
+    const std::size_t m_slotCount;
+    const std::size_t m_slotSize;
+    std::atomic<bool> m_started;
+    //! Guards the receivers
+    std::mutex m_mutex;
+    //! Guards the rings
+    std::mutex m_ringMutex;
+    std::map<std::string, std::shared_ptr<detail::ShmRing>> m_rings;
+    std::map<std::string, std::unique_ptr<Receiver>> m_receivers;
+    //! Stopped receivers waiting to be joined
+    std::vector<std::unique_ptr<Receiver>> m_retired;
+    std::atomic<uint64_t> m_droppedCount;
+    std::atomic<uint64_t> m_lostCount;
+};
+
+inline ShmTransport::ShmTransport(const std::string &name,
+                                  std::size_t slotCount, std::size_t slotSize)
+: AbstractTransport<ShmTransport::Channel>()
+, m_impl(std::make_shared<ShmTransport::Impl>(this, name, slotCount,
+                                              slotSize))
+{
+}
+
+inline ShmTransport::~ShmTransport()
+{
+    // Copies share the implementation, which calls the handlers of this
+    // transport; they must not be called once it is being destroyed
+    if (m_impl->m_obj == this)
+    {
+        m_impl->stop();
+    }
+}
+
+inline void ShmTransport::publish(const std::vector<unsigned char> &message,
+                                  const ShmTransport::Channel &channel)
+{
+    m_impl->publish(message, channel);
+}
+
+inline void ShmTransport::start()
+{
+    m_impl->start();
+}
+
+inline void ShmTransport::stop()
+{
+    m_impl->stop();
+}
+
+inline uint64_t ShmTransport::getDroppedCount() const
+{
+    return m_impl->m_droppedCount;
+}
+
+inline uint64_t ShmTransport::getLostCount() const
+{
+    return m_impl->m_lostCount;
+}
+
+inline void ShmTransport::useChannel(const ShmTransport::Channel &channel)
+{
+    m_impl->useChannel(channel);
+}
+
+inline void ShmTransport::dropChannel(const ShmTransport::Channel &channel)
+{
+    m_impl->dropChannel(channel);
+}
+
+} // bsf
+
+#endif
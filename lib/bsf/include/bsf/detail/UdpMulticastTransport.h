@@ -0,0 +1,590 @@
+
+#ifndef BSF_UDPMULTICASTTRANSPORT_DETAIL_H
+#define BSF_UDPMULTICASTTRANSPORT_DETAIL_H
+
+#include "../UdpMulticastTransport.h"
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+namespace bsf
+{
+
+//!
+//! \brief Implementation.
+//!
+//! Datagrams start with a header (magic number, version, number of records,
+//! sender identifier, channel length and channel) followed by the records
+//! (sequence number, message length and message), newest first. Integers are
+//! big-endian.
+//!
+struct UdpMulticastTransport::Impl
+{
+    //! Protocol magic number
+    static const uint16_t MAGIC{0x424d};
+    //! Protocol version
+    static const uint8_t VERSION{1};
+    //! Size of the datagram header without the channel
+    static const std::size_t HEADER_SIZE{10};
+    //! Size of the record header
+    static const std::size_t RECORD_HEADER_SIZE{6};
+    //! Maximum size of a UDP datagram over IPv4
+    static const std::size_t MAX_DATAGRAM_SIZE{65507};
+    //! Maximum size of a datagram carrying redundant records, which fits in an
+    //! Ethernet frame
+    static const std::size_t REDUNDANT_DATAGRAM_SIZE{1472};
+    //! Maximum redundancy depth
+    static const unsigned int MAX_REDUNDANCY{254};
+
+    //! \brief Publication state of a channel.
+    struct SendState
+    {
+        //! Destination of the channel datagrams
+        asio::ip::udp::endpoint endpoint;
+        //! Sequence number of the last message
+        uint32_t sequence;
+        //! Redundancy depth
+        unsigned int depth;
+        //! Last messages, newest first
+        std::deque<std::vector<unsigned char>> history;
+    };
+
+    //! \brief Reception state of a sender and channel.
+    struct ReceiveState
+    {
+        //! Sequence number of the last message delivered
+        uint32_t sequence;
+        //! Messages before it counted as lost, bit i standing for sequence
+        //! number sequence - 1 - i
+        uint64_t missing;
+    };
+
+    //! \brief Record of a received datagram.
+    struct Record
+    {
+        //! Sequence number
+        uint32_t sequence;
+        //! Message
+        ByteSpan message;
+    };
+
+    Impl(UdpMulticastTransport *obj, const std::string &group,
+         unsigned int groupCount, unsigned short port,
+         const std::string &localInterface)
+    : m_obj{obj}
+    , m_group(asio::ip::address_v4::from_string(group))
+    , m_groupCount{groupCount > 0 ? groupCount : 1}
+    , m_port{port}
+    , m_interface(localInterface.empty()
+                      ? asio::ip::address_v4::any()
+                      : asio::ip::address_v4::from_string(localInterface))
+    , m_senderId{static_cast<uint32_t>(std::random_device()())}
+    , m_asio()
+    , m_work()
+    , m_thread()
+    , m_receiveSocket(m_asio)
+    , m_sendSocket(m_asio)
+    , m_started{false}
+    , m_sendMutex()
+    , m_sendStates()
+    , m_datagram()
+    , m_receiveBuffer(MAX_DATAGRAM_SIZE)
+    , m_sender()
+    , m_channel()
+    , m_records()
+    , m_joinedChannels()
+    , m_groupUsers()
+    , m_receiveStates()
+    , m_droppedCount{0}
+    , m_lostCount{0}
+    , m_reorderedCount{0}
+    {
+    }
+
+    ~Impl()
+    {
+        stop();
+    }
+
+    void publish(const std::vector<unsigned char> &message,
+                 const std::string &channel)
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        auto &state = sendState(channel);
+        auto size = HEADER_SIZE + channel.size() + RECORD_HEADER_SIZE +
+                    message.size();
+        if (size > MAX_DATAGRAM_SIZE)
+        {
+            m_droppedCount++;
+            return;
+        }
+        state.sequence++;
+
+        // Header and new message
+        m_datagram.clear();
+        writeInteger<uint16_t>(MAGIC);
+        writeInteger<uint8_t>(VERSION);
+        writeInteger<uint8_t>(1);
+        writeInteger<uint32_t>(m_senderId);
+        writeInteger<uint16_t>(static_cast<uint16_t>(channel.size()));
+        m_datagram.insert(m_datagram.end(), channel.begin(), channel.end());
+        writeRecord(state.sequence, message);
+
+        // Previous messages, as long as they fit
+        uint8_t count{1};
+        for (const auto &previous : state.history) {
+            if (m_datagram.size() + RECORD_HEADER_SIZE + previous.size() >
+                REDUNDANT_DATAGRAM_SIZE)
+            {
+                break;
+            }
+            writeRecord(state.sequence - count, previous);
+            count++;
+        }
+        m_datagram[3] = count;
+
+        asio::error_code error;
+        m_sendSocket.send_to(asio::buffer(m_datagram), state.endpoint, 0,
+                             error);
+        if (error)
+        {
+            m_droppedCount++;
+        }
+
+        // Recycle the storage of the oldest message
+        if (state.depth > 0)
+        {
+            std::vector<unsigned char> storage;
+            if (state.history.size() >= state.depth)
+            {
+                storage.swap(state.history.back());
+                state.history.pop_back();
+            }
+            storage.assign(message.begin(), message.end());
+            state.history.push_front(std::move(storage));
+        }
+    }
+
+    void start()
+    {
+        if (m_started)
+        {
+            return;
+        }
+        try
+        {
+            m_receiveSocket.open(asio::ip::udp::v4());
+            m_receiveSocket.set_option(
+                asio::ip::udp::socket::reuse_address(true));
+            m_receiveSocket.bind(
+                asio::ip::udp::endpoint(asio::ip::address_v4::any(), m_port));
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            m_sendSocket.open(asio::ip::udp::v4());
+            m_sendSocket.set_option(
+                asio::ip::multicast::outbound_interface(m_interface));
+            m_sendSocket.set_option(asio::ip::multicast::enable_loopback(true));
+        }
+        catch (...)
+        {
+            asio::error_code error;
+            m_receiveSocket.close(error);
+            m_sendSocket.close(error);
+            throw;
+        }
+        // Channels added from now on are joined from the service
+        m_started = true;
+        for (const auto &channel : m_obj->getChannelsInUse()) {
+            joinChannel(channel);
+        }
+        receive();
+        m_asio.reset();
+        m_work.reset(new asio::io_service::work(m_asio));
+        m_thread = std::thread([this]
+                               {
+                                   m_asio.run();
+                               });
+    }
+
+    void stop()
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        m_started = false;
+        m_asio.post([this]
+                    {
+                        m_receiveSocket.close();
+                        m_joinedChannels.clear();
+                        m_groupUsers.clear();
+                    });
+        m_work.reset();
+        m_thread.join();
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_sendSocket.close();
+    }
+
+    void useChannel(const std::string &channel)
+    {
+        if (m_started)
+        {
+            m_asio.post([this, channel]
+                        {
+                            joinChannel(channel);
+                        });
+        }
+    }
+
+    void dropChannel(const std::string &channel)
+    {
+        if (m_started)
+        {
+            m_asio.post([this, channel]
+                        {
+                            leaveChannel(channel);
+                        });
+        }
+    }
+
+    void setRedundancy(const std::string &channel, unsigned int depth)
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        auto &state = sendState(channel);
+        state.depth = depth < MAX_REDUNDANCY ? depth : MAX_REDUNDANCY;
+        while (state.history.size() > state.depth)
+        {
+            state.history.pop_back();
+        }
+    }
+
+    //!
+    //! \brief Get the publication state of a channel, creating it if needed.
+    //!
+    //! Must be called with the send mutex locked.
+    //!
+    SendState &sendState(const std::string &channel)
+    {
+        auto it = m_sendStates.find(channel);
+        if (it == m_sendStates.end())
+        {
+            SendState state;
+            state.endpoint = asio::ip::udp::endpoint(group(channel), m_port);
+            state.sequence = 0;
+            state.depth = 0;
+            it = m_sendStates.emplace(channel, std::move(state)).first;
+        }
+        return it->second;
+    }
+
+    //! \return The multicast group of a channel
+    asio::ip::address_v4 group(const std::string &channel) const
+    {
+        return asio::ip::address_v4(
+            static_cast<unsigned long>(m_group.to_ulong() +
+                                       channelHash(channel) % m_groupCount));
+    }
+
+    template <typename IntegerT>
+    void writeInteger(IntegerT value)
+    {
+        for (auto shift = 8 * static_cast<int>(sizeof(IntegerT)) - 8;
+             shift >= 0; shift -= 8) {
+            m_datagram.push_back(static_cast<unsigned char>(value >> shift));
+        }
+    }
+
+    template <typename IntegerT>
+    static IntegerT readInteger(const unsigned char *data)
+    {
+        IntegerT value{0};
+        for (std::size_t i = 0; i < sizeof(IntegerT); i++) {
+            value = static_cast<IntegerT>((value << 8) | data[i]);
+        }
+        return value;
+    }
+
+    void writeRecord(uint32_t sequence,
+                     const std::vector<unsigned char> &message)
+    {
+        writeInteger<uint32_t>(sequence);
+        writeInteger<uint16_t>(static_cast<uint16_t>(message.size()));
+        m_datagram.insert(m_datagram.end(), message.begin(), message.end());
+    }
+
+    //!
+    //! \brief Join the group of a channel, if not joined yet.
+    //!
+    //! Must be called from the service, or before it runs.
+    //!
+    void joinChannel(const std::string &channel)
+    {
+        if (TopicTrie::isFilter(channel) ||
+            !m_joinedChannels.insert(channel).second)
+        {
+            return;
+        }
+        auto address = group(channel);
+        if (m_groupUsers[address.to_ulong()]++ == 0)
+        {
+            asio::error_code error;
+            m_receiveSocket.set_option(
+                asio::ip::multicast::join_group(address, m_interface), error);
+        }
+    }
+
+    //!
+    //! \brief Leave the group of a channel, unless used by other channels.
+    //!
+    //! Must be called from the service.
+    //!
+    void leaveChannel(const std::string &channel)
+    {
+        if (m_joinedChannels.erase(channel) == 0)
+        {
+            return;
+        }
+        auto address = group(channel);
+        if (--m_groupUsers[address.to_ulong()] == 0)
+        {
+            m_groupUsers.erase(address.to_ulong());
+            asio::error_code error;
+            m_receiveSocket.set_option(
+                asio::ip::multicast::leave_group(address, m_interface), error);
+        }
+    }
+
+    void receive()
+    {
+        m_receiveSocket.async_receive_from(
+            asio::buffer(m_receiveBuffer), m_sender,
+            [this](const asio::error_code &error, std::size_t size)
+            {
+                if (error == asio::error::operation_aborted)
+                {
+                    return;
+                }
+                if (!error)
+                {
+                    process(size);
+                }
+                if (m_receiveSocket.is_open())
+                {
+                    receive();
+                }
+            });
+    }
+
+    //!
+    //! \brief Deliver the new messages of a received datagram.
+    //!
+    //! \param size Size of the datagram
+    //!
+    void process(std::size_t size)
+    {
+        const auto data = m_receiveBuffer.data();
+        if (size < HEADER_SIZE || readInteger<uint16_t>(data) != MAGIC ||
+            data[2] != VERSION || data[3] == 0)
+        {
+            return;
+        }
+        auto count = data[3];
+        auto sender = readInteger<uint32_t>(data + 4);
+        std::size_t channelSize = readInteger<uint16_t>(data + 8);
+        if (HEADER_SIZE + channelSize > size)
+        {
+            return;
+        }
+        m_channel.assign(reinterpret_cast<const char *>(data + HEADER_SIZE),
+                         channelSize);
+        if (m_joinedChannels.count(m_channel) == 0)
+        {
+            return;
+        }
+
+        m_records.clear();
+        auto offset = HEADER_SIZE + channelSize;
+        for (auto i = 0; i < count; i++) {
+            if (offset + RECORD_HEADER_SIZE > size)
+            {
+                return;
+            }
+            auto sequence = readInteger<uint32_t>(data + offset);
+            std::size_t messageSize = readInteger<uint16_t>(data + offset + 4);
+            offset += RECORD_HEADER_SIZE;
+            if (offset + messageSize > size)
+            {
+                return;
+            }
+            m_records.push_back({sequence, ByteSpan(data + offset, messageSize)});
+            offset += messageSize;
+        }
+
+        auto &channels = m_receiveStates[sender];
+        auto it = channels.find(m_channel);
+        if (it == channels.end())
+        {
+            // Previous messages of a new sender are not delivered
+            it = channels
+                     .emplace(m_channel,
+                              ReceiveState{m_records.front().sequence - 1, 0})
+                     .first;
+        }
+        auto &state = it->second;
+        // Oldest first
+        for (auto record = m_records.rbegin(); record != m_records.rend();
+             ++record) {
+            auto gap = static_cast<int32_t>(record->sequence - state.sequence);
+            if (gap <= 0)
+            {
+                arrivedLate(state, static_cast<uint32_t>(-gap));
+                continue;
+            }
+            auto skipped = static_cast<uint32_t>(gap - 1);
+            m_lostCount += skipped;
+            state.missing = gap < 64 ? state.missing << gap : 0;
+            state.missing |= skipped < 64 ? (uint64_t{1} << skipped) - 1
+                                          : ~uint64_t{0};
+            state.sequence = record->sequence;
+            m_obj->callHandlers(record->message, m_channel);
+        }
+    }
+
+    //!
+    //! \brief Account for a message older than the last one delivered.
+    //!
+    //! A message counted as lost when it was skipped is counted as reordered
+    //! instead, so that every message is counted once; others are duplicates.
+    //!
+    //! \param state Reception state of the sender and channel
+    //! \param age Distance to the last message delivered
+    //!
+    void arrivedLate(ReceiveState &state, uint32_t age)
+    {
+        if (age == 0 || age > 64)
+        {
+            return;
+        }
+        auto bit = uint64_t{1} << (age - 1);
+        if ((state.missing & bit) != 0)
+        {
+            state.missing &= ~bit;
+            m_lostCount--;
+            m_reorderedCount++;
+        }
+    }
+
+    UdpMulticastTransport *const m_obj;
+    const asio::ip::address_v4 m_group;
+    const unsigned int m_groupCount;
+    const unsigned short m_port;
+    const asio::ip::address_v4 m_interface;
+    //! Random identifier of this sender
+    const uint32_t m_senderId;
+    asio::io_service m_asio;
+    std::unique_ptr<asio::io_service::work> m_work;
+    std::thread m_thread;
+    asio::ip::udp::socket m_receiveSocket;
+    asio::ip::udp::socket m_sendSocket;
+    std::atomic<bool> m_started;
+    //! Guards the send socket and the publication state
+    std::mutex m_sendMutex;
+    std::map<std::string, SendState> m_sendStates;
+    //! Datagram being sent, reused between publications
+    std::vector<unsigned char> m_datagram;
+    //! Reception state, only accessed from the service
+    std::vector<unsigned char> m_receiveBuffer;
+    asio::ip::udp::endpoint m_sender;
+    std::string m_channel;
+    std::vector<Record> m_records;
+    std::set<std::string> m_joinedChannels;
+    std::map<unsigned long, unsigned int> m_groupUsers;
+    std::map<uint32_t, std::map<std::string, ReceiveState>> m_receiveStates;
+    std::atomic<uint64_t> m_droppedCount;
+    std::atomic<uint64_t> m_lostCount;
+    std::atomic<uint64_t> m_reorderedCount;
+};
+
+inline UdpMulticastTransport::UdpMulticastTransport(
+    const std::string &group, unsigned int groupCount, unsigned short port,
+    const std::string &localInterface)
+: AbstractTransport<UdpMulticastTransport::Channel>()
+, m_impl(std::make_shared<UdpMulticastTransport::Impl>(
+      this, group, groupCount, port, localInterface))
+{
+}
+
+inline UdpMulticastTransport::~UdpMulticastTransport()
+{
+    // Copies share the implementation, which calls the handlers of this
+    // transport; they must not be called once it is being destroyed
+    if (m_impl->m_obj == this)
+    {
+        m_impl->stop();
+    }
+}
+
+inline void UdpMulticastTransport::publish(
+    const std::vector<unsigned char> &message,
+    const UdpMulticastTransport::Channel &channel)
+{
+    m_impl->publish(message, channel);
+}
+
+inline void UdpMulticastTransport::start()
+{
+    m_impl->start();
+}
+
+inline void UdpMulticastTransport::stop()
+{
+    m_impl->stop();
+}
+
+inline void UdpMulticastTransport::setRedundancy(
+    const UdpMulticastTransport::Channel &channel, unsigned int depth)
+{
+    m_impl->setRedundancy(channel, depth);
+}
+
+inline uint64_t UdpMulticastTransport::getDroppedCount() const
+{
+    return m_impl->m_droppedCount;
+}
+
+inline uint64_t UdpMulticastTransport::getLostCount() const
+{
+    return m_impl->m_lostCount;
+}
+
+inline uint64_t UdpMulticastTransport::getReorderedCount() const
+{
+    return m_impl->m_reorderedCount;
+}
+
+inline void UdpMulticastTransport::useChannel(
+    const UdpMulticastTransport::Channel &channel)
+{
+    m_impl->useChannel(channel);
+}
+
+inline void UdpMulticastTransport::dropChannel(
+    const UdpMulticastTransport::Channel &channel)
+{
+    m_impl->dropChannel(channel);
+}
+
+} // bsf
+
+#endif
@@ -0,0 +1,220 @@
+
+#ifndef ALSASEQMIDIOUTPUT_H
+#define ALSASEQMIDIOUTPUT_H
+
+#include <MidiEndpointCommon.h>
+#include <MidiOutput.h>
+
+#include <alsa/asoundlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief MIDI output through an ALSA sequencer queue.
+//!
+//! Messages are sent well ahead of their time, each one scheduled at its
+//! absolute real time on an ALSA sequencer queue, and the kernel dispatches
+//! them when they are due. The playout timing therefore does not depend on
+//! when the sending process is scheduled.
+//!
+//! Only one thread may send messages at any time.
+//!
+class AlsaSeqMidiOutput : public MidiOutput
+{
+public:
+    //! How long before their time messages are sent
+    static const int64_t LOOKAHEAD_MS{1000};
+
+    AlsaSeqMidiOutput(const AlsaSeqMidiOutput &) = delete;
+    AlsaSeqMidiOutput &operator=(const AlsaSeqMidiOutput &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param clientName ALSA sequencer client name
+    //!
+    explicit AlsaSeqMidiOutput(const std::string &clientName)
+    : m_clientName{clientName}
+    , m_seq{nullptr}
+    , m_port{-1}
+    , m_queue{-1}
+    , m_queueStatus{nullptr}
+    , m_droppedCount{0}
+    {
+    }
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~AlsaSeqMidiOutput()
+    {
+        close();
+    }
+
+    //!
+    //! \brief Open a sequencer client with an output port and a queue.
+    //!
+    //! \param portName Name of the port
+    //!
+    virtual void open(const std::string &portName)
+    {
+        if (m_seq != nullptr)
+        {
+            return;
+        }
+
+        if (snd_seq_open(&m_seq, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0)
+        {
+            m_seq = nullptr;
+            throw MidiEndpointException("Could not open the ALSA sequencer");
+        }
+        snd_seq_set_client_name(m_seq, m_clientName.c_str());
+        m_port = snd_seq_create_simple_port(
+            m_seq, portName.c_str(),
+            SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+            SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        m_queue = snd_seq_alloc_named_queue(m_seq, m_clientName.c_str());
+        if (m_port < 0 || m_queue < 0 ||
+            snd_seq_queue_status_malloc(&m_queueStatus) < 0)
+        {
+            close();
+            throw MidiEndpointException("Could not create ALSA sequencer port");
+        }
+        snd_seq_start_queue(m_seq, m_queue, nullptr);
+        snd_seq_drain_output(m_seq);
+    }
+
+    //!
+    //! \brief Close the sequencer client.
+    //!
+    //! Messages not played yet are discarded.
+    //!
+    virtual void close()
+    {
+        if (m_seq != nullptr)
+        {
+            if (m_queue >= 0)
+            {
+                snd_seq_stop_queue(m_seq, m_queue, nullptr);
+                snd_seq_drain_output(m_seq);
+                snd_seq_free_queue(m_seq, m_queue);
+            }
+            snd_seq_close(m_seq);
+            m_seq = nullptr;
+            m_port = -1;
+            m_queue = -1;
+        }
+        if (m_queueStatus != nullptr)
+        {
+            snd_seq_queue_status_free(m_queueStatus);
+            m_queueStatus = nullptr;
+        }
+    }
+
+    //!
+    //! \brief Send a batch of messages.
+    //!
+    //! The messages are scheduled on the queue at their time; messages due in
+    //! the past are played immediately.
+    //!
+    //! \param batch Messages to send
+    //! \param time Time at which the messages are due
+    //!
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point time)
+    {
+        using namespace std::chrono;
+
+        if (m_seq == nullptr)
+        {
+            return;
+        }
+
+        // Map the time to the queue clock, read every time to follow its drift
+        auto delayNs = duration_cast<nanoseconds>(time - Clock::now()).count();
+        if (delayNs < 0)
+        {
+            delayNs = 0;
+        }
+        auto queueNs = int64_t{0};
+        if (snd_seq_get_queue_status(m_seq, m_queue, m_queueStatus) == 0)
+        {
+            auto queueTime = snd_seq_queue_status_get_real_time(m_queueStatus);
+            queueNs = int64_t{queueTime->tv_sec} * 1000000000 +
+                      queueTime->tv_nsec;
+        }
+        queueNs += delayNs;
+        snd_seq_real_time_t eventTime;
+        eventTime.tv_sec = static_cast<unsigned int>(queueNs / 1000000000);
+        eventTime.tv_nsec = static_cast<unsigned int>(queueNs % 1000000000);
+
+        for (const auto &message : batch) {
+            snd_seq_event_t event;
+            snd_seq_ev_clear(&event);
+            snd_seq_ev_set_source(&event, m_port);
+            snd_seq_ev_set_subs(&event);
+            snd_seq_ev_schedule_real(&event, m_queue, 0, &eventTime);
+            auto channel = message.data[0] & 0x0F;
+            switch (message.data[0] & 0xF0)
+            {
+            case 0x90:
+                snd_seq_ev_set_noteon(&event, channel, message.data[1],
+                                      message.data[2]);
+                break;
+            case 0x80:
+                snd_seq_ev_set_noteoff(&event, channel, message.data[1],
+                                       message.data[2]);
+                break;
+            case 0xC0:
+                snd_seq_ev_set_pgmchange(&event, channel, message.data[1]);
+                break;
+            default:
+                continue;
+            }
+            if (snd_seq_event_output(m_seq, &event) < 0)
+            {
+                m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        snd_seq_drain_output(m_seq);
+    }
+
+    //! \return How long before their time messages should be sent
+    virtual Clock::duration lookahead() const
+    {
+        return std::chrono::milliseconds{int64_t{LOOKAHEAD_MS}};
+    }
+
+    //!
+    //! \brief Get the number of messages dropped because the sequencer
+    //!        output buffer was full.
+    //!
+    //! \return Number of dropped messages since construction
+    //!
+    unsigned long long getDroppedCount() const
+    {
+        return m_droppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    //! ALSA sequencer client name
+    std::string m_clientName;
+    //! ALSA sequencer handle
+    snd_seq_t *m_seq;
+    //! Output port
+    int m_port;
+    //! Scheduling queue
+    int m_queue;
+    //! Reused queue status
+    snd_seq_queue_status_t *m_queueStatus;
+    //! Number of dropped messages
+    std::atomic<unsigned long long> m_droppedCount;
+};
+}
+
+#endif
@@ -0,0 +1,153 @@
+
+#ifndef CLOCKOFFSETESTIMATOR_H
+#define CLOCKOFFSETESTIMATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Estimates the offset between a remote clock and the local monotonic
+//!        clock.
+//!
+//! Each sample is an NTP-style exchange: the origin and arrival times are read
+//! from the local monotonic clock, and the receive and transmit times from the
+//! remote clock (microseconds since epoch). The offset of a sample is
+//! ((receive - origin) + (transmit - arrival)) / 2, and its error is bounded by
+//! half of its round trip time, so the estimate is taken from the sample with
+//! the smallest round trip among the most recent ones.
+//!
+//! Until the first sample arrives, the remote clock is assumed to match the
+//! local system clock.
+//!
+//! Samples must be added from one thread at a time, but remote times may be
+//! converted from any thread.
+//!
+class ClockOffsetEstimator
+{
+public:
+    //! Local monotonic clock
+    typedef std::chrono::steady_clock Clock;
+
+    //! Number of recent samples considered by the filter
+    static const std::size_t WINDOW{8};
+
+    //!
+    //! \brief Constructor.
+    //!
+    ClockOffsetEstimator()
+    : m_samples()
+    , m_sampleCount{0}
+    , m_offset{0}
+    , m_roundTrip{0}
+    , m_synchronized{false}
+    {
+    }
+
+    //!
+    //! \brief Add a synchronization sample.
+    //!
+    //! \param origin Request transmission time (local, microseconds)
+    //! \param receive Request reception time (remote, microseconds)
+    //! \param transmit Response transmission time (remote, microseconds)
+    //! \param arrival Response reception time (local, microseconds)
+    //!
+    void addSample(int64_t origin, int64_t receive, int64_t transmit,
+                   int64_t arrival)
+    {
+        auto roundTrip = (arrival - origin) - (transmit - receive);
+        if (roundTrip < 0)
+        {
+            return;
+        }
+        auto &sample = m_samples[m_sampleCount++ % WINDOW];
+        sample.offset = ((receive - origin) + (transmit - arrival)) / 2;
+        sample.roundTrip = roundTrip;
+
+        // Minimum round trip filter
+        auto count = m_sampleCount < WINDOW ? m_sampleCount : WINDOW;
+        auto best = &m_samples[0];
+        for (std::size_t i = 1; i < count; i++) {
+            if (m_samples[i].roundTrip < best->roundTrip)
+            {
+                best = &m_samples[i];
+            }
+        }
+        m_offset.store(best->offset, std::memory_order_relaxed);
+        m_roundTrip.store(best->roundTrip, std::memory_order_relaxed);
+        m_synchronized.store(true, std::memory_order_release);
+    }
+
+    //! \return Whether any sample has been added
+    bool synchronized() const
+    {
+        return m_synchronized.load(std::memory_order_acquire);
+    }
+
+    //! \return Estimated remote clock minus local clock (microseconds)
+    int64_t offset() const
+    {
+        return m_offset.load(std::memory_order_relaxed);
+    }
+
+    //! \return Round trip time of the estimate (microseconds)
+    int64_t roundTrip() const
+    {
+        return m_roundTrip.load(std::memory_order_relaxed);
+    }
+
+    //!
+    //! \brief Convert a remote time into the local monotonic timeline.
+    //!
+    //! \param remote Remote time in microseconds since epoch
+    //! \return Local monotonic time point
+    //!
+    Clock::time_point toLocal(int64_t remote) const
+    {
+        using namespace std::chrono;
+        if (synchronized())
+        {
+            return Clock::time_point{microseconds{remote - offset()}};
+        }
+        // Assume the remote clock matches the local system clock
+        auto systemNow = duration_cast<microseconds>(
+                             system_clock::now().time_since_epoch()).count();
+        return Clock::now() + microseconds{remote - systemNow};
+    }
+
+    //! \return Current local monotonic time in microseconds
+    static int64_t nowMicros()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(Clock::now().time_since_epoch())
+            .count();
+    }
+
+private:
+    //! \brief A synchronization sample.
+    struct Sample
+    {
+        //! Remote minus local clock (microseconds)
+        int64_t offset;
+        //! Round trip time (microseconds)
+        int64_t roundTrip;
+    };
+
+    //! Most recent samples
+    Sample m_samples[WINDOW];
+    //! Number of samples added
+    std::size_t m_sampleCount;
+    //! Current offset estimate
+    std::atomic<int64_t> m_offset;
+    //! Round trip time of the current estimate
+    std::atomic<int64_t> m_roundTrip;
+    //! Whether any sample has been added
+    std::atomic<bool> m_synchronized;
+};
+}
+
+#endif
@@ -0,0 +1,190 @@
+
+#ifndef CLOCKSYNCCLIENT_H
+#define CLOCKSYNCCLIENT_H
+
+#include <masmusic.pb.h>
+#include <ClockOffsetEstimator.h>
+#include <ClockSync.h>
+#include <MidiEndpointCommon.h>
+
+#include <asio.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Periodically synchronizes with the clock of a remote endpoint.
+//!
+//! Sends a clock synchronization request through a BSF channel at a fixed
+//! interval and feeds every matching response into a ClockOffsetEstimator.
+//! Requests and responses share the channel; only responses to the last sent
+//! request are taken into account.
+//!
+//! The offsets to the clocks of different responders cannot be mixed in one
+//! estimator, so the client follows the first responder that answers and
+//! ignores the responses of any other one on the channel.
+//!
+//! \tparam TransportT BSF transport type
+//!
+template <typename TransportT>
+class ClockSyncClient : private ClockSyncSensorClient<TransportT>
+{
+public:
+    //! BSF transport type
+    typedef TransportT Transport;
+
+    //! Interval between synchronization requests (milliseconds)
+    static const unsigned int SYNC_INTERVAL{1000};
+
+    using ClockSyncSensorClient<TransportT>::getChannel;
+
+    //!
+    //! \brief Get the number of responses ignored because they came from
+    //!        another responder than the followed one.
+    //!
+    //! \return Number of ignored responses since construction
+    //!
+    unsigned long long getIgnoredCount() const
+    {
+        return m_ignoredCount.load(std::memory_order_relaxed);
+    }
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param transport BSF transport
+    //! \param channel BSF transport channel for clock synchronization
+    //! \param asio ASIO service running the request timer
+    //! \param estimator Estimator fed with the received responses
+    //!
+    ClockSyncClient(const Transport &transport,
+                    const typename Transport::Channel &channel,
+                    asio::io_service &asio, ClockOffsetEstimator &estimator)
+    : ClockSyncSensorClient<TransportT>(transport, channel)
+    , m_sensor(transport, channel)
+    , m_request{m_sensor.newDataReading()}
+    , m_asio(asio)
+    , m_strand(asio)
+    , m_timer(asio)
+    , m_estimator(estimator)
+    , m_lastOrigin{0}
+    , m_responder{0}
+    , m_hasResponder{false}
+    , m_ignoredCount{0}
+    , m_running{false}
+    {
+    }
+
+    //!
+    //! \brief Start sending requests.
+    //!
+    void start()
+    {
+        m_running = true;
+        m_strand.post([this]
+                      {
+                          sendRequest();
+                      });
+    }
+
+    //!
+    //! \brief Stop sending requests.
+    //!
+    //! The request timer is cancelled asynchronously from the ASIO service.
+    //!
+    void stop()
+    {
+        m_running = false;
+        m_strand.post([this]
+                      {
+                          m_timer.cancel();
+                      });
+    }
+
+private:
+    //! Sensor for the requests
+    ClockSyncSensor<TransportT> m_sensor;
+    //! Reused request reading object
+    ClockSyncReading m_request;
+    //! ASIO service
+    asio::io_service &m_asio;
+    //! ASIO strand owning the request and the timer
+    asio::io_service::strand m_strand;
+    //! Request timer
+    asio::steady_timer m_timer;
+    //! Estimator fed with the responses
+    ClockOffsetEstimator &m_estimator;
+    //! Origin time of the last sent request
+    std::atomic<int64_t> m_lastOrigin;
+    //! Identifier of the followed responder
+    uint64_t m_responder;
+    //! Whether a responder is being followed
+    bool m_hasResponder;
+    //! Number of responses ignored because of their responder
+    std::atomic<unsigned long long> m_ignoredCount;
+    //! Whether requests are being sent
+    std::atomic<bool> m_running;
+
+    //!
+    //! \brief Send a request and schedule the next one.
+    //!
+    void sendRequest()
+    {
+        if (!m_running)
+        {
+            return;
+        }
+        auto origin = ClockOffsetEstimator::nowMicros();
+        m_lastOrigin = origin;
+        m_request->set_origin(origin);
+        m_sensor.publish(m_request);
+
+        m_timer.expires_from_now(
+            std::chrono::milliseconds{int64_t{SYNC_INTERVAL}});
+        m_timer.async_wait(
+            m_strand.wrap([this](const asio::error_code &error)
+                          {
+                              if (error != asio::error::operation_aborted)
+                              {
+                                  sendRequest();
+                              }
+                          }));
+    }
+
+    //!
+    //! \brief Process a received response.
+    //!
+    //! \param reading Received reading
+    //! \return true
+    //!
+    virtual bool onDataReading(const ClockSyncReading &reading)
+    {
+        auto arrival = ClockOffsetEstimator::nowMicros();
+        // Requests (ours or others') are received through the same channel
+        if (reading->receive() == 0 || reading->origin() != m_lastOrigin)
+        {
+            return true;
+        }
+        if (!m_hasResponder)
+        {
+            m_responder = reading->responder();
+            m_hasResponder = true;
+        }
+        else if (reading->responder() != m_responder)
+        {
+            m_ignoredCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        m_estimator.addSample(reading->origin(), reading->receive(),
+                              reading->transmit(), arrival);
+        return true;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,296 @@
+
+#ifndef JACKMIDIOUTPUT_H
+#define JACKMIDIOUTPUT_H
+
+#include <MidiEndpointCommon.h>
+#include <MidiOutput.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Frame-accurate MIDI output through a native JACK port.
+//!
+//! Messages are sent ahead of their time into a lock-free ring buffer, which
+//! is consumed by the JACK process callback. Each message is written with
+//! jack_midi_event_write at the frame offset corresponding to its time within
+//! the cycle that contains it, so the playout timing does not depend on when
+//! the sending thread woke up.
+//!
+//! The process callback moves the messages sent into a preallocated list kept
+//! in time order, so messages may be sent in any order; a late message is not
+//! held back by messages sent before it for a later cycle. Only one thread may
+//! send messages at any time.
+//!
+class JackMidiOutput : public MidiOutput
+{
+public:
+    //! How long before their time messages are sent
+    static const int64_t LOOKAHEAD_MS{20};
+    //! Number of messages the ring buffer can hold
+    static const std::size_t BUFFER_CAPACITY{4096};
+
+    JackMidiOutput(const JackMidiOutput &) = delete;
+    JackMidiOutput &operator=(const JackMidiOutput &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param clientName JACK client name
+    //!
+    explicit JackMidiOutput(const std::string &clientName)
+    : m_clientName{clientName}
+    , m_client{nullptr}
+    , m_port{nullptr}
+    , m_buffer{nullptr}
+    , m_pending()
+    , m_droppedCount{0}
+    {
+        m_pending.reserve(BUFFER_CAPACITY);
+    }
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~JackMidiOutput()
+    {
+        close();
+    }
+
+    //!
+    //! \brief Open a JACK client with a MIDI output port.
+    //!
+    //! \param portName Name of the port
+    //!
+    virtual void open(const std::string &portName)
+    {
+        if (m_client != nullptr)
+        {
+            return;
+        }
+
+        jack_status_t status;
+        m_client = jack_client_open(m_clientName.c_str(), JackNoStartServer,
+                                    &status);
+        if (m_client == nullptr)
+        {
+            throw MidiEndpointException("Could not connect to the JACK server");
+        }
+        m_port = jack_port_register(m_client, portName.c_str(),
+                                    JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput,
+                                    0);
+        m_buffer =
+            jack_ringbuffer_create(BUFFER_CAPACITY * sizeof(TimedMidiMessage));
+        if (m_port == nullptr || m_buffer == nullptr)
+        {
+            close();
+            throw MidiEndpointException("Could not create JACK MIDI port");
+        }
+        jack_ringbuffer_mlock(m_buffer);
+
+        jack_set_process_callback(m_client, &JackMidiOutput::processCallback,
+                                  this);
+        if (jack_activate(m_client) != 0)
+        {
+            close();
+            throw MidiEndpointException("Could not activate JACK client");
+        }
+    }
+
+    //!
+    //! \brief Close the JACK client.
+    //!
+    //! Messages not played yet are discarded.
+    //!
+    virtual void close()
+    {
+        if (m_client != nullptr)
+        {
+            jack_deactivate(m_client);
+            jack_client_close(m_client);
+            m_client = nullptr;
+            m_port = nullptr;
+        }
+        if (m_buffer != nullptr)
+        {
+            jack_ringbuffer_free(m_buffer);
+            m_buffer = nullptr;
+        }
+        m_pending.clear();
+    }
+
+    //!
+    //! \brief Send a batch of messages.
+    //!
+    //! Messages that do not fit in the ring buffer are dropped.
+    //!
+    //! \param batch Messages to send
+    //! \param time Time at which the messages are due
+    //!
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point time)
+    {
+        using namespace std::chrono;
+
+        if (m_buffer == nullptr)
+        {
+            return;
+        }
+        TimedMidiMessage timed;
+        timed.timeUs =
+            duration_cast<microseconds>(time.time_since_epoch()).count();
+        for (const auto &message : batch) {
+            if (jack_ringbuffer_write_space(m_buffer) < sizeof(timed))
+            {
+                m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            timed.message = message;
+            jack_ringbuffer_write(m_buffer,
+                                  reinterpret_cast<const char *>(&timed),
+                                  sizeof(timed));
+        }
+    }
+
+    //! \return How long before their time messages should be sent
+    virtual Clock::duration lookahead() const
+    {
+        return std::chrono::milliseconds{int64_t{LOOKAHEAD_MS}};
+    }
+
+    //!
+    //! \brief Get the number of messages dropped because the ring buffer was
+    //!        full or the JACK buffer had no room for them.
+    //!
+    //! \return Number of dropped messages since construction
+    //!
+    unsigned long long getDroppedCount() const
+    {
+        return m_droppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    //! \brief A message with its playing time.
+    struct TimedMidiMessage
+    {
+        //! Time in microseconds since the clock epoch
+        int64_t timeUs;
+        //! Message
+        MidiMessage message;
+    };
+
+    //! JACK client name
+    std::string m_clientName;
+    //! JACK client
+    jack_client_t *m_client;
+    //! JACK MIDI output port
+    jack_port_t *m_port;
+    //! Messages sent
+    jack_ringbuffer_t *m_buffer;
+    //! Messages waiting to be played, latest first
+    std::vector<TimedMidiMessage> m_pending;
+    //! Number of dropped messages
+    std::atomic<unsigned long long> m_droppedCount;
+
+    static int processCallback(jack_nframes_t nframes, void *arg)
+    {
+        static_cast<JackMidiOutput *>(arg)->process(nframes);
+        return 0;
+    }
+
+    //!
+    //! \brief Write the messages due in the current cycle.
+    //!
+    //! Runs in the JACK real-time thread.
+    //!
+    //! \param nframes Number of frames in the cycle
+    //!
+    void process(jack_nframes_t nframes)
+    {
+        using namespace std::chrono;
+
+        auto portBuffer = jack_port_get_buffer(m_port, nframes);
+        jack_midi_clear_buffer(portBuffer);
+
+        jack_nframes_t cycleFrames;
+        jack_time_t cycleUs;
+        jack_time_t nextCycleUs;
+        float period;
+        if (jack_get_cycle_times(m_client, &cycleFrames, &cycleUs,
+                                 &nextCycleUs, &period) != 0 ||
+            nextCycleUs <= cycleUs)
+        {
+            return;
+        }
+        // Map message times to the JACK clock
+        auto clockUs = duration_cast<microseconds>(
+                           Clock::now().time_since_epoch()).count();
+        auto clockOffsetUs = clockUs - static_cast<int64_t>(jack_get_time());
+        auto cycleLengthUs = static_cast<int64_t>(nextCycleUs - cycleUs);
+
+        // Take the messages sent; among messages due at the same time, the
+        // first sent is played first
+        TimedMidiMessage timed;
+        while (m_pending.size() < m_pending.capacity() &&
+               jack_ringbuffer_read_space(m_buffer) >= sizeof(timed))
+        {
+            jack_ringbuffer_read(m_buffer, reinterpret_cast<char *>(&timed),
+                                 sizeof(timed));
+            m_pending.insert(
+                std::lower_bound(m_pending.begin(), m_pending.end(), timed,
+                                 [](const TimedMidiMessage &a,
+                                    const TimedMidiMessage &b)
+                                 {
+                                     return a.timeUs > b.timeUs;
+                                 }),
+                timed);
+        }
+
+        jack_nframes_t lastOffset{0};
+        while (!m_pending.empty())
+        {
+            timed = m_pending.back();
+            auto offsetUs = timed.timeUs - clockOffsetUs -
+                            static_cast<int64_t>(cycleUs);
+            if (offsetUs >= cycleLengthUs)
+            {
+                // Due in a later cycle
+                break;
+            }
+            m_pending.pop_back();
+
+            // Late messages are played at the start of the cycle, and events
+            // must be written in frame order
+            jack_nframes_t offset{0};
+            if (offsetUs > 0)
+            {
+                offset = static_cast<jack_nframes_t>(offsetUs * nframes /
+                                                     cycleLengthUs);
+            }
+            if (offset < lastOffset)
+            {
+                offset = lastOffset;
+            }
+            if (jack_midi_event_write(portBuffer, offset, timed.message.data,
+                                      timed.message.size) != 0)
+            {
+                m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            lastOffset = offset;
+        }
+    }
+};
+}
+
+#endif
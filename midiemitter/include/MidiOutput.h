@@ -0,0 +1,259 @@
+
+#ifndef MIDIOUTPUT_H
+#define MIDIOUTPUT_H
+
+#include <MidiEndpointCommon.h>
+
+#include <RtMidi.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace midiendpoints
+{
+
+//! \brief A MIDI channel message.
+struct MidiMessage
+{
+    //! Number of bytes in the message
+    unsigned char size;
+    //! Message bytes
+    unsigned char data[3];
+};
+
+//!
+//! \brief A fixed-capacity batch of MIDI messages due at the same time.
+//!
+//! Messages are written in place into a preallocated array, so building a
+//! batch never allocates memory.
+//!
+class MidiMessageBatch
+{
+public:
+    //! Maximum number of messages in a batch
+    static const std::size_t CAPACITY{64};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! Creates an empty batch.
+    //!
+    MidiMessageBatch()
+    : m_size{0}
+    {
+    }
+
+    //!
+    //! \brief Add a note on message.
+    //!
+    //! \param channel MIDI channel
+    //! \param note MIDI note
+    //! \param velocity Note velocity
+    //!
+    void noteOn(uint8_t channel, uint8_t note, uint8_t velocity)
+    {
+        add(0x90 | (channel & 0x0F), note & 0x7F, velocity & 0x7F);
+    }
+
+    //!
+    //! \brief Add a note off message.
+    //!
+    //! \param channel MIDI channel
+    //! \param note MIDI note
+    //! \param velocity Note velocity
+    //!
+    void noteOff(uint8_t channel, uint8_t note, uint8_t velocity)
+    {
+        add(0x80 | (channel & 0x0F), note & 0x7F, velocity & 0x7F);
+    }
+
+    //!
+    //! \brief Add a program change message.
+    //!
+    //! \param channel MIDI channel
+    //! \param program New program
+    //!
+    void programChange(uint8_t channel, uint8_t program)
+    {
+        auto &message = m_messages[m_size++];
+        message.size = 2;
+        message.data[0] = static_cast<unsigned char>(0xC0 | (channel & 0x0F));
+        message.data[1] = static_cast<unsigned char>(program & 0x7F);
+    }
+
+    //! \return Whether the batch cannot hold more messages
+    bool full() const
+    {
+        return m_size == CAPACITY;
+    }
+
+    //! \return Whether the batch is empty
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    //! \return Number of messages in the batch
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    //! \brief Remove every message from the batch.
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    //! \return Beginning of the messages
+    const MidiMessage *begin() const
+    {
+        return m_messages;
+    }
+
+    //! \return End of the messages
+    const MidiMessage *end() const
+    {
+        return m_messages + m_size;
+    }
+
+private:
+    //! Messages
+    MidiMessage m_messages[CAPACITY];
+    //! Number of messages
+    std::size_t m_size;
+
+    void add(unsigned int status, unsigned int data1, unsigned int data2)
+    {
+        auto &message = m_messages[m_size++];
+        message.size = 3;
+        message.data[0] = static_cast<unsigned char>(status);
+        message.data[1] = static_cast<unsigned char>(data1);
+        message.data[2] = static_cast<unsigned char>(data2);
+    }
+};
+
+//!
+//! \brief A MIDI output backend.
+//!
+//! Backends with a lookahead accept messages ahead of their time and play them
+//! at the given time themselves; backends without one play messages as soon
+//! as they are sent.
+//!
+class MidiOutput
+{
+public:
+    //! Clock used for message times
+    typedef std::chrono::steady_clock Clock;
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~MidiOutput()
+    {
+    }
+
+    //!
+    //! \brief Open an output port.
+    //!
+    //! \param portName Name of the port
+    //!
+    virtual void open(const std::string &portName) = 0;
+
+    //!
+    //! \brief Close the output port.
+    //!
+    virtual void close() = 0;
+
+    //!
+    //! \brief Send a batch of messages.
+    //!
+    //! \param batch Messages to send
+    //! \param time Time at which the messages are due
+    //!
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point time) = 0;
+
+    //!
+    //! \return How long before their time messages should be sent
+    //!
+    virtual Clock::duration lookahead() const = 0;
+};
+
+//!
+//! \brief MIDI output through an RtMidi virtual port.
+//!
+//! Messages are copied into a reused message buffer before being handed to
+//! RtMidi, so sending does not allocate memory. Messages are played as soon as
+//! they are sent.
+//!
+class RtMidiOutput : public MidiOutput
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param api RtMidi API
+    //! \param clientName MIDI client identifier
+    //!
+    RtMidiOutput(RtMidi::Api api, const std::string &clientName)
+    : m_midiOut(api, clientName)
+    , m_message()
+    {
+        m_message.reserve(sizeof(MidiMessage::data));
+    }
+
+    //!
+    //! \brief Open a virtual output port.
+    //!
+    //! \param portName Name of the port
+    //!
+    virtual void open(const std::string &portName)
+    {
+        if (m_midiOut.getPortCount() < 1)
+        {
+            throw MidiEndpointException("No MIDI ports available");
+        }
+        m_midiOut.openVirtualPort(portName);
+    }
+
+    //!
+    //! \brief Close the output port.
+    //!
+    virtual void close()
+    {
+        m_midiOut.closePort();
+    }
+
+    //!
+    //! \brief Send a batch of messages.
+    //!
+    //! The messages are played immediately.
+    //!
+    //! \param batch Messages to send
+    //!
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point)
+    {
+        for (const auto &message : batch) {
+            m_message.assign(message.data, message.data + message.size);
+            m_midiOut.sendMessage(&m_message);
+        }
+    }
+
+    //! \return Zero, messages are played as soon as they are sent
+    virtual Clock::duration lookahead() const
+    {
+        return Clock::duration::zero();
+    }
+
+private:
+    //! RtMidi output
+    RtMidiOut m_midiOut;
+    //! Reused message buffer
+    std::vector<unsigned char> m_message;
+};
+}
+
+#endif
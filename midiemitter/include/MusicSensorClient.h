@@ -3,46 +3,71 @@
 #define MUSICSENSORCLIENT_H
 
 #include <masmusic.pb.h>
+#include <ClockOffsetEstimator.h>
+#include <ClockSyncClient.h>
 #include <MidiEndpointCommon.h>
+#include <MidiOutput.h>
+#include <NoteOwnershipTable.h>
+#include <NoteScheduler.h>
+#include <PlayoutDelay.h>
 
 #include <asio.hpp>
-#include <asio/system_timer.hpp>
+#include <bsf/MpscQueue.h>
 #include <bsf/SensorClient.h>
 #include <log4cxx/logger.h>
 #include <RtMidi.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include <thread>
 
 namespace midiendpoints
 {
-struct InstrumentNote
+
+//! \brief A scheduled MIDI note event.
+struct NoteEvent
 {
+    enum class Type : uint8_t
+    {
+        ON,
+        OFF
+    };
+
+    //! Time at which the event is due
+    MidiOutput::Clock::time_point time;
+    //! Event type
+    Type type;
+    //! Note instrument
     int8_t instrument;
+    //! MIDI note
     int8_t note;
-    bool operator== (const InstrumentNote& other) const {
-        return this->instrument == other.instrument && this->note == other.note;
-    }
+    //! Note velocity
+    int8_t velocity;
+    //! Ownership ticket of the note the event belongs to
+    NoteOwnershipTable::Ticket ticket;
 };
-}
-
-namespace std {
-     template <> struct hash<midiendpoints::InstrumentNote>
-     {
-         size_t operator()(const midiendpoints::InstrumentNote &cn) const
-         {
-             return (cn.instrument << sizeof(cn.note)) + cn.note;
-         }
-     };
-}
 
-
-namespace midiendpoints
+//! \brief A received note waiting to be scheduled.
+struct NoteRequest
 {
+    //! Note time stamp
+    MidiOutput::Clock::time_point timestamp;
+    //! Note arrival time
+    MidiOutput::Clock::time_point arrival;
+    //! Note duration
+    std::chrono::milliseconds duration;
+    //! Note instrument
+    int8_t instrument;
+    //! MIDI note
+    int8_t note;
+    //! Note velocity
+    int8_t velocity;
+};
 
 template <typename TransportT>
 using MusicSensorClientParent =
@@ -53,7 +78,22 @@ using MusicSensorClientParent =
 //! \brief Plays music messages coming from a BSF network.
 //!
 //! Music messages are received as protocol buffers messages from a BSF network
-//! and played through a Jack MIDI port.
+//! and played through a MIDI output backend.
+//!
+//! Received notes are decoded on the transport thread and handed to the client
+//! strand through a lock-free queue. Notes are scheduled at their time stamp
+//! plus a playout delay, and notes arriving after that are played at once, and
+//! counted as late if there is a delay. Time stamps are converted into the
+//! local monotonic clock, optionally using the clock offset estimated by
+//! synchronizing with the remote endpoint. All the scheduling and playing
+//! state is only accessed from within the strand, so the client does not need
+//! any other synchronization, and its io_service may be run by several
+//! threads.
+//!
+//! The client runs its io_service in a thread of its own while started. The
+//! io_service may be shared with the transport, so that network I/O and
+//! scheduling run in a single event loop; in that case, the transport must be
+//! stopped before the client.
 //!
 //! \tparam TransportT BSF transport type
 //!
@@ -70,10 +110,39 @@ public:
     //! \param transport BSF transport
     //! \param channel BSF transport channel
     //! \param midiClientName MIDI client identifier
+    //! \param midiOut MIDI output backend
+    //! \param playoutDelay Playout delay of the received notes
+    //! \param syncChannel BSF transport channel for clock synchronization, or
+    //!                    an empty channel to trust the local system clock
     //!
     MusicSensorClient(const Transport &transport,
                       const typename Transport::Channel &channel,
-                      const std::string &midiClientName);
+                      const std::string &midiClientName,
+                      std::unique_ptr<MidiOutput> midiOut,
+                      const PlayoutDelay &playoutDelay = PlayoutDelay(),
+                      const typename Transport::Channel &syncChannel =
+                          typename Transport::Channel());
+
+    //!
+    //! \brief Constructor sharing an ASIO service.
+    //!
+    //! \param transport BSF transport
+    //! \param channel BSF transport channel
+    //! \param midiClientName MIDI client identifier
+    //! \param midiOut MIDI output backend
+    //! \param asio ASIO service run by the client
+    //! \param playoutDelay Playout delay of the received notes
+    //! \param syncChannel BSF transport channel for clock synchronization, or
+    //!                    an empty channel to trust the local system clock
+    //!
+    MusicSensorClient(const Transport &transport,
+                      const typename Transport::Channel &channel,
+                      const std::string &midiClientName,
+                      std::unique_ptr<MidiOutput> midiOut,
+                      asio::io_service &asio,
+                      const PlayoutDelay &playoutDelay = PlayoutDelay(),
+                      const typename Transport::Channel &syncChannel =
+                          typename Transport::Channel());
 
     //!
     //! \brief Destructor.
@@ -95,10 +164,30 @@ public:
     //!
     void stop();
 
+    //!
+    //! \brief Get the number of received notes dropped because the received
+    //!        notes queue was full.
+    //!
+    //! \return Number of dropped notes since construction
+    //!
+    unsigned long long getDroppedCount() const;
+
+    //!
+    //! \brief Get the number of received notes that arrived too late to be
+    //!        played at their time stamp plus a non-zero playout delay.
+    //!
+    //! \return Number of late notes since construction
+    //!
+    unsigned long long getLateCount() const;
+
 private:
 
     //! MIDI output
-    RtMidiOut m_midiOut;
+    std::unique_ptr<MidiOutput> m_midiOut;
+    //! MIDI messages pending to be sent
+    MidiMessageBatch m_midiBatch;
+    //! Time at which the pending MIDI messages are due
+    MidiOutput::Clock::time_point m_midiBatchTime;
     //! MIDI client name
     std::string m_midiClientName;
     //! MIDI channel
@@ -109,17 +198,51 @@ private:
     std::vector<int8_t> m_midiChannelProgram;
     //! MIDI channel used by each program
     std::vector<int8_t> m_programMidiChannel;
+    //! Capacity of the received notes queue
+    static const std::size_t REQUEST_QUEUE_CAPACITY{4096};
+
+    //! ASIO service owned by the client, if not shared
+    std::unique_ptr<asio::io_service> m_ownAsio;
     //! ASIO service
-    asio::io_service m_asio;
+    asio::io_service &m_asio;
+    //! ASIO strand owning the scheduling and playing state
+    asio::io_service::strand m_strand;
     //! ASIO work
     std::unique_ptr<asio::io_service::work> m_work;
     //! ASIO thread
     std::thread m_asioThread;
-    //! A map storing timers that started a note
-    std::unordered_map<InstrumentNote, std::weak_ptr<asio::system_timer>>
-        m_startedNotes;
+    //! Note event scheduler
+    NoteScheduler<NoteEvent, MidiOutput::Clock> m_scheduler;
+    //! Table storing the scheduled note that started each note
+    NoteOwnershipTable m_startedNotes;
+    //! Playout delay of the received notes
+    PlayoutDelay m_playoutDelay;
+    //! Offset between the remote clock and the local monotonic clock
+    ClockOffsetEstimator m_clockOffset;
+    //! Clock synchronization client, if enabled
+    std::unique_ptr<ClockSyncClient<TransportT>> m_clockSync;
+    //! Received notes waiting to be scheduled
+    bsf::MpscQueue<NoteRequest> m_requests;
+    //! Whether a drain of the received notes queue is pending in the strand
+    std::atomic<bool> m_drainPending;
+    //! Number of received notes dropped because the queue was full
+    std::atomic<unsigned long long> m_droppedCount;
+    //! Number of received notes played later than their playout time
+    std::atomic<unsigned long long> m_lateCount;
     //! Whether the retransmitter has been started
-    bool m_started;
+    std::atomic<bool> m_started;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param asio Shared ASIO service, or nullptr for an own service
+    //!
+    MusicSensorClient(const Transport &transport,
+                      const typename Transport::Channel &channel,
+                      const std::string &midiClientName,
+                      std::unique_ptr<MidiOutput> midiOut,
+                      asio::io_service *asio, const PlayoutDelay &playoutDelay,
+                      const typename Transport::Channel &syncChannel);
 
     //! Class logger
     static log4cxx::LoggerPtr LOG;
@@ -137,6 +260,33 @@ private:
     //!
     virtual bool onDataReading(const TimeSpanNoteReading &reading);
 
+    //!
+    //! \brief Schedule every note waiting in the received notes queue.
+    //!
+    void drainRequests();
+
+    //!
+    //! \brief Play a batch of due note events.
+    //!
+    //! \param events Due events
+    //! \param count Number of events
+    //!
+    void playEvents(const NoteEvent *events, std::size_t count);
+
+    //!
+    //! \brief Send the pending MIDI messages.
+    //!
+    void midiFlush();
+
+    //!
+    //! \brief Set the time of the next MIDI messages.
+    //!
+    //! Pending messages due at a different time are sent first.
+    //!
+    //! \param time Time at which the next messages are due
+    //!
+    void midiSetTime(MidiOutput::Clock::time_point time);
+
     //!
     //! \brief Send a MIDI ON message for a note.
     //!
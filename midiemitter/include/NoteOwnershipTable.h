@@ -0,0 +1,140 @@
+
+#ifndef NOTEOWNERSHIPTABLE_H
+#define NOTEOWNERSHIPTABLE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Tracks which scheduled note owns each playing instrument note.
+//!
+//! Every scheduled note gets a ticket from a per instrument and note generation
+//! counter, carried by both its on and off events. When the on event is played
+//! the ticket becomes the owner of the note, and the off event only switches
+//! the note off if it still holds the ownership (i.e. the note was not
+//! restarted by a later note in the meantime). Tables are flat arrays, so every
+//! check is a single indexed access.
+//!
+//! Outputs with a lookahead receive events ahead of their time, and a note
+//! scheduled late may be handed over after a later one, so ownership follows
+//! the times at which the events are due rather than the order in which they
+//! are played: a note only takes the ownership from a note starting before
+//! it, and a note ending before the owner starts is switched off anyway.
+//!
+//! This class is not thread-safe.
+//!
+class NoteOwnershipTable
+{
+public:
+    //! Ticket type; zero is never issued
+    typedef uint16_t Ticket;
+    //! Time point type of the events
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    //! Number of instruments
+    static const std::size_t INSTRUMENTS{128};
+    //! Number of MIDI notes
+    static const std::size_t NOTES{128};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! Creates a table with no playing notes.
+    //!
+    NoteOwnershipTable()
+    : m_entries()
+    {
+    }
+
+    //!
+    //! \brief Issue a ticket for a new scheduled note.
+    //!
+    //! \param instrument Note instrument (0-127)
+    //! \param note MIDI note (0-127)
+    //! \return The ticket of the note
+    //!
+    Ticket issue(uint8_t instrument, uint8_t note)
+    {
+        auto &entry = at(instrument, note);
+        if (++entry.generation == 0)
+        {
+            ++entry.generation;
+        }
+        return entry.generation;
+    }
+
+    //!
+    //! \brief Make a ticket the owner of a note, unless a later note owns it.
+    //!
+    //! \param instrument Note instrument (0-127)
+    //! \param note MIDI note (0-127)
+    //! \param ticket Ticket of the started note
+    //! \param time Time at which the note starts
+    //! \return Whether the note is owned by another ticket and still playing at
+    //!         that time, so it must be switched off first
+    //!
+    bool acquire(uint8_t instrument, uint8_t note, Ticket ticket,
+                 TimePoint time)
+    {
+        auto &entry = at(instrument, note);
+        if (entry.owner != 0 && time < entry.start)
+        {
+            return false;
+        }
+        auto wasPlaying = entry.owner != 0 && entry.end > time;
+        entry.owner = ticket;
+        entry.start = time;
+        entry.end = TimePoint::max();
+        return wasPlaying;
+    }
+
+    //!
+    //! \brief Release a note, checking whether it must be switched off.
+    //!
+    //! \param instrument Note instrument (0-127)
+    //! \param note MIDI note (0-127)
+    //! \param ticket Ticket of the finished note
+    //! \param time Time at which the note ends
+    //! \return Whether the ticket owns the note or ends before its owner starts
+    //!
+    bool release(uint8_t instrument, uint8_t note, Ticket ticket,
+                 TimePoint time)
+    {
+        auto &entry = at(instrument, note);
+        if (entry.owner == ticket)
+        {
+            entry.end = time;
+            return true;
+        }
+        return entry.owner == 0 || time < entry.start;
+    }
+
+private:
+    //! \brief Ownership data of an instrument note.
+    struct Entry
+    {
+        //! Last issued ticket
+        Ticket generation;
+        //! Ticket of the last note to start, or zero
+        Ticket owner;
+        //! Time at which the owner starts
+        TimePoint start;
+        //! Time at which the owner ends, or the maximum time if not released
+        TimePoint end;
+    };
+
+    //! Ownership data of each note of each instrument
+    Entry m_entries[INSTRUMENTS][NOTES];
+
+    Entry &at(uint8_t instrument, uint8_t note)
+    {
+        return m_entries[instrument & (INSTRUMENTS - 1)][note & (NOTES - 1)];
+    }
+};
+}
+
+#endif
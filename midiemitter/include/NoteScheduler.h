@@ -0,0 +1,454 @@
+
+#ifndef NOTESCHEDULER_H
+#define NOTESCHEDULER_H
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Timing wheel scheduler for note events.
+//!
+//! Events are stored in a hashed timing wheel with millisecond ticks. Each
+//! wheel slot is an intrusive list of nodes taken from a preallocated pool, so
+//! scheduling an event is O(1) and does not allocate memory unless the pool is
+//! exhausted. A single timer drives the wheel; when it expires, every event due
+//! up to the current tick is collected and passed to the handler in one batch,
+//! in time order. The timer waits are allocated from a small reused pool too.
+//!
+//! With a lookahead, events are handed to the handler up to that long before
+//! they are due, for outputs that play them at their time by themselves. The
+//! timer is then armed half the lookahead before the next event, so a single
+//! wakeup hands over every event due within the following half lookahead.
+//!
+//! The scheduler is not thread-safe; it must only be used from within its
+//! strand, which also serializes the calls to the handler.
+//!
+//! \tparam EventT Event type; it should be a small POD type
+//! \tparam ClockT Clock used for the event times
+//!
+template <typename EventT, typename ClockT = std::chrono::system_clock>
+class NoteScheduler
+{
+public:
+    //! Event type
+    typedef EventT Event;
+    //! Clock type
+    typedef ClockT Clock;
+    //! Time point type
+    typedef typename Clock::time_point TimePoint;
+    //! Duration type
+    typedef typename Clock::duration Duration;
+    //! Handler for batches of due events
+    typedef std::function<void(const Event *events, std::size_t count)>
+        Handler;
+
+    NoteScheduler(const NoteScheduler &) = delete;
+    NoteScheduler &operator=(const NoteScheduler &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param asio ASIO service running the scheduler timer
+    //! \param strand ASIO strand of the scheduler
+    //! \param handler Handler called with every batch of due events
+    //! \param lookahead How long before they are due events are handed over
+    //! \param capacity Number of events preallocated in the pool
+    //!
+    NoteScheduler(asio::io_service &asio, asio::io_service::strand &strand,
+                  Handler handler, Duration lookahead = Duration::zero(),
+                  std::size_t capacity = DEFAULT_CAPACITY)
+    : m_strand(strand)
+    , m_timer(asio)
+    , m_handler(std::move(handler))
+    , m_lookahead{std::chrono::duration_cast<std::chrono::milliseconds>(
+          lookahead).count()}
+    , m_nodes()
+    , m_free{NIL}
+    , m_slots(SLOTS, Slot{NIL, NIL})
+    , m_occupied()
+    , m_size{0}
+    , m_currentTick{0}
+    , m_armedTick{NO_TICK}
+    , m_batch()
+    , m_waitMemory(std::make_shared<WaitMemory>())
+    {
+        m_nodes.reserve(capacity);
+        m_batch.reserve(capacity);
+    }
+
+    //!
+    //! \brief Schedule an event.
+    //!
+    //! Events scheduled in the past are fired as soon as possible.
+    //!
+    //! \param time Time at which the event is due
+    //! \param event Event to schedule
+    //!
+    void schedule(TimePoint time, const Event &event)
+    {
+        if (m_size == 0)
+        {
+            m_currentTick = toTick(Clock::now()) - 1;
+        }
+        auto tick = std::max(toTick(time), m_currentTick + 1);
+
+        // Take a node from the pool
+        auto index = m_free;
+        if (index != NIL)
+        {
+            m_free = m_nodes[index].next;
+        }
+        else
+        {
+            index = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.push_back(Node());
+        }
+        auto &node = m_nodes[index];
+        node.event = event;
+        node.tick = tick;
+        node.next = NIL;
+
+        // Append to the slot list
+        auto slotIndex = static_cast<std::size_t>(tick) & SLOT_MASK;
+        auto &slot = m_slots[slotIndex];
+        if (slot.tail == NIL)
+        {
+            slot.head = index;
+            m_occupied[slotIndex / 64] |= uint64_t{1} << (slotIndex % 64);
+        }
+        else
+        {
+            m_nodes[slot.tail].next = index;
+        }
+        slot.tail = index;
+        m_size++;
+
+        if (m_armedTick == NO_TICK || tick < m_armedTick)
+        {
+            arm(tick);
+        }
+    }
+
+    //!
+    //! \brief Drop every scheduled event.
+    //!
+    void clear()
+    {
+        m_timer.cancel();
+        m_armedTick = NO_TICK;
+        m_nodes.clear();
+        m_free = NIL;
+        std::fill(m_slots.begin(), m_slots.end(), Slot{NIL, NIL});
+        std::fill(std::begin(m_occupied), std::end(m_occupied), 0);
+        m_size = 0;
+    }
+
+    //! \return Number of scheduled events
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    //! Number of wheel slots (one tick each)
+    static const std::size_t SLOTS{4096};
+    //! Slot index mask
+    static const std::size_t SLOT_MASK{SLOTS - 1};
+    //! Default number of preallocated events
+    static const std::size_t DEFAULT_CAPACITY{4096};
+    //! Null node index
+    static const uint32_t NIL{std::numeric_limits<uint32_t>::max()};
+    //! Null tick
+    static const int64_t NO_TICK{std::numeric_limits<int64_t>::max()};
+
+    //! \brief Pooled event node.
+    struct Node
+    {
+        Event event;
+        int64_t tick;
+        uint32_t next;
+    };
+
+    //! \brief Wheel slot event list.
+    struct Slot
+    {
+        uint32_t head;
+        uint32_t tail;
+    };
+
+    //!
+    //! \brief Memory reused for the timer waits.
+    //!
+    //! Re-arming the timer for an earlier event starts a new wait while the
+    //! cancelled one is still queued, so a few blocks are kept; requests beyond
+    //! them fall back to the heap. Blocks may be released from any thread
+    //! running the service.
+    //!
+    class WaitMemory
+    {
+    public:
+        WaitMemory()
+        {
+            for (auto &block : m_blocks) {
+                block.used = false;
+            }
+        }
+
+        void *allocate(std::size_t size)
+        {
+            if (size <= BLOCK_SIZE)
+            {
+                for (auto &block : m_blocks) {
+                    if (!block.used.exchange(true, std::memory_order_acquire))
+                    {
+                        return &block.storage;
+                    }
+                }
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void *pointer)
+        {
+            for (auto &block : m_blocks) {
+                if (pointer == &block.storage)
+                {
+                    block.used.store(false, std::memory_order_release);
+                    return;
+                }
+            }
+            ::operator delete(pointer);
+        }
+
+    private:
+        //! Number of blocks
+        static const std::size_t BLOCKS{8};
+        //! Size of a block (bytes)
+        static const std::size_t BLOCK_SIZE{256};
+
+        //! \brief Memory block.
+        struct Block
+        {
+            typename std::aligned_storage<BLOCK_SIZE>::type storage;
+            std::atomic<bool> used;
+        };
+
+        //! Blocks
+        Block m_blocks[BLOCKS];
+    };
+
+    //!
+    //! \brief Timer wait handler, allocated from the wait memory.
+    //!
+    //! The handler shares the memory, so that it outlives the waits still queued
+    //! in the service when the scheduler is destroyed.
+    //!
+    struct WaitHandler
+    {
+        NoteScheduler *scheduler;
+        std::shared_ptr<WaitMemory> memory;
+
+        void operator()(const asio::error_code &error) const
+        {
+            if (error != asio::error::operation_aborted)
+            {
+                scheduler->m_armedTick = NO_TICK;
+                scheduler->advance();
+            }
+        }
+
+        friend void *asio_handler_allocate(std::size_t size,
+                                           WaitHandler *handler)
+        {
+            return handler->memory->allocate(size);
+        }
+
+        friend void asio_handler_deallocate(void *pointer, std::size_t,
+                                            WaitHandler *handler)
+        {
+            handler->memory->deallocate(pointer);
+        }
+    };
+
+    //! Strand of the scheduler
+    asio::io_service::strand &m_strand;
+    //! Timer driving the wheel
+    asio::basic_waitable_timer<Clock> m_timer;
+    //! Handler for due events
+    Handler m_handler;
+    //! Lookahead in ticks
+    int64_t m_lookahead;
+    //! Event node pool
+    std::vector<Node> m_nodes;
+    //! First free node in the pool
+    uint32_t m_free;
+    //! Wheel slots
+    std::vector<Slot> m_slots;
+    //! Bitmap of non-empty slots
+    uint64_t m_occupied[SLOTS / 64];
+    //! Number of scheduled events
+    std::size_t m_size;
+    //! Last processed tick
+    int64_t m_currentTick;
+    //! Tick for which the timer is armed
+    int64_t m_armedTick;
+    //! Reused batch of due events
+    std::vector<Event> m_batch;
+    //! Memory of the timer waits
+    std::shared_ptr<WaitMemory> m_waitMemory;
+
+    static int64_t toTick(TimePoint time)
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(time.time_since_epoch()).count();
+    }
+
+    static TimePoint fromTick(int64_t tick)
+    {
+        using namespace std::chrono;
+        return TimePoint{
+            duration_cast<typename Clock::duration>(milliseconds{tick})};
+    }
+
+    //!
+    //! \brief Arm the timer to expire at a tick.
+    //!
+    //! \param tick Expiration tick
+    //!
+    void arm(int64_t tick)
+    {
+        m_armedTick = tick;
+        m_timer.expires_at(fromTick(tick - m_lookahead / 2));
+        m_timer.async_wait(m_strand.wrap(WaitHandler{this, m_waitMemory}));
+    }
+
+    //!
+    //! \brief Fire every event due up to the current time plus the lookahead.
+    //!
+    void advance()
+    {
+        auto horizonTick = toTick(Clock::now()) + m_lookahead;
+        // A full turn of the wheel visits every slot
+        auto lastTick = std::min(horizonTick, m_currentTick + int64_t{SLOTS});
+        for (auto tick = m_currentTick + 1; tick <= lastTick; tick++) {
+            auto slotIndex = static_cast<std::size_t>(tick) & SLOT_MASK;
+            if ((m_occupied[slotIndex / 64] & (uint64_t{1} << (slotIndex % 64)))
+                != 0)
+            {
+                collect(slotIndex, horizonTick);
+            }
+        }
+        m_currentTick = std::max(m_currentTick, horizonTick);
+
+        if (!m_batch.empty())
+        {
+            m_handler(m_batch.data(), m_batch.size());
+            m_batch.clear();
+        }
+
+        if (m_size > 0 && m_armedTick == NO_TICK)
+        {
+            arm(nextOccupiedTick());
+        }
+    }
+
+    //!
+    //! \brief Move the due events of a slot into the batch.
+    //!
+    //! \param slotIndex Slot index
+    //! \param horizonTick Last tick to collect
+    //!
+    void collect(std::size_t slotIndex, int64_t horizonTick)
+    {
+        auto &slot = m_slots[slotIndex];
+        auto previous = NIL;
+        auto index = slot.head;
+        while (index != NIL)
+        {
+            auto &node = m_nodes[index];
+            auto next = node.next;
+            if (node.tick <= horizonTick)
+            {
+                // Unlink and return to the pool
+                m_batch.push_back(node.event);
+                if (previous == NIL)
+                {
+                    slot.head = next;
+                }
+                else
+                {
+                    m_nodes[previous].next = next;
+                }
+                if (slot.tail == index)
+                {
+                    slot.tail = previous;
+                }
+                node.next = m_free;
+                m_free = index;
+                m_size--;
+            }
+            else
+            {
+                previous = index;
+            }
+            index = next;
+        }
+        if (slot.head == NIL)
+        {
+            m_occupied[slotIndex / 64] &= ~(uint64_t{1} << (slotIndex % 64));
+        }
+    }
+
+    //!
+    //! \return The first tick after the current one with a non-empty slot
+    //!
+    int64_t nextOccupiedTick() const
+    {
+        auto start = static_cast<std::size_t>(m_currentTick + 1) & SLOT_MASK;
+        for (std::size_t offset = 0; offset < SLOTS;) {
+            auto slotIndex = (start + offset) & SLOT_MASK;
+            auto bits = m_occupied[slotIndex / 64] >> (slotIndex % 64);
+            if (bits != 0)
+            {
+                offset += lowestBit(bits);
+                return m_currentTick + 1 + static_cast<int64_t>(offset);
+            }
+            // Skip to the next bitmap word
+            offset += 64 - slotIndex % 64;
+        }
+        return m_currentTick + 1;
+    }
+
+    //! \return Index of the lowest set bit of a non-zero word
+    static unsigned int lowestBit(uint64_t bits)
+    {
+#ifdef __GNUC__
+        return static_cast<unsigned int>(__builtin_ctzll(bits));
+#else
+        unsigned int index{0};
+        while ((bits & 1) == 0)
+        {
+            bits >>= 1;
+            index++;
+        }
+        return index;
+#endif
+    }
+};
+}
+
+#endif
@@ -0,0 +1,177 @@
+
+#ifndef PLAYOUTDELAY_H
+#define PLAYOUTDELAY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Playout delay of a jitter buffer.
+//!
+//! Notes are played at their time stamp plus the playout delay, so network
+//! jitter smaller than the delay does not distort the timing between notes.
+//!
+//! The delay is either fixed or adapted to the observed lateness of the notes
+//! (the time between their time stamp and their arrival). In adaptive mode,
+//! lateness is recorded in a histogram with millisecond buckets, whose counts
+//! are periodically halved so it follows recent conditions, and the delay
+//! tracks a percentile of it. The delay is raised at once, but lowered slowly
+//! to avoid squeezing consecutive notes together.
+//!
+//! Spanned notes are only sent once they finish, so their span is not recorded
+//! as lateness: long notes do not inflate the delay of the others, and are
+//! played late instead.
+//!
+//! This class is not thread-safe.
+//!
+class PlayoutDelay
+{
+public:
+    //! Delay modes
+    enum class Mode
+    {
+        FIXED,
+        ADAPTIVE
+    };
+
+    //! Maximum delay (milliseconds), bounded by the histogram size
+    static const int64_t MAX_DELAY_MS{2047};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! Creates a fixed zero delay, i.e. notes are played as soon as possible.
+    //!
+    PlayoutDelay()
+    : PlayoutDelay(Mode::FIXED, std::chrono::milliseconds{0}, 0)
+    {
+    }
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param mode Delay mode
+    //! \param delay Fixed delay, or initial delay in adaptive mode
+    //! \param percentile Lateness percentile followed in adaptive mode (0-100)
+    //!
+    PlayoutDelay(Mode mode, std::chrono::milliseconds delay, double percentile)
+    : m_mode{mode}
+    , m_delayMs{std::min(std::max(delay.count(), int64_t{0}),
+                        int64_t{MAX_DELAY_MS})}
+    , m_percentile{std::min(std::max(percentile, 0.0), 100.0) / 100.0}
+    , m_histogram()
+    , m_total{0}
+    , m_observations{0}
+    {
+    }
+
+    //! \return Delay mode
+    Mode mode() const
+    {
+        return m_mode;
+    }
+
+    //! \return Current delay
+    std::chrono::milliseconds delay() const
+    {
+        return std::chrono::milliseconds{m_delayMs};
+    }
+
+    //!
+    //! \brief Record the lateness of a received note.
+    //!
+    //! \param lateness Time between the note time stamp and its arrival
+    //! \param span Note span, which is not recorded as lateness
+    //!
+    void observe(std::chrono::milliseconds lateness,
+                 std::chrono::milliseconds span = std::chrono::milliseconds{0})
+    {
+        if (m_mode != Mode::ADAPTIVE)
+        {
+            return;
+        }
+        auto bucket =
+            std::min(std::max(lateness.count() - span.count(), int64_t{0}),
+                     int64_t{BUCKETS - 1});
+        m_histogram[bucket]++;
+        m_total++;
+        if (++m_observations % UPDATE_INTERVAL == 0)
+        {
+            update();
+        }
+        if (m_observations % DECAY_INTERVAL == 0)
+        {
+            decay();
+        }
+    }
+
+private:
+    //! Number of histogram buckets (one millisecond each)
+    static const std::size_t BUCKETS{2048};
+    //! Number of observations between delay updates
+    static const unsigned int UPDATE_INTERVAL{16};
+    //! Number of observations between histogram decays
+    static const unsigned int DECAY_INTERVAL{1024};
+    //! Inverse of the fraction of a delay decrease applied per update
+    static const int64_t DECREASE_GAIN{8};
+
+    //! Delay mode
+    Mode m_mode;
+    //! Current delay (milliseconds)
+    int64_t m_delayMs;
+    //! Lateness percentile followed (0-1)
+    double m_percentile;
+    //! Lateness histogram
+    uint32_t m_histogram[BUCKETS];
+    //! Sum of the histogram counts
+    uint64_t m_total;
+    //! Number of observations
+    unsigned int m_observations;
+
+    //!
+    //! \brief Move the delay towards the current lateness percentile.
+    //!
+    void update()
+    {
+        auto target = static_cast<uint64_t>(m_percentile * m_total);
+        uint64_t count{0};
+        int64_t targetMs{0};
+        for (std::size_t i = 0; i < BUCKETS; i++) {
+            count += m_histogram[i];
+            if (count >= target)
+            {
+                targetMs = static_cast<int64_t>(i);
+                break;
+            }
+        }
+        targetMs = std::min(targetMs, int64_t{MAX_DELAY_MS});
+        if (targetMs > m_delayMs)
+        {
+            m_delayMs = targetMs;
+        }
+        else
+        {
+            m_delayMs -= (m_delayMs - targetMs) / DECREASE_GAIN;
+        }
+    }
+
+    //!
+    //! \brief Halve the histogram counts.
+    //!
+    void decay()
+    {
+        m_total = 0;
+        for (auto &bucket : m_histogram) {
+            bucket /= 2;
+            m_total += bucket;
+        }
+    }
+};
+}
+
+#endif
@@ -6,7 +6,6 @@
 
 #include <algorithm>
 #include <chrono>
-#include <vector>
 
 namespace midiendpoints
 {
@@ -18,20 +17,66 @@ log4cxx::LoggerPtr MusicSensorClient<TransportT>::LOG(
 template <typename TransportT>
 MusicSensorClient<TransportT>::MusicSensorClient(
     const Transport &transport, const typename Transport::Channel &channel,
-    const std::string &midiClientName)
+    const std::string &midiClientName, std::unique_ptr<MidiOutput> midiOut,
+    const PlayoutDelay &playoutDelay,
+    const typename Transport::Channel &syncChannel)
+: MusicSensorClient(transport, channel, midiClientName, std::move(midiOut),
+                    nullptr, playoutDelay, syncChannel)
+{
+}
+
+template <typename TransportT>
+MusicSensorClient<TransportT>::MusicSensorClient(
+    const Transport &transport, const typename Transport::Channel &channel,
+    const std::string &midiClientName, std::unique_ptr<MidiOutput> midiOut,
+    asio::io_service &asio, const PlayoutDelay &playoutDelay,
+    const typename Transport::Channel &syncChannel)
+: MusicSensorClient(transport, channel, midiClientName, std::move(midiOut),
+                    &asio, playoutDelay, syncChannel)
+{
+}
+
+template <typename TransportT>
+MusicSensorClient<TransportT>::MusicSensorClient(
+    const Transport &transport, const typename Transport::Channel &channel,
+    const std::string &midiClientName, std::unique_ptr<MidiOutput> midiOut,
+    asio::io_service *asio, const PlayoutDelay &playoutDelay,
+    const typename Transport::Channel &syncChannel)
 : MusicSensorClientParent<TransportT>(transport, channel)
-, m_midiOut(MIDI_API, midiClientName)
+, m_midiOut(std::move(midiOut))
+, m_midiBatch()
+, m_midiBatchTime()
 , m_midiClientName{midiClientName}
 , m_midiChannel{0}
 , m_lastUsedMidiChannel{-1}
 , m_midiChannelProgram(16, 0)
 , m_programMidiChannel(128, -1)
-, m_asio()
+, m_ownAsio(asio == nullptr ? new asio::io_service() : nullptr)
+, m_asio(asio == nullptr ? *m_ownAsio : *asio)
+, m_strand(m_asio)
 , m_work()
 , m_asioThread()
+, m_scheduler(m_asio, m_strand,
+              [this](const NoteEvent *events, std::size_t count)
+              {
+                  playEvents(events, count);
+              },
+              m_midiOut->lookahead())
 , m_startedNotes()
+, m_playoutDelay(playoutDelay)
+, m_clockOffset()
+, m_clockSync()
+, m_requests(REQUEST_QUEUE_CAPACITY)
+, m_drainPending{false}
+, m_droppedCount{0}
+, m_lateCount{0}
 , m_started{false}
 {
+    if (syncChannel != typename Transport::Channel())
+    {
+        m_clockSync.reset(new ClockSyncClient<TransportT>(
+            transport, syncChannel, m_asio, m_clockOffset));
+    }
 }
 
 template <typename TransportT>
@@ -45,18 +90,19 @@ void MusicSensorClient<TransportT>::start()
 {
     if (!m_started)
     {
-        LOG4CXX_DEBUG(logger(), "Checking MIDI ports...")
-        // Check MIDI ports
-        if (m_midiOut.getPortCount() < 1)
-        {
-            throw MidiEndpointException("No MIDI ports available");
-        }
-
         // MIDI output
         LOG4CXX_DEBUG(logger(), "Opening MIDI port...")
-        m_midiOut.openVirtualPort("midi_out");
+        m_midiOut->open("midi_out");
         midiSetProgram();
 
+        // Logged before the strand can update the delay
+        LOG4CXX_INFO(logger(), "Playout delay "
+                                    << m_playoutDelay.delay().count() << " ms"
+                                    << (m_playoutDelay.mode() ==
+                                                PlayoutDelay::Mode::ADAPTIVE
+                                            ? " (adaptive)"
+                                            : ""))
+
         m_started = true;
 
         m_work.reset(new asio::io_service::work(m_asio));
@@ -67,13 +113,22 @@ void MusicSensorClient<TransportT>::start()
                                            m_asio.run_one();
                                        }
                                    });
+        if (m_clockSync)
+        {
+            m_clockSync->start();
+        }
 
         LOG4CXX_INFO(logger(), "Music sensor client started")
         LOG4CXX_INFO(logger(), "Subscribed to music events in MQTT channel '"
                                     << MusicSensorClientParent<TransportT>::getChannel()
                                     << "'")
-        LOG4CXX_INFO(logger(), "Playing on Jack port '" << m_midiClientName
+        LOG4CXX_INFO(logger(), "Playing on MIDI port '" << m_midiClientName
                                     << ":midi_out'")
+        if (m_clockSync)
+        {
+            LOG4CXX_INFO(logger(), "Synchronizing clock on MQTT channel '"
+                                        << m_clockSync->getChannel() << "'")
+        }
     }
     else
     {
@@ -88,13 +143,41 @@ void MusicSensorClient<TransportT>::stop()
     {
         LOG4CXX_DEBUG(logger(), "Stopping sensor client...")
         m_started = false;
+        if (m_clockSync)
+        {
+            m_clockSync->stop();
+        }
         m_work.reset();
         m_asioThread.join();
-        m_midiOut.closePort();
+        m_midiOut->close();
+        if (m_clockOffset.synchronized())
+        {
+            LOG4CXX_INFO(logger(), "Clock offset " << m_clockOffset.offset()
+                                        << " us (round trip "
+                                        << m_clockOffset.roundTrip() << " us)")
+        }
+        if (m_clockSync && m_clockSync->getIgnoredCount() > 0)
+        {
+            LOG4CXX_WARN(logger(), m_clockSync->getIgnoredCount()
+                                       << " clock synchronization responses"
+                                          " from other listeners were ignored")
+        }
         LOG4CXX_INFO(logger(), "Music sensor client stopped")
     }
 }
 
+template <typename TransportT>
+unsigned long long MusicSensorClient<TransportT>::getDroppedCount() const
+{
+    return m_droppedCount.load(std::memory_order_relaxed);
+}
+
+template <typename TransportT>
+unsigned long long MusicSensorClient<TransportT>::getLateCount() const
+{
+    return m_lateCount.load(std::memory_order_relaxed);
+}
+
 template <typename TransportT>
 bool MusicSensorClient<TransportT>::onDataReading(
     const TimeSpanNoteReading &reading)
@@ -106,15 +189,14 @@ bool MusicSensorClient<TransportT>::onDataReading(
         return true;
     }
 
-    // Get current time stamp
-    auto now = system_clock::now().time_since_epoch();
-    auto nowMs = duration_cast<milliseconds>(now);
+    // Get arrival time stamp
+    auto now = MidiOutput::Clock::now();
 
     LOG4CXX_DEBUG(logger(), "Received message:\n"
                                 << reading->ShortDebugString())
 
     // Read message data
-    milliseconds timestampMs{reading->timestamp()};
+    auto timestamp = m_clockOffset.toLocal(reading->timestamp() * 1000);
     const masmusic::Pitch &pitch = reading->pitch();
     int8_t midiNote = pitchToMidi(pitch);
     if (reading->instrument() > 127u)
@@ -130,45 +212,109 @@ bool MusicSensorClient<TransportT>::onDataReading(
     auto velocity =
         static_cast<int8_t>(std::min(reading->velocity(), 127u));
 
-    // Normalize expired start timestamp to now
-    timestampMs = std::max(timestampMs, nowMs);
-    system_clock::time_point timestampPointOn{timestampMs};
-    auto timestampPointOff =
-        timestampPointOn + milliseconds{reading->duration()};
-
-    // Set up new timers
-    auto onTimer =
-        std::make_shared<asio::system_timer>(m_asio, timestampPointOn);
-    onTimer->async_wait(
-        [this, onTimer, instrument, midiNote, velocity](const asio::error_code &)
+    // Hand the note to the strand
+    if (!m_requests.tryPush({timestamp, now, milliseconds{reading->duration()},
+                             instrument, midiNote, velocity}))
+    {
+        m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+        LOG4CXX_WARN(logger(), "Received notes queue full, note dropped")
+        return true;
+    }
+    if (!m_drainPending.exchange(true))
+    {
+        m_strand.post([this]
+                      {
+                          drainRequests();
+                      });
+    }
+
+    return true;
+}
+
+template <typename TransportT>
+void MusicSensorClient<TransportT>::drainRequests()
+{
+    // Notes pushed after this point will post a new drain
+    m_drainPending.exchange(false);
+    NoteRequest request;
+    while (m_requests.tryPop(request))
+    {
+        using namespace std::chrono;
+
+        // Play at the time stamp plus the delay, or at once if already late;
+        // without a delay, every note is played at once and none is late
+        m_playoutDelay.observe(
+            duration_cast<milliseconds>(request.arrival - request.timestamp),
+            request.duration);
+        auto delay = m_playoutDelay.delay();
+        auto on = request.timestamp + delay;
+        if (on < request.arrival)
         {
-            InstrumentNote instrumentNote {instrument, midiNote};
-            // Stop any previously playing notes
-            if (m_startedNotes[instrumentNote].lock())
+            if (delay > milliseconds::zero())
             {
-                setProgram(instrumentNote.instrument);
-                midiNoteOff(midiNote, DEFAULT_VELOCITY);
+                m_lateCount.fetch_add(1, std::memory_order_relaxed);
             }
-            // Start note and save this timer as initiator
-            m_startedNotes[instrumentNote] = onTimer;
-            setProgram(instrumentNote.instrument);
-            midiNoteOn(midiNote, velocity);
-        });
-    auto offTimer =
-        std::make_shared<asio::system_timer>(m_asio, timestampPointOff);
-    offTimer->async_wait(
-        [this, onTimer, offTimer, instrument, midiNote](const asio::error_code &)
+            on = request.arrival;
+        }
+        auto off = on + request.duration;
+
+        auto ticket = m_startedNotes.issue(request.instrument, request.note);
+        m_scheduler.schedule(on, {on, NoteEvent::Type::ON, request.instrument,
+                                  request.note, request.velocity, ticket});
+        m_scheduler.schedule(off, {off, NoteEvent::Type::OFF,
+                                   request.instrument, request.note,
+                                   request.velocity, ticket});
+    }
+}
+
+template <typename TransportT>
+void MusicSensorClient<TransportT>::playEvents(const NoteEvent *events,
+                                               std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        const auto &event = events[i];
+        midiSetTime(event.time);
+        if (event.type == NoteEvent::Type::ON)
         {
-            InstrumentNote instrumentNote {instrument, midiNote};
-            // Switch off note if it was initiated by this onTimer
-            if (m_startedNotes[instrumentNote].lock() == onTimer)
+            // Start note and save it as owner, stopping any previous note
+            setProgram(event.instrument);
+            if (m_startedNotes.acquire(event.instrument, event.note,
+                                       event.ticket, event.time))
             {
-                setProgram(instrumentNote.instrument);
-                midiNoteOff(midiNote, DEFAULT_VELOCITY);
+                midiNoteOff(event.note, DEFAULT_VELOCITY);
             }
-        });
+            midiNoteOn(event.note, event.velocity);
+        }
+        else if (m_startedNotes.release(event.instrument, event.note,
+                                        event.ticket, event.time))
+        {
+            // Switch off note unless a later note restarted it meanwhile
+            setProgram(event.instrument);
+            midiNoteOff(event.note, DEFAULT_VELOCITY);
+        }
+    }
+    midiFlush();
+}
 
-    return true;
+template <typename TransportT>
+void MusicSensorClient<TransportT>::midiFlush()
+{
+    if (!m_midiBatch.empty())
+    {
+        m_midiOut->send(m_midiBatch, m_midiBatchTime);
+        m_midiBatch.clear();
+    }
+}
+
+template <typename TransportT>
+void MusicSensorClient<TransportT>::midiSetTime(
+    MidiOutput::Clock::time_point time)
+{
+    if (time != m_midiBatchTime)
+    {
+        midiFlush();
+        m_midiBatchTime = time;
+    }
 }
 
 template <typename TransportT>
@@ -180,12 +326,12 @@ void MusicSensorClient<TransportT>::midiNoteOn(int8_t midiNote,
         return;
     }
 
-    LOG4CXX_DEBUG(logger(),
-                  "Note on: " << midiToPitch(midiNote).ShortDebugString())
-    std::vector<unsigned char> message{
-        (unsigned char)(0x90 | (0x0F & m_midiChannel)),
-        (unsigned char)(midiNote & 0x7F), (unsigned char)(velocity & 0x7F)};
-    m_midiOut.sendMessage(&message);
+    LOG4CXX_DEBUG(logger(), "Note on: " << (int) midiNote)
+    if (m_midiBatch.full())
+    {
+        midiFlush();
+    }
+    m_midiBatch.noteOn(m_midiChannel, midiNote, velocity);
 }
 
 template <typename TransportT>
@@ -197,12 +343,12 @@ void MusicSensorClient<TransportT>::midiNoteOff(int8_t midiNote,
         return;
     }
 
-    LOG4CXX_DEBUG(logger(),
-                  "Note off: " << midiToPitch(midiNote).ShortDebugString())
-    std::vector<unsigned char> message{
-        (unsigned char)(0x80 | (0x0F & m_midiChannel)),
-        (unsigned char)(midiNote & 0x7F), (unsigned char)(velocity & 0x7F)};
-    m_midiOut.sendMessage(&message);
+    LOG4CXX_DEBUG(logger(), "Note off: " << (int) midiNote)
+    if (m_midiBatch.full())
+    {
+        midiFlush();
+    }
+    m_midiBatch.noteOff(m_midiChannel, midiNote, velocity);
 }
 
 template <typename TransportT>
@@ -244,11 +390,12 @@ void MusicSensorClient<TransportT>::midiSetProgram()
     }
 
     auto program = m_midiChannelProgram[m_midiChannel];
-    LOG4CXX_DEBUG(logger(), "Set program: " << program);
-    std::vector<unsigned char> message{
-        (unsigned char) (0xC0 | (0x0F & m_midiChannel)),
-        (unsigned char) program};
-    m_midiOut.sendMessage(&message);
+    LOG4CXX_DEBUG(logger(), "Set program: " << (int) program);
+    if (m_midiBatch.full())
+    {
+        midiFlush();
+    }
+    m_midiBatch.programChange(m_midiChannel, program);
 }
 }
 
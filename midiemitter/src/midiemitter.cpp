@@ -1,23 +1,54 @@
 
 #include "MidiEndpointCommon.h"
+#include "MidiOutput.h"
 #include "MusicSensorClient.h"
+#include "PlayoutDelay.h"
+#ifdef USE_JACK
+#include "JackMidiOutput.h"
+#endif
+#ifdef USE_ALSA
+#include "AlsaSeqMidiOutput.h"
+#endif
 
+#include <asio.hpp>
+#include <bsf/AsioMqttTransport.h>
 #include <bsf/AsyncMqttTransport.h>
+#include <bsf/ShmTransport.h>
+#include <bsf/UdpMulticastTransport.h>
 #include <boost/program_options.hpp>
 #include <log4cxx/logger.h>
 
+#include <chrono>
+#include <memory>
 #include <stdexcept>
 
 static const char *DEFAULT_SERVER = "localhost";
 static const unsigned int DEFAULT_PORT = 1883;
 static const char *DEFAULT_TOPIC = "music";
 static const char *DEFAULT_CLIENT_NAME = "midiemitter";
+static const char *DEFAULT_OUTPUT = "rtmidi";
+static const unsigned int DEFAULT_PLAYOUT_DELAY = 0;
+static const double DEFAULT_DELAY_PERCENTILE = 95;
+static const char *DEFAULT_TOPIC_SYNC = "music-sync";
+static const char *DEFAULT_TRANSPORT = "mqtt";
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("midiemitter"));
 
 bool parseOptions(int argc, char *argv[], std::string &mqttServer,
                   unsigned int &mqttPort, std::string &mqttTopic,
-                  std::string &clientName, bool &debug);
+                  std::string &clientName, std::string &midiOutput,
+                  std::string &midiApi,
+                  midiendpoints::PlayoutDelay &playoutDelay,
+                  std::string &mqttTopicSync, std::string &transportName,
+                  bool &debug);
+
+std::unique_ptr<midiendpoints::MidiOutput>
+createMidiOutput(const std::string &midiOutput, const std::string &midiApi,
+                 const std::string &clientName);
+
+template <typename TransportT>
+void runSensorClient(TransportT &transport,
+                     midiendpoints::MusicSensorClient<TransportT> &sensorClient);
 
 int main(int argc, char *argv[])
 {
@@ -27,9 +58,15 @@ int main(int argc, char *argv[])
     unsigned int mqttPort;
     std::string clientName;
     std::string mqttTopic;
+    std::string midiOutput;
+    std::string midiApi;
+    PlayoutDelay playoutDelay;
+    std::string mqttTopicSync;
+    std::string transportName;
     bool debug;
     if (!parseOptions(argc, argv, mqttServer, mqttPort, mqttTopic, clientName,
-                      debug))
+                      midiOutput, midiApi, playoutDelay, mqttTopicSync,
+                      transportName, debug))
     {
         return 0;
     }
@@ -38,21 +75,59 @@ int main(int argc, char *argv[])
 
     try
     {
-        bsf::AsyncMqttTransport transport(clientName, mqttServer, mqttPort,
-                                          MQTT_QOS);
-        MusicSensorClient<bsf::AsyncMqttTransport> sensorClient(
-            transport, mqttTopic, clientName);
-
-        sensorClient.start();
-        transport.start();
-
-        // TODO make this right
-        LOG4CXX_INFO(logger, "Sending MIDI messages, press <enter> to quit...")
-        char input;
-        std::cin.get(input);
-
-        sensorClient.stop();
-        transport.stop();
+        if (transportName == "mqtt")
+        {
+            bsf::AsyncMqttTransport transport(clientName, mqttServer, mqttPort,
+                                              MQTT_QOS);
+            MusicSensorClient<bsf::AsyncMqttTransport> sensorClient(
+                transport, mqttTopic, clientName,
+                createMidiOutput(midiOutput, midiApi, clientName),
+                playoutDelay, mqttTopicSync);
+            runSensorClient(transport, sensorClient);
+        }
+        else if (transportName == "mqtt-asio")
+        {
+            // Network I/O and note scheduling share the client event loop
+            asio::io_service asio;
+            bsf::AsioMqttTransport transport(asio, clientName, mqttServer,
+                                             mqttPort, MQTT_QOS);
+            MusicSensorClient<bsf::AsioMqttTransport> sensorClient(
+                transport, mqttTopic, clientName,
+                createMidiOutput(midiOutput, midiApi, clientName), asio,
+                playoutDelay, mqttTopicSync);
+            runSensorClient(transport, sensorClient);
+        }
+        else if (transportName == "shm")
+        {
+            bsf::ShmTransport transport;
+            MusicSensorClient<bsf::ShmTransport> sensorClient(
+                transport, mqttTopic, clientName,
+                createMidiOutput(midiOutput, midiApi, clientName),
+                playoutDelay, mqttTopicSync);
+            runSensorClient(transport, sensorClient);
+        }
+        else if (transportName == "udp")
+        {
+            bsf::UdpMulticastTransport transport;
+            MusicSensorClient<bsf::UdpMulticastTransport> sensorClient(
+                transport, mqttTopic, clientName,
+                createMidiOutput(midiOutput, midiApi, clientName),
+                playoutDelay, mqttTopicSync);
+            runSensorClient(transport, sensorClient);
+            if (transport.getLostCount() > 0 ||
+                transport.getReorderedCount() > 0)
+            {
+                LOG4CXX_WARN(logger, transport.getLostCount()
+                                         << " messages were lost and "
+                                         << transport.getReorderedCount()
+                                         << " arrived out of order")
+            }
+        }
+        else
+        {
+            throw std::invalid_argument("Unsupported transport '" +
+                                        transportName + "'");
+        }
     }
     catch (std::exception &e)
     {
@@ -64,7 +139,11 @@ int main(int argc, char *argv[])
 
 bool parseOptions(int argc, char *argv[], std::string &mqttServer,
                   unsigned int &mqttPort, std::string &mqttTopic,
-                  std::string &clientName, bool &debug)
+                  std::string &clientName, std::string &midiOutput,
+                  std::string &midiApi,
+                  midiendpoints::PlayoutDelay &playoutDelay,
+                  std::string &mqttTopicSync, std::string &transportName,
+                  bool &debug)
 {
     namespace po = boost::program_options;
 
@@ -75,6 +154,13 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         unsigned int port;
         std::string topic;
         std::string name;
+        std::string output;
+        std::string api;
+        unsigned int delay;
+        bool adaptiveDelay;
+        double percentile;
+        std::string topicSync;
+        std::string transportType;
         bool debugFlag;
 
         // clang-format off
@@ -85,6 +171,13 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
             ("port,p", po::value<unsigned int>(&port)->default_value(DEFAULT_PORT), "server port")
             ("topic,t", po::value<std::string>(&topic)->default_value(DEFAULT_TOPIC), "MQTT topic")
             ("name,n", po::value<std::string>(&name)->default_value(DEFAULT_CLIENT_NAME), "MQTT and MIDI client name")
+            ("output,o", po::value<std::string>(&output)->default_value(DEFAULT_OUTPUT), "MIDI output (rtmidi, jack, alsa)")
+            ("midi-api,a", po::value<std::string>(&api)->default_value(midiendpoints::DEFAULT_MIDI_API), "RtMidi API (jack, alsa, coremidi, winmm, dummy)")
+            ("playout-delay,l", po::value<unsigned int>(&delay)->default_value(DEFAULT_PLAYOUT_DELAY), "playout delay in milliseconds (initial delay if adaptive)")
+            ("adaptive-delay", po::bool_switch(&adaptiveDelay), "adapt the playout delay to the lateness of the notes")
+            ("delay-percentile", po::value<double>(&percentile)->default_value(DEFAULT_DELAY_PERCENTILE), "lateness percentile followed by the adaptive playout delay")
+            ("topic-sync,y", po::value<std::string>(&topicSync)->default_value(DEFAULT_TOPIC_SYNC), "MQTT topic for clock synchronization (empty to disable)")
+            ("transport", po::value<std::string>(&transportType)->default_value(DEFAULT_TRANSPORT), "BSF transport (mqtt, mqtt-asio, shm, udp)")
             ("debug,d", po::bool_switch(&debugFlag),"print debug messages");
         // clang-format on
 
@@ -102,6 +195,14 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         mqttPort = port;
         mqttTopic = topic;
         clientName = name;
+        midiOutput = output;
+        midiApi = api;
+        playoutDelay = midiendpoints::PlayoutDelay(
+            adaptiveDelay ? midiendpoints::PlayoutDelay::Mode::ADAPTIVE
+                          : midiendpoints::PlayoutDelay::Mode::FIXED,
+            std::chrono::milliseconds{delay}, percentile);
+        mqttTopicSync = topicSync;
+        transportName = transportType;
         debug = debugFlag;
 
         return true;
@@ -112,3 +213,54 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         return false;
     }
 }
+
+std::unique_ptr<midiendpoints::MidiOutput>
+createMidiOutput(const std::string &midiOutput, const std::string &midiApi,
+                 const std::string &clientName)
+{
+    using namespace midiendpoints;
+
+    if (midiOutput == "rtmidi")
+    {
+        return std::unique_ptr<MidiOutput>(
+            new RtMidiOutput(parseMidiApi(midiApi), clientName));
+    }
+#ifdef USE_JACK
+    if (midiOutput == "jack")
+    {
+        return std::unique_ptr<MidiOutput>(new JackMidiOutput(clientName));
+    }
+#endif
+#ifdef USE_ALSA
+    if (midiOutput == "alsa")
+    {
+        return std::unique_ptr<MidiOutput>(new AlsaSeqMidiOutput(clientName));
+    }
+#endif
+    throw std::invalid_argument("Unsupported MIDI output '" + midiOutput +
+                                "'");
+}
+
+template <typename TransportT>
+void runSensorClient(TransportT &transport,
+                     midiendpoints::MusicSensorClient<TransportT> &sensorClient)
+{
+    sensorClient.start();
+    transport.start();
+
+    // TODO make this right
+    LOG4CXX_INFO(logger, "Sending MIDI messages, press <enter> to quit...")
+    char input;
+    std::cin.get(input);
+
+    // The transport may be served by the client event loop
+    transport.stop();
+    sensorClient.stop();
+
+    if (sensorClient.getLateCount() > 0)
+    {
+        LOG4CXX_WARN(logger, sensorClient.getLateCount()
+                                 << " notes arrived too late for the"
+                                    " playout delay")
+    }
+}
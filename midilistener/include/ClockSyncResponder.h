@@ -0,0 +1,95 @@
+
+#ifndef CLOCKSYNCRESPONDER_H
+#define CLOCKSYNCRESPONDER_H
+
+#include <masmusic.pb.h>
+#include <ClockSync.h>
+#include <MidiEndpointCommon.h>
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Answers clock synchronization requests.
+//!
+//! Requests and responses share a BSF channel. Every request (a message with
+//! only the origin time) is answered with the time at which it was received
+//! and the time at which the response is sent, in microseconds since epoch, so
+//! the requester can estimate the offset between both clocks and the round
+//! trip time. Responses also carry a random identifier of the responder, so
+//! the requester can tell them apart from those of other responders.
+//!
+//! \tparam TransportT BSF transport type
+//!
+template <typename TransportT>
+class ClockSyncResponder : private ClockSyncSensorClient<TransportT>
+{
+public:
+    //! BSF transport type
+    typedef TransportT Transport;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param transport BSF transport
+    //! \param channel BSF transport channel for clock synchronization
+    //! \param clockShift Constant added to every reported time (e.g. to
+    //!                   simulate a skewed system clock)
+    //!
+    ClockSyncResponder(
+        const Transport &transport, const typename Transport::Channel &channel,
+        std::chrono::microseconds clockShift = std::chrono::microseconds{0})
+    : ClockSyncSensorClient<TransportT>(transport, channel)
+    , m_sensor(transport, channel)
+    , m_response{m_sensor.newDataReading()}
+    , m_clockShift{clockShift.count()}
+    {
+        std::random_device device;
+        m_response->set_responder(uint64_t{device()} << 32 | device());
+    }
+
+private:
+    //! Sensor for the responses
+    ClockSyncSensor<TransportT> m_sensor;
+    //! Reused response reading object
+    ClockSyncReading m_response;
+    //! Constant added to every reported time (microseconds)
+    int64_t m_clockShift;
+
+    //!
+    //! \brief Answer a received request.
+    //!
+    //! \param reading Received reading
+    //! \return true
+    //!
+    virtual bool onDataReading(const ClockSyncReading &reading)
+    {
+        auto receive = nowMicros();
+        // Responses (ours or others') are received through the same channel
+        if (reading->receive() != 0)
+        {
+            return true;
+        }
+        m_response->set_origin(reading->origin());
+        m_response->set_receive(receive);
+        m_response->set_transmit(nowMicros());
+        m_sensor.publish(m_response);
+        return true;
+    }
+
+    //! \return Current time in microseconds since epoch
+    int64_t nowMicros() const
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(
+                   system_clock::now().time_since_epoch()).count() +
+               m_clockShift;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,148 @@
+
+#ifndef JACKMIDIINPUT_H
+#define JACKMIDIINPUT_H
+
+#include <MidiEndpointCommon.h>
+#include <MidiInput.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include <cstdint>
+#include <string>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Frame-accurate MIDI input through a native JACK port.
+//!
+//! Events are read in the JACK process callback. Each event is stamped with
+//! the time of its frame (the frame time of the cycle plus the event offset),
+//! converted to microseconds by JACK's time-keeping, so the stream time does
+//! not depend on when the event was delivered. The callback hands the event
+//! bytes straight to the handler, without any intermediate buffer.
+//!
+class JackMidiInput : public MidiInput
+{
+public:
+    JackMidiInput(const JackMidiInput &) = delete;
+    JackMidiInput &operator=(const JackMidiInput &) = delete;
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param clientName JACK client name
+    //!
+    explicit JackMidiInput(const std::string &clientName)
+    : m_clientName{clientName}
+    , m_client{nullptr}
+    , m_port{nullptr}
+    , m_handler{nullptr}
+    {
+    }
+
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~JackMidiInput()
+    {
+        close();
+    }
+
+    //!
+    //! \brief Open a JACK client with a MIDI input port.
+    //!
+    //! \param portName Name of the port
+    //! \param handler Receiver of the MIDI data, until the port is closed
+    //!
+    virtual void open(const std::string &portName, MidiInputHandler &handler)
+    {
+        if (m_client != nullptr)
+        {
+            return;
+        }
+
+        jack_status_t status;
+        m_client = jack_client_open(m_clientName.c_str(), JackNoStartServer,
+                                    &status);
+        if (m_client == nullptr)
+        {
+            throw MidiEndpointException("Could not connect to the JACK server");
+        }
+        m_port = jack_port_register(m_client, portName.c_str(),
+                                    JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+        if (m_port == nullptr)
+        {
+            close();
+            throw MidiEndpointException("Could not create JACK MIDI port");
+        }
+        m_handler = &handler;
+
+        jack_set_process_callback(m_client, &JackMidiInput::processCallback,
+                                  this);
+        if (jack_activate(m_client) != 0)
+        {
+            close();
+            throw MidiEndpointException("Could not activate JACK client");
+        }
+    }
+
+    //!
+    //! \brief Close the JACK client.
+    //!
+    virtual void close()
+    {
+        if (m_client != nullptr)
+        {
+            jack_deactivate(m_client);
+            jack_client_close(m_client);
+            m_client = nullptr;
+            m_port = nullptr;
+            m_handler = nullptr;
+        }
+    }
+
+private:
+    //! JACK client name
+    std::string m_clientName;
+    //! JACK client
+    jack_client_t *m_client;
+    //! JACK MIDI input port
+    jack_port_t *m_port;
+    //! Receiver of the MIDI data
+    MidiInputHandler *m_handler;
+
+    static int processCallback(jack_nframes_t nframes, void *arg)
+    {
+        static_cast<JackMidiInput *>(arg)->process(nframes);
+        return 0;
+    }
+
+    //!
+    //! \brief Read the events received in the current cycle.
+    //!
+    //! Runs in the JACK real-time thread.
+    //!
+    //! \param nframes Number of frames in the cycle
+    //!
+    void process(jack_nframes_t nframes)
+    {
+        auto portBuffer = jack_port_get_buffer(m_port, nframes);
+        auto cycleFrame = jack_last_frame_time(m_client);
+        auto count = jack_midi_get_event_count(portBuffer);
+        for (uint32_t i = 0; i < count; i++) {
+            jack_midi_event_t event;
+            if (jack_midi_event_get(&event, portBuffer, i) != 0)
+            {
+                continue;
+            }
+            auto timeUs = jack_frames_to_time(m_client, cycleFrame + event.time);
+            m_handler->midiReceived(static_cast<double>(timeUs) * 1e-6,
+                                    event.buffer, event.size);
+        }
+    }
+};
+}
+
+#endif
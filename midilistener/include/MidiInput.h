@@ -0,0 +1,151 @@
+
+#ifndef MIDIINPUT_H
+#define MIDIINPUT_H
+
+#include <MidiEndpointCommon.h>
+
+#include <RtMidi.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Receiver of the MIDI data read by a MIDI input backend.
+//!
+class MidiInputHandler
+{
+public:
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~MidiInputHandler()
+    {
+    }
+
+    //!
+    //! \brief Callback for new MIDI data.
+    //!
+    //! Called from the MIDI thread of the backend, which may be a real-time
+    //! thread: implementations must not block or allocate memory.
+    //!
+    //! \param streamTime Time of the data in seconds, with an arbitrary origin
+    //! \param data MIDI data
+    //! \param size Number of bytes of data
+    //!
+    virtual void midiReceived(double streamTime, const unsigned char *data,
+                              std::size_t size) = 0;
+};
+
+//!
+//! \brief A MIDI input backend.
+//!
+class MidiInput
+{
+public:
+    //!
+    //! \brief Destructor.
+    //!
+    virtual ~MidiInput()
+    {
+    }
+
+    //!
+    //! \brief Open an input port.
+    //!
+    //! \param portName Name of the port
+    //! \param handler Receiver of the MIDI data, until the port is closed
+    //!
+    virtual void open(const std::string &portName,
+                      MidiInputHandler &handler) = 0;
+
+    //!
+    //! \brief Close the input port.
+    //!
+    virtual void close() = 0;
+};
+
+//!
+//! \brief MIDI input through an RtMidi virtual port.
+//!
+//! The stream time is built by accumulating the time deltas reported by
+//! RtMidi.
+//!
+class RtMidiInput : public MidiInput
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param api RtMidi API
+    //! \param clientName MIDI client identifier
+    //!
+    RtMidiInput(RtMidi::Api api, const std::string &clientName)
+    : m_midiIn(api, clientName)
+    , m_handler{nullptr}
+    , m_streamTime{0}
+    {
+    }
+
+    //!
+    //! \brief Open a virtual input port.
+    //!
+    //! \param portName Name of the port
+    //! \param handler Receiver of the MIDI data, until the port is closed
+    //!
+    virtual void open(const std::string &portName, MidiInputHandler &handler)
+    {
+        if (m_midiIn.getPortCount() < 1)
+        {
+            throw MidiEndpointException("No MIDI ports available");
+        }
+        m_midiIn.openVirtualPort(portName);
+        m_handler = &handler;
+        m_streamTime = 0;
+        m_midiIn.setCallback(RtMidiInput::forwardMidiCallback, this);
+    }
+
+    //!
+    //! \brief Close the input port.
+    //!
+    virtual void close()
+    {
+        m_midiIn.cancelCallback();
+        m_midiIn.closePort();
+        m_handler = nullptr;
+    }
+
+private:
+    //! RtMidi input
+    RtMidiIn m_midiIn;
+    //! Receiver of the MIDI data
+    MidiInputHandler *m_handler;
+    //! Accumulated MIDI time deltas (seconds), owned by the MIDI thread
+    double m_streamTime;
+
+    //!
+    //! \brief Forward a MIDI event callback to a RtMidiInput object.
+    //!
+    //! This is a wrapper for the member callback function, since RtMidi does
+    //! not allow to use bound functions as callback.
+    //!
+    //! \param timestamp time since the previous MIDI event in seconds
+    //! \param message MIDI event data
+    //! \param userData a valid pointer to a RtMidiInput
+    //!
+    static void forwardMidiCallback(double timestamp,
+                                    std::vector<unsigned char> *message,
+                                    void *userData)
+    {
+        auto input = static_cast<RtMidiInput *>(userData);
+        input->m_streamTime += timestamp;
+        input->m_handler->midiReceived(input->m_streamTime, message->data(),
+                                       message->size());
+    }
+};
+}
+
+#endif
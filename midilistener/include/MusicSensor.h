@@ -3,18 +3,25 @@
 #define MUSICSENSOR_H
 
 #include <masmusic.pb.h>
+#include <MidiClock.h>
 #include <MidiEndpointCommon.h>
+#include <MidiInput.h>
+#include <MidiParser.h>
+#include <OnsetTable.h>
 
 #include <bsf/Sensor.h>
+#include <bsf/SpscQueue.h>
+#include <bsf/Wakeup.h>
 #include <log4cxx/logger.h>
-#include <RtMidi.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <sstream>
-#include <unordered_map>
-#include <vector>
+#include <thread>
 
 namespace midiendpoints
 {
@@ -31,17 +38,26 @@ using TimeSpanNoteSensor =
 //!
 //! \brief Retransmits music messages to a BSF network.
 //!
-//! Music messages are received through a Jack MIDI port and retransmitted
+//! Music messages are received through a MIDI input backend and retransmitted
 //! into a BSF network in a protocol buffers message. The sensor retransmits
 //! two kinds of messages: instantaneous note events, which are emitted when a
 //! note starts, and spanned note events, which are emitted when the note
 //! finishes, and include the duration. Each kind of even can be published to
 //! a different channel.
 //!
+//! The MIDI callback only copies the received bytes into a preallocated
+//! lock-free queue, and wakes the publisher up if it is sleeping; parsing and
+//! publishing are performed by that dedicated thread, so the real-time MIDI
+//! thread never blocks on the network.
+//!
+//! Events are timestamped with the stream time reported by the MIDI backend,
+//! mapped to the epoch through a MidiClock, instead of the time at which they
+//! are processed.
+//!
 //! \tparam TransportT BSF transport type
 //!
 template <typename TransportT>
-class MusicSensor
+class MusicSensor : private MidiInputHandler
 {
 public:
     //! BSF transport type
@@ -54,11 +70,17 @@ public:
     //! \param channelSpanned BSF transport channel for spanned events
     //! \param channelInstant BSF transport channel for instantaneous events
     //! \param midiClientName MIDI client identifier
+    //! \param midiIn MIDI input backend
+    //! \param clockShift Constant added to every time stamp (e.g. to simulate
+    //!                   a skewed system clock)
     //!
     MusicSensor(const Transport &transport,
                 const typename Transport::Channel &channelSpanned,
                 const typename Transport::Channel &channelInstant,
-                const std::string &midiClientName);
+                const std::string &midiClientName,
+                std::unique_ptr<MidiInput> midiIn,
+                std::chrono::microseconds clockShift =
+                    std::chrono::microseconds{0});
 
     //!
     //! \brief Start the sensor.
@@ -80,37 +102,37 @@ public:
     virtual ~MusicSensor();
 
     //!
-    //! \brief Callback for new MIDI events.
+    //! \brief Get the number of MIDI events waiting to be published.
     //!
-    //! \param midiTimestamp time stamp of the MIDI event
-    //! \param message MIDI event data
-    //! \param userData user data given in the callback binding
+    //! \return Current depth of the event queue
     //!
-    void midiEventReceived(double midiTimestamp,
-                           std::vector<unsigned char> *message, void *userData);
+    std::size_t getQueueDepth() const;
 
-private:
-    enum class MidiNoteEvent
-    {
-        NONE,
-        OFF,
-        ON
-    };
-    enum class MidiParserStatus
-    {
-        WAITING,
-        NOTE,
-        VELOCITY
-    };
+    //!
+    //! \brief Get the number of MIDI events dropped because the queue was full.
+    //!
+    //! \return Number of dropped events since construction
+    //!
+    unsigned long long getOverflowCount() const;
 
+private:
     //! Maximum acceptable ON/OFF event distance
     static const unsigned int MAX_DURATION{5000};
+    //! Capacity of the MIDI event queue
+    static const std::size_t QUEUE_CAPACITY{1024};
+    //! Maximum number of bytes held by a single queued event
+    static const std::size_t RAW_EVENT_SIZE{8};
 
-    //! \brief Note start data.
-    struct Onset
+    //!
+    //! \brief Raw MIDI data received in the MIDI callback.
+    //!
+    //! Messages longer than RAW_EVENT_SIZE are split over several events.
+    //!
+    struct RawMidiEvent
     {
-        std::chrono::time_point<std::chrono::system_clock> timestamp;
-        unsigned char velocity;
+        double streamTime;
+        unsigned char size;
+        unsigned char data[RAW_EVENT_SIZE];
     };
 
     //! Sensor for spanned events
@@ -118,21 +140,29 @@ private:
     //! Sensor for instantaneous events
     TimePointNoteSensor<TransportT> m_sensorInstant;
     //! MIDI input
-    RtMidiIn m_midiIn;
+    std::unique_ptr<MidiInput> m_midiIn;
     //! MIDI client name
     std::string m_midiClientName;
-    //! Current MIDI note event
-    MidiNoteEvent m_midiNoteEvent;
-    //! Current MIDI parsing status
-    MidiParserStatus m_midiParserStatus;
+    //! MIDI stream parser
+    MidiParser m_parser;
     //! Reused spanned reading object
     TimeSpanNoteReading m_readingSpanned;
     //! Reused instantaneous reading object
     TimePointNoteReading m_readingInstant;
-    //! Current MIDI pitch value
-    int8_t m_currentPitch;
-    //! Map to keep track of event start timestamps and velocites
-    std::unordered_map<int8_t, Onset> m_startedNotes;
+    //! Table to keep track of event start timestamps and velocites
+    OnsetTable m_startedNotes;
+    //! Stream time to wall-clock time mapping, owned by the publisher thread
+    MidiClock m_clock;
+    //! Queue of MIDI events pending to be published
+    bsf::SpscQueue<RawMidiEvent> m_queue;
+    //! Number of MIDI events dropped because the queue was full
+    std::atomic<unsigned long long> m_overflowCount;
+    //! Whether the publisher thread should keep running
+    std::atomic<bool> m_publishing;
+    //! Publisher thread
+    std::thread m_publisherThread;
+    //! Wakeup of the publisher thread while the queue is empty
+    bsf::Wakeup m_wakeup;
    //! Whether the retransmitter has been started
     bool m_started;
 
@@ -145,18 +175,47 @@ private:
     }
 
     //!
-    //! \brief Forward a MIDI event callback to a MusicSensor object.
+    //! \brief Callback for new MIDI data.
+    //!
+    //! \param streamTime Time of the data in seconds
+    //! \param data MIDI data
+    //! \param size Number of bytes of data
+    //!
+    virtual void midiReceived(double streamTime, const unsigned char *data,
+                              std::size_t size);
+
+    //!
+    //! \brief Publisher thread loop.
+    //!
+    //! Drains the event queue until the sensor is stopped.
+    //!
+    void runPublisher();
+
+    //!
+    //! \brief Parse a queued MIDI event and publish the resulting readings.
+    //!
+    //! \param event Queued MIDI event
+    //!
+    void processEvent(const RawMidiEvent &event);
+
+    //!
+    //! \brief Publish the readings corresponding to a parsed MIDI event.
+    //!
+    //! \param midiEvent Parsed MIDI event
+    //! \param streamTime Stream time of the event in seconds
+    //!
+    void processMidiEvent(const MidiEvent &midiEvent, double streamTime);
+
     //!
-    //! This is a wrapper for the member callback function, since RtMidi does
-    //! not allow to use bound functions as callback.
+    //! \brief Finish a started note and publish its spanned reading.
     //!
-    //! \param timestamp time stamp of the MIDI event
-    //! \param message MIDI event data
-    //! \param userData a valid pointer to a MusicSensor
+    //! \param channel MIDI channel
+    //! \param note MIDI note
+    //! \param onset Onset of the note
+    //! \param timestampUs Time stamp of the note end in microseconds
     //!
-    static void forwardMidiCallback(double timestamp,
-                                    std::vector<unsigned char> *message,
-                                    void *userData);
+    void finishNote(uint8_t channel, uint8_t note, const Onset &onset,
+                    int64_t timestampUs);
 };
 }
 
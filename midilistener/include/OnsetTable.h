@@ -0,0 +1,150 @@
+
+#ifndef ONSETTABLE_H
+#define ONSETTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace midiendpoints
+{
+
+//! \brief Note start data.
+struct Onset
+{
+    //! Note start time stamp since epoch in microseconds
+    int64_t timestampUs;
+    //! Note velocity
+    unsigned char velocity;
+};
+
+//!
+//! \brief Table of started notes indexed by MIDI channel and note.
+//!
+//! The table is a fixed flat array with a slot for every channel and note, so
+//! lookups, insertions and removals are a single indexed access and never
+//! allocate memory. An occupancy bitmap allows iterating over the started notes
+//! without scanning the whole table.
+//!
+//! This class is not thread-safe.
+//!
+class OnsetTable
+{
+public:
+    //! Number of MIDI channels
+    static const std::size_t CHANNELS{16};
+    //! Number of MIDI notes
+    static const std::size_t NOTES{128};
+
+    //!
+    //! \brief Constructor.
+    //!
+    //! Creates an empty table.
+    //!
+    OnsetTable()
+    : m_onsets()
+    , m_occupied()
+    {
+    }
+
+    //!
+    //! \brief Find the onset of a started note.
+    //!
+    //! \param channel MIDI channel (0-15)
+    //! \param note MIDI note (0-127)
+    //! \return The onset of the note, or null if the note is not started
+    //!
+    const Onset *find(uint8_t channel, uint8_t note) const
+    {
+        channel &= CHANNELS - 1;
+        note &= NOTES - 1;
+        return (m_occupied[channel][note >> 6] & bit(note)) != 0
+                   ? &m_onsets[channel][note]
+                   : nullptr;
+    }
+
+    //!
+    //! \brief Start a note, replacing any previous onset.
+    //!
+    //! \param channel MIDI channel (0-15)
+    //! \param note MIDI note (0-127)
+    //! \param onset Note onset
+    //!
+    void insert(uint8_t channel, uint8_t note, const Onset &onset)
+    {
+        channel &= CHANNELS - 1;
+        note &= NOTES - 1;
+        m_onsets[channel][note] = onset;
+        m_occupied[channel][note >> 6] |= bit(note);
+    }
+
+    //!
+    //! \brief Remove the onset of a note.
+    //!
+    //! \param channel MIDI channel (0-15)
+    //! \param note MIDI note (0-127)
+    //!
+    void erase(uint8_t channel, uint8_t note)
+    {
+        channel &= CHANNELS - 1;
+        note &= NOTES - 1;
+        m_occupied[channel][note >> 6] &= ~bit(note);
+    }
+
+    //!
+    //! \brief Call a function for every started note in a channel.
+    //!
+    //! The function is called as `f(uint8_t note, const Onset &onset)`. It is
+    //! safe to erase notes from the table within the function.
+    //!
+    //! \param channel MIDI channel (0-15)
+    //! \param f Function to call
+    //!
+    template <typename F>
+    void forEach(uint8_t channel, F &&f) const
+    {
+        channel &= CHANNELS - 1;
+        for (std::size_t word = 0; word < WORDS; word++) {
+            auto bits = m_occupied[channel][word];
+            while (bits != 0)
+            {
+                auto note = static_cast<uint8_t>(word * 64 + lowestBit(bits));
+                bits &= bits - 1;
+                f(note, m_onsets[channel][note]);
+            }
+        }
+    }
+
+private:
+    //! Number of bitmap words per channel
+    static const std::size_t WORDS{NOTES / 64};
+
+    //! Onset data of each note in each channel
+    Onset m_onsets[CHANNELS][NOTES];
+    //! Bitmap of started notes in each channel
+    uint64_t m_occupied[CHANNELS][WORDS];
+
+    //! \return Bitmap word mask of a note
+    static uint64_t bit(uint8_t note)
+    {
+        return uint64_t{1} << (note & 63);
+    }
+
+    //! \return Index of the lowest set bit of a non-zero word
+    static unsigned int lowestBit(uint64_t bits)
+    {
+#ifdef __GNUC__
+        return static_cast<unsigned int>(__builtin_ctzll(bits));
+#else
+        unsigned int index{0};
+        while ((bits & 1) == 0)
+        {
+            bits >>= 1;
+            index++;
+        }
+        return index;
+#endif
+    }
+};
+}
+
+#endif
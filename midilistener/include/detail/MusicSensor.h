@@ -4,6 +4,7 @@
 
 #include "../MusicSensor.h"
 
+#include <cstring>
 #include <istream>
 
 namespace midiendpoints
@@ -18,17 +19,22 @@ MusicSensor<TransportT>::MusicSensor(
     const TransportT &transport,
     const typename TransportT::Channel &channelSpanned,
     const typename TransportT::Channel &channelInstant,
-    const std::string &midiClientName)
+    const std::string &midiClientName, std::unique_ptr<MidiInput> midiIn,
+    std::chrono::microseconds clockShift)
 : m_sensorSpanned(transport, channelSpanned)
 , m_sensorInstant(transport, channelInstant)
-, m_midiIn(MIDI_API, midiClientName)
+, m_midiIn(std::move(midiIn))
 , m_midiClientName{midiClientName}
-, m_midiNoteEvent(MidiNoteEvent::NONE)
-, m_midiParserStatus{MidiParserStatus::WAITING}
+, m_parser()
 , m_readingSpanned{m_sensorSpanned.newDataReading()}
 , m_readingInstant{m_sensorInstant.newDataReading()}
-, m_currentPitch{0}
 , m_startedNotes()
+, m_clock(clockShift)
+, m_queue(QUEUE_CAPACITY)
+, m_overflowCount{0}
+, m_publishing{false}
+, m_publisherThread()
+, m_wakeup()
 , m_started{false}
 {
 }
@@ -44,22 +50,23 @@ void MusicSensor<TransportT>::start()
 {
     if (!m_started)
     {
-        // Check MIDI ports
-        if (m_midiIn.getPortCount() < 1)
-        {
-            throw MidiEndpointException("No MIDI ports available");
-        }
+        m_clock.reset();
+        m_parser.reset();
 
-        // MIDI input
-        m_midiIn.openVirtualPort("midi_in");
-        m_midiIn.setCallback(MusicSensor<TransportT>::forwardMidiCallback,
-                             this);
-        // midiin->ignoreTypes( false, false, false );
+        // MIDI input, queueing events until the publisher starts
+        m_midiIn->open("midi_in", *this);
+
+        // Publisher
+        m_publishing = true;
+        m_publisherThread = std::thread([this]
+                                        {
+                                            runPublisher();
+                                        });
 
         m_started = true;
 
         LOG4CXX_INFO(logger(), "Music sensor started")
-        LOG4CXX_INFO(logger(), "Listening on Jack port '" << m_midiClientName
+        LOG4CXX_INFO(logger(), "Listening on MIDI port '" << m_midiClientName
                                     << ":midi_in'")
         LOG4CXX_INFO(logger(), "Publishing music events on MQTT channel '"
                                     << m_sensorSpanned.getChannel()
@@ -81,130 +88,194 @@ void MusicSensor<TransportT>::stop()
     {
         LOG4CXX_DEBUG(logger(), "Stopping sensor...")
         m_started = false;
-        m_midiIn.cancelCallback();
-        m_midiIn.closePort();
+        m_midiIn->close();
+        m_publishing = false;
+        m_wakeup.notify();
+        m_publisherThread.join();
         LOG4CXX_INFO(logger(), "Music sensor stopped")
     }
 }
 
 template <typename TransportT>
-void MusicSensor<TransportT>::midiEventReceived(
-    double /*midiTimestamp*/, std::vector<unsigned char> *message,
-    void * /*userData*/)
+std::size_t MusicSensor<TransportT>::getQueueDepth() const
 {
-    using namespace std::chrono;
+    return m_queue.size();
+}
 
-    LOG4CXX_DEBUG(logger(), "MIDI event received (" << message->size()
-                                                    << " bytes)")
+template <typename TransportT>
+unsigned long long MusicSensor<TransportT>::getOverflowCount() const
+{
+    return m_overflowCount.load(std::memory_order_relaxed);
+}
+
+template <typename TransportT>
+void MusicSensor<TransportT>::midiReceived(double streamTime,
+                                           const unsigned char *data,
+                                           std::size_t size)
+{
+    // Runs on the MIDI thread: no logging, locking or allocation here, and
+    // only a non-blocking write to wake the publisher up if it is sleeping
+    // Messages are queued whole, so the parser never sees a truncated one
+    if (!m_queue.hasRoom((size + RAW_EVENT_SIZE - 1) / RAW_EVENT_SIZE))
+    {
+        m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    RawMidiEvent event;
+    event.streamTime = streamTime;
+    std::size_t offset{0};
+    while (offset < size)
+    {
+        auto remaining = size - offset;
+        event.size = static_cast<unsigned char>(
+            remaining < RAW_EVENT_SIZE ? remaining : RAW_EVENT_SIZE);
+        std::memcpy(event.data, data + offset, event.size);
+        m_queue.tryPush(event);
+        offset += event.size;
+    }
+    m_wakeup.notify();
+}
 
-    for (auto messageByte : *message) {
-        // All this would probably be better done with a proper FSM
-        if ((messageByte & 0x80) != 0)
+template <typename TransportT>
+void MusicSensor<TransportT>::runPublisher()
+{
+    RawMidiEvent event;
+    bool drained{true};
+    unsigned long long reportedOverflows{0};
+    // Keep draining after stop until the queue is empty
+    while (m_publishing || !m_queue.empty())
+    {
+        if (!m_queue.tryPop(event))
         {
-            // Status byte
-            if ((messageByte & 0xF0) == 0x80)
+            if (!drained)
             {
-                m_midiNoteEvent = MidiNoteEvent::OFF;
-                m_midiParserStatus = MidiParserStatus::NOTE;
+                // Sample the clocks once per batch of events
+                m_clock.correct(event.streamTime);
+                drained = true;
             }
-            else if ((messageByte & 0xF0) == 0x90)
+            // Sleep until an event is queued or the sensor stopped
+            m_wakeup.prepareWait();
+            if (m_publishing && m_queue.empty())
             {
-                m_midiNoteEvent = MidiNoteEvent::ON;
-                m_midiParserStatus = MidiParserStatus::NOTE;
+                m_wakeup.wait();
             }
             else
             {
-                m_midiNoteEvent = MidiNoteEvent::NONE;
-                m_midiParserStatus = MidiParserStatus::WAITING;
+                m_wakeup.cancelWait();
             }
+            continue;
         }
-        else if (m_midiNoteEvent != MidiNoteEvent::NONE)
+        processEvent(event);
+        drained = false;
+
+        auto overflows = getOverflowCount();
+        if (overflows != reportedOverflows)
         {
-            // Data byte
-            switch (m_midiParserStatus)
-            {
-            case MidiParserStatus::NOTE:
-            {
-                m_currentPitch = messageByte;
-                m_midiParserStatus = MidiParserStatus::VELOCITY;
-                break;
-            }
-            case MidiParserStatus::VELOCITY:
-            {
-                // Get time stamp
-                auto timestamp = system_clock::now();
-                auto timestampMs = duration_cast<milliseconds>(
-                                       timestamp.time_since_epoch()).count();
-
-                // Either ON or OFF, send spanned event if pitch was ON
-                auto previous = m_startedNotes.find(m_currentPitch);
-                if (previous != m_startedNotes.end())
-                {
-                    // Compute note timestamp and duration in milliseconds
-                    auto previousTimestamp = previous->second.timestamp;
-                    auto previousMs =
-                        duration_cast<milliseconds>(
-                            previousTimestamp.time_since_epoch()).count();
-                    auto durationMs =
-                        static_cast<unsigned int>(timestampMs - previousMs);
-                    // Fill spanned reading data
-                    auto previousVelocity = previous->second.velocity;
-                    midiToPitch(m_currentPitch,
-                                m_readingSpanned->mutable_pitch());
-                    m_readingSpanned->set_timestamp(previousMs);
-                    m_readingSpanned->set_velocity(previousVelocity);
-                    m_readingSpanned->set_duration(durationMs);
-                    // Remove previous onset
-                    m_startedNotes.erase(previous);
-                    if (durationMs <= MAX_DURATION)
-                    {
-                        // Publish message
-                        LOG4CXX_DEBUG(
-                            logger(),
-                            "Publishing spanned message:\n"
-                                << m_readingSpanned->ShortDebugString())
-                        m_sensorSpanned.publish(m_readingSpanned);
-                    }
-                }
-
-                if (m_midiNoteEvent == MidiNoteEvent::ON && messageByte > 0)
-                {
-                    // Fill instant reading data
-                    midiToPitch(m_currentPitch,
-                                m_readingInstant->mutable_pitch());
-                    m_readingInstant->set_timestamp(timestampMs);
-                    m_readingInstant->set_velocity(messageByte);
-                    // Save onset data
-                    m_startedNotes[m_currentPitch] = {timestamp, messageByte};
-                    // Publish message
-                    LOG4CXX_DEBUG(logger(),
-                                  "Publishing instant message:\n"
-                                      << m_readingInstant->ShortDebugString())
-                    m_sensorInstant.publish(m_readingInstant);
-                }
-
-                m_midiParserStatus = MidiParserStatus::NOTE;
-                break;
-            }
-            default:
-                LOG4CXX_WARN(LOG, "Inconsistent MIDI parser status")
-            }
+            LOG4CXX_WARN(logger(), "MIDI event queue overflow, "
+                                       << overflows - reportedOverflows
+                                       << " events dropped")
+            reportedOverflows = overflows;
         }
     }
 }
 
 template <typename TransportT>
-void MusicSensor<TransportT>::forwardMidiCallback(
-    double timestamp, std::vector<unsigned char> *message, void *userData)
+void MusicSensor<TransportT>::processEvent(const RawMidiEvent &event)
 {
-    auto retransmitter = static_cast<MusicSensor<TransportT> *>(userData);
-    if (retransmitter)
+    LOG4CXX_DEBUG(logger(), "MIDI event received (" << (int) event.size
+                                                    << " bytes, "
+                                                    << m_queue.size()
+                                                    << " queued)")
+
+    m_parser.parse(event.data, event.data + event.size,
+                   [this, &event](const MidiEvent *events, std::size_t count)
+                   {
+                       for (std::size_t i = 0; i < count; i++) {
+                           processMidiEvent(events[i], event.streamTime);
+                       }
+                   });
+}
+
+template <typename TransportT>
+void MusicSensor<TransportT>::processMidiEvent(const MidiEvent &midiEvent,
+                                               double streamTime)
+{
+    switch (midiEvent.type)
+    {
+    case MidiEventType::NOTE_ON:
+    case MidiEventType::NOTE_OFF:
     {
-        retransmitter->midiEventReceived(timestamp, message, userData);
+        auto channel = midiEvent.channel;
+        auto note = midiEvent.data1;
+        auto velocity = midiEvent.data2;
+
+        // Get time stamp
+        auto timestampUs = m_clock.toEpochMicros(streamTime);
+
+        // Either ON or OFF, send spanned event if pitch was ON
+        auto previous = m_startedNotes.find(channel, note);
+        if (previous)
+        {
+            finishNote(channel, note, *previous, timestampUs);
+        }
+
+        if (midiEvent.type == MidiEventType::NOTE_ON)
+        {
+            // Fill instant reading data
+            midiToPitch(note, m_readingInstant->mutable_pitch());
+            m_readingInstant->set_timestamp(timestampUs / 1000);
+            m_readingInstant->set_velocity(velocity);
+            // Save onset data
+            m_startedNotes.insert(channel, note, {timestampUs, velocity});
+            // Publish message
+            LOG4CXX_DEBUG(logger(), "Publishing instant message:\n"
+                                        << m_readingInstant->ShortDebugString())
+            m_sensorInstant.publish(m_readingInstant);
+        }
+        break;
     }
-    else
+    case MidiEventType::CONTROL_CHANGE:
+    {
+        // All sound off (120) and all notes off (123) finish every note
+        if (midiEvent.data1 == 120 || midiEvent.data1 == 123)
+        {
+            auto channel = midiEvent.channel;
+            auto timestampUs = m_clock.toEpochMicros(streamTime);
+            m_startedNotes.forEach(
+                channel, [this, channel, timestampUs](uint8_t note,
+                                                      const Onset &onset)
+                {
+                    finishNote(channel, note, onset, timestampUs);
+                });
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+template <typename TransportT>
+void MusicSensor<TransportT>::finishNote(uint8_t channel, uint8_t note,
+                                         const Onset &onset,
+                                         int64_t timestampUs)
+{
+    // Compute note timestamp and duration in milliseconds
+    auto durationMs = static_cast<unsigned int>(
+        (timestampUs - onset.timestampUs + 500) / 1000);
+    // Fill spanned reading data
+    midiToPitch(note, m_readingSpanned->mutable_pitch());
+    m_readingSpanned->set_timestamp(onset.timestampUs / 1000);
+    m_readingSpanned->set_velocity(onset.velocity);
+    m_readingSpanned->set_duration(durationMs);
+    // Remove onset
+    m_startedNotes.erase(channel, note);
+    if (durationMs <= MAX_DURATION)
     {
-        LOG4CXX_ERROR(LOG, "Invalid pointer in MIDI event callback")
+        // Publish message
+        LOG4CXX_DEBUG(logger(), "Publishing spanned message:\n"
+                                    << m_readingSpanned->ShortDebugString())
+        m_sensorSpanned.publish(m_readingSpanned);
     }
 }
 }
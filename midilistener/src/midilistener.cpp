@@ -1,11 +1,21 @@
 
+#include "ClockSyncResponder.h"
 #include "MidiEndpointCommon.h"
+#include "MidiInput.h"
 #include "MusicSensor.h"
+#ifdef USE_JACK
+#include "JackMidiInput.h"
+#endif
 
 #include <bsf/AsyncMqttTransport.h>
+#include <bsf/ShmTransport.h>
+#include <bsf/UdpMulticastTransport.h>
 #include <boost/program_options.hpp>
 #include <log4cxx/logger.h>
 
+#include <chrono>
+#include <cstddef>
+#include <memory>
 #include <stdexcept>
 
 static const char *DEFAULT_SERVER = "localhost";
@@ -13,13 +23,33 @@ static const unsigned int DEFAULT_PORT = 1883;
 static const char *DEFAULT_TOPIC = "music";
 static const char *DEFAULT_TOPIC_INSTANT = "music-instant";
 static const char *DEFAULT_CLIENT_NAME = "midilistener";
+static const char *DEFAULT_INPUT = "rtmidi";
+static const char *DEFAULT_TOPIC_SYNC = "music-sync";
+static const int DEFAULT_CLOCK_OFFSET = 0;
+static const std::size_t DEFAULT_PUBLISH_QUEUE = 0;
+static const char *DEFAULT_TRANSPORT = "mqtt";
+static const unsigned int DEFAULT_REDUNDANCY = 0;
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("midilistener"));
 
 bool parseOptions(int argc, char *argv[], std::string &mqttServer,
                   unsigned int &mqttPort, std::string &mqttTopic,
                   std::string &mqttTopicInstant, std::string &clientName,
-                  bool &debug);
+                  std::string &midiInput, std::string &midiApi,
+                  std::string &mqttTopicSync, int &clockOffset,
+                  std::size_t &publishQueue, std::string &transportName,
+                  unsigned int &redundancy, bool &debug);
+
+std::unique_ptr<midiendpoints::MidiInput>
+createMidiInput(const std::string &midiInput, const std::string &midiApi,
+                const std::string &clientName);
+
+template <typename TransportT>
+void runSensor(TransportT &transport, const std::string &mqttTopic,
+               const std::string &mqttTopicInstant,
+               const std::string &clientName, const std::string &midiInput,
+               const std::string &midiApi, const std::string &mqttTopicSync,
+               std::chrono::milliseconds clockShift);
 
 int main(int argc, char *argv[])
 {
@@ -30,10 +60,19 @@ int main(int argc, char *argv[])
     std::string clientName;
     std::string mqttTopicInstant;
     std::string mqttTopic;
+    std::string midiInput;
+    std::string midiApi;
+    std::string mqttTopicSync;
+    int clockOffset;
+    std::size_t publishQueue;
+    std::string transportName;
+    unsigned int redundancy;
     bool debug;
 
     if (!parseOptions(argc, argv, mqttServer, mqttPort, mqttTopic,
-                      mqttTopicInstant, clientName, debug))
+                      mqttTopicInstant, clientName, midiInput, midiApi,
+                      mqttTopicSync, clockOffset, publishQueue, transportName,
+                      redundancy, debug))
     {
         return 0;
     }
@@ -42,21 +81,39 @@ int main(int argc, char *argv[])
 
     try
     {
-        bsf::AsyncMqttTransport transport(clientName, mqttServer, mqttPort,
-                                          MQTT_QOS);
-        MusicSensor<bsf::AsyncMqttTransport> sensor(
-            transport, mqttTopic, mqttTopicInstant, clientName);
-
-        transport.start();
-        sensor.start();
-
-        // TODO make this right
-        LOG4CXX_INFO(logger, "Reading MIDI input, press <enter> to quit...")
-        char input;
-        std::cin.get(input);
-
-        sensor.stop();
-        transport.stop();
+        std::chrono::milliseconds clockShift{clockOffset};
+        if (transportName == "mqtt")
+        {
+            bsf::AsyncMqttTransport transport(clientName, mqttServer, mqttPort,
+                                              MQTT_QOS);
+            transport.setAsyncPublish(publishQueue);
+            runSensor(transport, mqttTopic, mqttTopicInstant, clientName,
+                      midiInput, midiApi, mqttTopicSync, clockShift);
+        }
+        else if (transportName == "shm")
+        {
+            bsf::ShmTransport transport;
+            runSensor(transport, mqttTopic, mqttTopicInstant, clientName,
+                      midiInput, midiApi, mqttTopicSync, clockShift);
+        }
+        else if (transportName == "udp")
+        {
+            bsf::UdpMulticastTransport transport;
+            // Notes are published when they finish, so losing one loses it
+            transport.setRedundancy(mqttTopic, redundancy);
+            runSensor(transport, mqttTopic, mqttTopicInstant, clientName,
+                      midiInput, midiApi, mqttTopicSync, clockShift);
+            if (transport.getDroppedCount() > 0)
+            {
+                LOG4CXX_WARN(logger, transport.getDroppedCount()
+                                         << " messages could not be sent")
+            }
+        }
+        else
+        {
+            throw std::invalid_argument("Unsupported transport '" +
+                                        transportName + "'");
+        }
     }
     catch (std::exception &e)
     {
@@ -69,7 +126,10 @@ int main(int argc, char *argv[])
 bool parseOptions(int argc, char *argv[], std::string &mqttServer,
                   unsigned int &mqttPort, std::string &mqttTopic,
                   std::string &mqttTopicInstant, std::string &clientName,
-                  bool &debug)
+                  std::string &midiInput, std::string &midiApi,
+                  std::string &mqttTopicSync, int &clockOffset,
+                  std::size_t &publishQueue, std::string &transportName,
+                  unsigned int &redundancy, bool &debug)
 {
     namespace po = boost::program_options;
 
@@ -81,6 +141,13 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         std::string topic;
         std::string topicInstant;
         std::string name;
+        std::string input;
+        std::string api;
+        std::string topicSync;
+        int offset;
+        std::size_t queue;
+        std::string transportType;
+        unsigned int redundancyDepth;
         bool debugFlag;
 
         // clang-format off
@@ -92,6 +159,13 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
             ("topic,t", po::value<std::string>(&topic)->default_value(DEFAULT_TOPIC), "MQTT topic for music messages")
             ("topic-instant,r", po::value<std::string>(&topicInstant)->default_value(DEFAULT_TOPIC_INSTANT), "MQTT topic for instant music messages")
             ("name,n", po::value<std::string>(&name)->default_value(DEFAULT_CLIENT_NAME), "MQTT and MIDI client name")
+            ("input,i", po::value<std::string>(&input)->default_value(DEFAULT_INPUT), "MIDI input (rtmidi, jack)")
+            ("midi-api,a", po::value<std::string>(&api)->default_value(midiendpoints::DEFAULT_MIDI_API), "RtMidi API (jack, alsa, coremidi, winmm, dummy)")
+            ("topic-sync,y", po::value<std::string>(&topicSync)->default_value(DEFAULT_TOPIC_SYNC), "MQTT topic for clock synchronization (empty to disable)")
+            ("clock-offset", po::value<int>(&offset)->default_value(DEFAULT_CLOCK_OFFSET), "artificial clock offset in milliseconds, for testing")
+            ("publish-queue", po::value<std::size_t>(&queue)->default_value(DEFAULT_PUBLISH_QUEUE), "capacity of the asynchronous MQTT publish queue (0 to publish synchronously)")
+            ("transport", po::value<std::string>(&transportType)->default_value(DEFAULT_TRANSPORT), "BSF transport (mqtt, shm, udp)")
+            ("redundancy", po::value<unsigned int>(&redundancyDepth)->default_value(DEFAULT_REDUNDANCY), "previous music messages repeated in every UDP datagram")
             ("debug,d", po::bool_switch(&debugFlag),"print debug messages");
         // clang-format on
 
@@ -110,6 +184,13 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         mqttTopic = topic;
         mqttTopicInstant = topicInstant;
         clientName = name;
+        midiInput = input;
+        midiApi = api;
+        mqttTopicSync = topicSync;
+        clockOffset = offset;
+        publishQueue = queue;
+        transportName = transportType;
+        redundancy = redundancyDepth;
         debug = debugFlag;
 
         return true;
@@ -120,3 +201,62 @@ bool parseOptions(int argc, char *argv[], std::string &mqttServer,
         return false;
     }
 }
+
+std::unique_ptr<midiendpoints::MidiInput>
+createMidiInput(const std::string &midiInput, const std::string &midiApi,
+                const std::string &clientName)
+{
+    using namespace midiendpoints;
+
+    if (midiInput == "rtmidi")
+    {
+        return std::unique_ptr<MidiInput>(
+            new RtMidiInput(parseMidiApi(midiApi), clientName));
+    }
+#ifdef USE_JACK
+    if (midiInput == "jack")
+    {
+        return std::unique_ptr<MidiInput>(new JackMidiInput(clientName));
+    }
+#endif
+    throw std::invalid_argument("Unsupported MIDI input '" + midiInput + "'");
+}
+
+template <typename TransportT>
+void runSensor(TransportT &transport, const std::string &mqttTopic,
+               const std::string &mqttTopicInstant,
+               const std::string &clientName, const std::string &midiInput,
+               const std::string &midiApi, const std::string &mqttTopicSync,
+               std::chrono::milliseconds clockShift)
+{
+    using namespace midiendpoints;
+
+    MusicSensor<TransportT> sensor(
+        transport, mqttTopic, mqttTopicInstant, clientName,
+        createMidiInput(midiInput, midiApi, clientName), clockShift);
+    std::unique_ptr<ClockSyncResponder<TransportT>> responder;
+    if (!mqttTopicSync.empty())
+    {
+        responder.reset(new ClockSyncResponder<TransportT>(
+            transport, mqttTopicSync, clockShift));
+        LOG4CXX_INFO(logger, "Answering clock synchronization on MQTT"
+                             " channel '" << mqttTopicSync << "'")
+    }
+
+    transport.start();
+    sensor.start();
+
+    // TODO make this right
+    LOG4CXX_INFO(logger, "Reading MIDI input, press <enter> to quit...")
+    char input;
+    std::cin.get(input);
+
+    sensor.stop();
+    transport.stop();
+
+    if (sensor.getOverflowCount() > 0)
+    {
+        LOG4CXX_WARN(logger, sensor.getOverflowCount()
+                                 << " MIDI events were dropped")
+    }
+}
@@ -0,0 +1,205 @@
+
+//
+// Stress test of the handler tables of AbstractTransport, read through RcuCell
+// snapshots.
+//
+// Several threads deliver messages as fast as possible, while others keep
+// adding and removing handlers in the same channels, some of which remove
+// themselves from within the delivery. Every handler checks that the state it
+// captured is still alive, and permanent handlers check that no message is
+// lost while the tables change. Meant to be run under ThreadSanitizer or
+// AddressSanitizer.
+//
+
+#include <bsf/AbstractTransport.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const unsigned int DELIVERERS{4};
+static const unsigned int CHURNERS{4};
+static const unsigned int CHURN_ROUNDS{2000};
+static const char *CHANNELS[] = {"stress/a", "stress/b"};
+
+//!
+//! \brief Transport delivering the published messages synchronously.
+//!
+class DirectTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    virtual void publish(const std::vector<unsigned char> &message,
+                         const std::string &channel)
+    {
+        callHandlers(bsf::ByteSpan(message), channel);
+    }
+};
+
+//!
+//! \brief State captured by a transient handler.
+//!
+struct HandlerState
+{
+    //! Magic value, overwritten when the state is destroyed
+    std::atomic<unsigned int> magic;
+    //! Number of calls
+    std::atomic<unsigned long> calls;
+
+    HandlerState()
+    : magic{ALIVE}
+    , calls{0}
+    {
+    }
+
+    ~HandlerState()
+    {
+        magic = 0;
+    }
+
+    //! Value of the magic while alive
+    static const unsigned int ALIVE{0x5EEDF00D};
+};
+
+//! Number of handler calls on destroyed state
+static std::atomic<unsigned long> deadCalls{0};
+
+//!
+//! \brief Check the state of a handler on a call.
+//!
+//! \param state Handler state
+//!
+static void touch(HandlerState &state)
+{
+    if (state.magic != HandlerState::ALIVE)
+    {
+        deadCalls++;
+    }
+    state.calls++;
+}
+
+//!
+//! \brief Keep adding and removing handlers.
+//!
+//! \param transport Transport
+//! \param churner Churner number
+//!
+static void churn(DirectTransport &transport, unsigned int churner)
+{
+    for (unsigned int i = 0; i < CHURN_ROUNDS; i++) {
+        std::string channel = CHANNELS[(churner + i) % 2];
+        auto state = std::make_shared<HandlerState>();
+        if (i % 4 == 0)
+        {
+            // Handler removing itself on its first call once registered
+            auto token = std::make_shared<std::atomic<bsf::HandlerToken>>(0);
+            auto registered = std::make_shared<std::atomic<bool>>(false);
+            auto removed = std::make_shared<std::atomic<bool>>(false);
+            *token = transport.addSpanHandler(
+                [&transport, state, token, registered, removed,
+                 channel](bsf::ByteSpan)
+                {
+                    touch(*state);
+                    if (*registered && !removed->exchange(true))
+                    {
+                        transport.removeHandler(*token, channel);
+                    }
+                },
+                channel);
+            *registered = true;
+        }
+        else
+        {
+            auto token = transport.addSpanHandler([state](bsf::ByteSpan)
+                                                  {
+                                                      touch(*state);
+                                                  },
+                                                  channel);
+            std::this_thread::yield();
+            transport.removeHandler(token, channel);
+        }
+    }
+}
+
+int main()
+{
+    DirectTransport transport;
+
+    // Permanent handlers, counting every message of a channel
+    std::atomic<unsigned long> received[2];
+    for (unsigned int c = 0; c < 2; c++) {
+        received[c] = 0;
+        auto counter = &received[c];
+        transport.addSpanHandler([counter](bsf::ByteSpan)
+                                 {
+                                     (*counter)++;
+                                 },
+                                 CHANNELS[c]);
+    }
+    // Wildcard handler, counting the messages of both channels
+    std::atomic<unsigned long> receivedAll{0};
+    transport.addSpanHandler([&receivedAll](bsf::ByteSpan)
+                             {
+                                 receivedAll++;
+                             },
+                             "stress/#");
+
+    std::atomic<bool> stopping{false};
+    std::atomic<unsigned long> published[2];
+    published[0] = 0;
+    published[1] = 0;
+    std::vector<std::thread> deliverers;
+    for (unsigned int d = 0; d < DELIVERERS; d++) {
+        deliverers.emplace_back([&, d]
+                                {
+                                    std::vector<unsigned char> message(16, d);
+                                    for (unsigned int i = d; !stopping; i++) {
+                                        transport.publish(message,
+                                                          CHANNELS[i % 2]);
+                                        published[i % 2]++;
+                                    }
+                                });
+    }
+
+    std::vector<std::thread> churners;
+    for (unsigned int c = 0; c < CHURNERS; c++) {
+        churners.emplace_back([&transport, c]
+                              {
+                                  churn(transport, c);
+                              });
+    }
+    for (auto &churner : churners) {
+        churner.join();
+    }
+    stopping = true;
+    for (auto &deliverer : deliverers) {
+        deliverer.join();
+    }
+
+    auto succeeded = true;
+    if (deadCalls != 0)
+    {
+        std::cerr << deadCalls << " handler calls on destroyed state"
+                  << std::endl;
+        succeeded = false;
+    }
+    for (unsigned int c = 0; c < 2; c++) {
+        if (received[c] != published[c])
+        {
+            std::cerr << received[c] << " messages received in "
+                      << CHANNELS[c] << " out of " << published[c]
+                      << std::endl;
+            succeeded = false;
+        }
+    }
+    if (receivedAll != published[0] + published[1])
+    {
+        std::cerr << receivedAll << " messages received in stress/# out of "
+                  << published[0] + published[1] << std::endl;
+        succeeded = false;
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+
+//
+// Unit test of the channel table and of the channel dispatch of
+// AbstractTransport.
+//
+// Checks that channels get consecutive identifiers that survive the growth of
+// the table, that channels with colliding hashes are told apart, that lookups
+// by null-terminated strings match string channels, and that removing the
+// last handler of a channel and adding it again reuses its identifier.
+//
+
+#include <bsf/AbstractTransport.h>
+#include <bsf/ChannelTable.h>
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const unsigned int CHANNELS{1000};
+static const unsigned int COLLIDING_CHANNELS{100};
+
+//!
+//! \brief Channel whose hash is the same for every value.
+//!
+struct CollidingChannel
+{
+    //! Value
+    unsigned int value;
+
+    bool operator==(const CollidingChannel &other) const
+    {
+        return value == other.value;
+    }
+};
+
+namespace std
+{
+
+//! \brief Constant hash of colliding channels.
+template <>
+struct hash<CollidingChannel>
+{
+    std::size_t operator()(const CollidingChannel &) const
+    {
+        return 42;
+    }
+};
+}
+
+//!
+//! \brief Transport delivering the published messages synchronously and
+//!        counting the channel notifications.
+//!
+class DirectTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    //! Number of channels notified as used
+    unsigned int usedCount;
+    //! Number of channels notified as dropped
+    unsigned int droppedCount;
+
+    DirectTransport()
+    : usedCount{0}
+    , droppedCount{0}
+    {
+    }
+
+    using bsf::AbstractTransport<std::string>::findChannel;
+    using bsf::AbstractTransport<std::string>::getChannelsInUse;
+
+    virtual void publish(const std::vector<unsigned char> &message,
+                         const std::string &channel)
+    {
+        callHandlers(bsf::ByteSpan(message), channel.c_str());
+    }
+
+protected:
+    virtual void useChannel(const std::string &)
+    {
+        usedCount++;
+    }
+
+    virtual void dropChannel(const std::string &)
+    {
+        droppedCount++;
+    }
+};
+
+//!
+//! \brief Check a condition.
+//!
+//! \param condition Condition
+//! \param description Description of the condition
+//! \return The condition
+//!
+static bool check(bool condition, const char *description)
+{
+    if (!condition)
+    {
+        std::cerr << "Failed: " << description << std::endl;
+    }
+    return condition;
+}
+
+//!
+//! \brief Check interning string channels.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkStrings()
+{
+    bsf::ChannelTable<std::string> table;
+    auto consecutive = true;
+    for (unsigned int i = 0; i < CHANNELS; i++) {
+        consecutive &= table.intern("channel/" + std::to_string(i)) == i;
+    }
+    auto found = true;
+    for (unsigned int i = 0; i < CHANNELS; i++) {
+        auto channel = "channel/" + std::to_string(i);
+        found &= table.intern(channel) == i && table.find(channel) == i &&
+                 table.find(channel.c_str()) == i && table.get(i) == channel;
+    }
+
+    auto succeeded = true;
+    succeeded &= check(consecutive, "identifiers are consecutive");
+    succeeded &= check(found, "channels are found after growing");
+    succeeded &= check(table.size() == CHANNELS, "channels are interned once");
+    succeeded &= check(table.find("channel/") == bsf::INVALID_CHANNEL_ID &&
+                           table.find(std::string("other")) ==
+                               bsf::INVALID_CHANNEL_ID,
+                       "unknown channels are not found");
+    succeeded &= check(table.intern("") == CHANNELS &&
+                           table.find("") == CHANNELS,
+                       "the empty channel is a channel");
+    return succeeded;
+}
+
+//!
+//! \brief Check interning channels with colliding hashes.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkCollisions()
+{
+    bsf::ChannelTable<CollidingChannel> table;
+    for (unsigned int i = 0; i < COLLIDING_CHANNELS; i++) {
+        table.intern(CollidingChannel{i});
+    }
+    auto found = true;
+    for (unsigned int i = 0; i < COLLIDING_CHANNELS; i++) {
+        found &= table.find(CollidingChannel{i}) == i &&
+                 table.get(i).value == i;
+    }
+
+    auto succeeded = true;
+    succeeded &= check(found, "colliding channels are told apart");
+    succeeded &= check(table.size() == COLLIDING_CHANNELS,
+                       "colliding channels are interned once");
+    succeeded &= check(table.find(CollidingChannel{COLLIDING_CHANNELS}) ==
+                           bsf::INVALID_CHANNEL_ID,
+                       "unknown colliding channels are not found");
+    return succeeded;
+}
+
+//!
+//! \brief Check removing the handlers of a channel.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkRemoval()
+{
+    DirectTransport transport;
+    unsigned int calls{0};
+    auto handler = [&calls](bsf::ByteSpan)
+    {
+        calls++;
+    };
+    std::vector<unsigned char> message{0};
+    auto succeeded = true;
+
+    auto first = transport.addSpanHandler(handler, "a");
+    auto second = transport.addSpanHandler(handler, "a");
+    auto id = transport.findChannel("a");
+    transport.publish(message, "a");
+    succeeded &= check(calls == 2 && transport.usedCount == 1,
+                       "every handler of a channel is called");
+
+    transport.removeHandler(first, "b");
+    transport.removeHandler(first + second + 1, "a");
+    transport.publish(message, "a");
+    succeeded &= check(calls == 4,
+                       "removing unknown handlers has no effect");
+
+    transport.removeHandler(first, "a");
+    transport.removeHandler(second, "a");
+    transport.publish(message, "a");
+    succeeded &= check(calls == 4 && transport.droppedCount == 1 &&
+                           transport.getChannelsInUse().empty(),
+                       "removed handlers are not called");
+
+    transport.addSpanHandler(handler, "a");
+    transport.publish(message, "a");
+    succeeded &= check(calls == 5 && transport.usedCount == 2 &&
+                           transport.findChannel("a") == id,
+                       "channels keep their identifier once unused");
+    return succeeded;
+}
+
+int main()
+{
+    auto succeeded = checkStrings();
+    succeeded &= checkCollisions();
+    succeeded &= checkRemoval();
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
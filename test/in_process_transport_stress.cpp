@@ -0,0 +1,284 @@
+
+//
+// Test of the in-process transport, in synchronous and queued mode.
+//
+// Checks the delivery to exact and wildcard channels, publishing again from
+// within a handler, stopping while the delivery thread sleeps, the dropped
+// count of a full queue, and, as a stress, several threads publishing at once
+// while a handler republishes part of the messages. Meant to be run under
+// ThreadSanitizer or AddressSanitizer.
+//
+
+#include <bsf/InProcessTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const unsigned int PUBLISHERS{4};
+static const unsigned int MESSAGES_PER_PUBLISHER{20000};
+static const std::size_t QUEUE_CAPACITY{64};
+//! Longest time a queued message may take to be delivered (milliseconds)
+static const int64_t DELIVERY_TIMEOUT_MS{5000};
+
+//!
+//! \brief Check a condition.
+//!
+//! \param condition Condition
+//! \param description Description of the condition
+//! \return The condition
+//!
+static bool check(bool condition, const char *description)
+{
+    if (!condition)
+    {
+        std::cerr << "Failed: " << description << std::endl;
+    }
+    return condition;
+}
+
+//!
+//! \brief Wait until a condition holds.
+//!
+//! \param condition Condition
+//! \return Whether the condition held before the delivery timeout
+//!
+template <typename ConditionT>
+static bool waitFor(ConditionT condition)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds{DELIVERY_TIMEOUT_MS};
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return true;
+}
+
+//!
+//! \brief Check the delivery to channels and from within handlers.
+//!
+//! \param queueCapacity Capacity of the delivery queue, or zero
+//! \return Whether the checks passed
+//!
+static bool checkDelivery(std::size_t queueCapacity)
+{
+    auto succeeded = true;
+    bsf::InProcessTransport transport(queueCapacity);
+    std::mutex mutex;
+    std::vector<unsigned char> exact;
+    std::vector<unsigned char> wildcard;
+    std::atomic<unsigned int> replies{0};
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 exact.push_back(message.data()[0]);
+                             },
+                             "test/a");
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 wildcard.push_back(message.data()[0]);
+                             },
+                             "test/+");
+    // Re-entrant publication
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 std::vector<unsigned char> reply{
+                                     message.data()[0]};
+                                 transport.publish(reply, "rpc/reply");
+                             },
+                             "rpc/request");
+    transport.addSpanHandler([&](bsf::ByteSpan)
+                             {
+                                 replies++;
+                             },
+                             "rpc/reply");
+
+    std::vector<unsigned char> message{0};
+    transport.publish(message, "test/a");
+    succeeded &= check(exact.empty(), "messages published while stopped are "
+                                      "discarded");
+    transport.start();
+    for (unsigned char i = 1; i <= 3; i++) {
+        message[0] = i;
+        transport.publish(message, "test/a");
+    }
+    message[0] = 4;
+    transport.publish(message, "test/b");
+    message[0] = 5;
+    transport.publish(message, "other/a");
+    for (auto i = 0; i < 3; i++) {
+        transport.publish(message, "rpc/request");
+    }
+    succeeded &= check(waitFor([&]
+                               {
+                                   std::lock_guard<std::mutex> lock(mutex);
+                                   return wildcard.size() >= 4 &&
+                                          replies == 3;
+                               }),
+                       "every message is delivered");
+    transport.stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    succeeded &= check(exact == std::vector<unsigned char>{1, 2, 3},
+                       "exact channels get their messages in order");
+    succeeded &= check(wildcard == std::vector<unsigned char>{1, 2, 3, 4},
+                       "wildcard channels get the matching messages");
+    succeeded &= check(replies == 3, "handlers may publish");
+    return succeeded;
+}
+
+//!
+//! \brief Check stopping the transport while the delivery thread sleeps.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkStopWhileIdle()
+{
+    auto succeeded = true;
+    bsf::InProcessTransport transport(QUEUE_CAPACITY);
+    std::atomic<unsigned int> delivered{0};
+    transport.addSpanHandler([&](bsf::ByteSpan)
+                             {
+                                 delivered++;
+                             },
+                             "test");
+    transport.start();
+    // Long enough for the delivery thread to go to sleep
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    std::vector<unsigned char> message{0};
+    transport.publish(message, "test");
+    succeeded &= check(waitFor([&]
+                               {
+                                   return delivered == 1;
+                               }),
+                       "a sleeping delivery thread is woken up");
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    auto stopping = std::chrono::steady_clock::now();
+    transport.stop();
+    succeeded &= check(std::chrono::steady_clock::now() - stopping <
+                           std::chrono::milliseconds{DELIVERY_TIMEOUT_MS},
+                       "a sleeping delivery thread is stopped");
+    return succeeded;
+}
+
+//!
+//! \brief Check the messages dropped with the delivery queue full.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkDropped()
+{
+    auto succeeded = true;
+    bsf::InProcessTransport transport(2);
+    std::atomic<bool> blocked{false};
+    std::atomic<bool> released{false};
+    std::atomic<unsigned int> delivered{0};
+    transport.addSpanHandler([&](bsf::ByteSpan)
+                             {
+                                 blocked = true;
+                                 while (!released)
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                                 delivered++;
+                             },
+                             "test");
+    transport.start();
+    std::vector<unsigned char> message{0};
+    transport.publish(message, "test");
+    succeeded &= check(waitFor([&]
+                               {
+                                   return blocked.load();
+                               }),
+                       "the first message is being delivered");
+    // The message being delivered keeps its slot until the handlers return
+    for (auto i = 0; i < 4; i++) {
+        transport.publish(message, "test");
+    }
+    succeeded &= check(transport.getQueuedCount() == 2 &&
+                           transport.getDroppedCount() == 3,
+                       "messages are dropped with the queue full");
+    released = true;
+    // Queued messages are delivered before stopping
+    transport.stop();
+    succeeded &= check(delivered == 2, "queued messages are delivered");
+    return succeeded;
+}
+
+//!
+//! \brief Publish from several threads at once.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkConcurrentPublishers()
+{
+    bsf::InProcessTransport transport(QUEUE_CAPACITY);
+    std::atomic<unsigned long> delivered{0};
+    std::atomic<unsigned long> republished{0};
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 delivered++;
+                                 if (message.data()[0] == 0)
+                                 {
+                                     std::vector<unsigned char> again{1};
+                                     transport.publish(again, "stress");
+                                     republished++;
+                                 }
+                             },
+                             "stress");
+    transport.start();
+    std::vector<std::thread> publishers;
+    for (unsigned int p = 0; p < PUBLISHERS; p++) {
+        publishers.emplace_back([&transport, p]
+                                {
+                                    std::vector<unsigned char> message{0};
+                                    for (unsigned int i = 0;
+                                         i < MESSAGES_PER_PUBLISHER; i++) {
+                                        message[0] = static_cast<unsigned char>(
+                                            (i + p) % 16);
+                                        transport.publish(message, "stress");
+                                    }
+                                });
+    }
+    for (auto &publisher : publishers) {
+        publisher.join();
+    }
+    // Republished messages would be discarded once stopped, so every message
+    // must have been handled before
+    unsigned long published{PUBLISHERS * MESSAGES_PER_PUBLISHER};
+    auto handled = waitFor([&]
+                           {
+                               return delivered + transport.getDroppedCount() ==
+                                      published + republished;
+                           });
+    transport.stop();
+
+    if (!handled)
+    {
+        std::cerr << delivered << " messages delivered and "
+                  << transport.getDroppedCount() << " dropped out of "
+                  << published + republished << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    auto succeeded = checkDelivery(0);
+    succeeded &= checkDelivery(QUEUE_CAPACITY);
+    succeeded &= checkStopWhileIdle();
+    succeeded &= checkDropped();
+    succeeded &= checkConcurrentPublishers();
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+
+//
+// Unit test of the MIDI stream parser.
+//
+// Every case feeds a byte stream to a fresh parser, whole and one byte at a
+// time, and compares the parsed events with the expected ones. The cases cover
+// running status, real-time bytes interleaved within messages, SysEx and
+// system common messages, note on messages with zero velocity and batching.
+//
+
+#include "MidiParser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace midiendpoints;
+
+//!
+//! \brief A byte stream and the events it must be parsed into.
+//!
+struct Case
+{
+    //! Description of the case
+    const char *description;
+    //! Byte stream
+    std::vector<unsigned char> stream;
+    //! Expected events
+    std::vector<MidiEvent> events;
+};
+
+namespace midiendpoints
+{
+
+//!
+//! \brief Compare two events.
+//!
+static bool operator==(const MidiEvent &a, const MidiEvent &b)
+{
+    return a.type == b.type && a.channel == b.channel && a.data1 == b.data1 &&
+           a.data2 == b.data2;
+}
+}
+
+//!
+//! \brief Parse a stream in pieces of a given size.
+//!
+//! \param stream Byte stream
+//! \param piece Size of the pieces fed to the parser
+//! \param batches Set to the size of every batch passed to the sink
+//! \return The parsed events
+//!
+static std::vector<MidiEvent> parse(const std::vector<unsigned char> &stream,
+                                    std::size_t piece,
+                                    std::vector<std::size_t> &batches)
+{
+    MidiParser parser;
+    std::vector<MidiEvent> events;
+    for (std::size_t offset = 0; offset < stream.size(); offset += piece) {
+        auto end = std::min(offset + piece, stream.size());
+        parser.parse(stream.data() + offset, stream.data() + end,
+                     [&](const MidiEvent *batch, std::size_t count)
+                     {
+                         events.insert(events.end(), batch, batch + count);
+                         batches.push_back(count);
+                     });
+    }
+    return events;
+}
+
+int main()
+{
+    const auto ON = MidiEventType::NOTE_ON;
+    const auto OFF = MidiEventType::NOTE_OFF;
+    std::vector<Case> cases{
+        {"note on", {0x90, 60, 100}, {{ON, 0, 60, 100}}},
+        {"note on with zero velocity", {0x93, 60, 0}, {{OFF, 3, 60, 0}}},
+        {"running status",
+         {0x90, 60, 100, 62, 90, 60, 0},
+         {{ON, 0, 60, 100}, {ON, 0, 62, 90}, {OFF, 0, 60, 0}}},
+        {"one data byte messages with running status",
+         {0xC5, 5, 6, 0xD1, 64},
+         {{MidiEventType::PROGRAM_CHANGE, 5, 5, 0},
+          {MidiEventType::PROGRAM_CHANGE, 5, 6, 0},
+          {MidiEventType::CHANNEL_PRESSURE, 1, 64, 0}}},
+        {"every two data byte message type",
+         {0x8F, 60, 64, 0xA2, 60, 10, 0xB4, 7, 127, 0xE1, 0, 64},
+         {{OFF, 15, 60, 64},
+          {MidiEventType::POLY_PRESSURE, 2, 60, 10},
+          {MidiEventType::CONTROL_CHANGE, 4, 7, 127},
+          {MidiEventType::PITCH_BEND, 1, 0, 64}}},
+        {"interleaved real-time bytes",
+         {0xF8, 0x90, 0xFE, 60, 0xF8, 100, 0xFA, 62, 0xFF, 90},
+         {{ON, 0, 60, 100}, {ON, 0, 62, 90}}},
+        {"real-time bytes within a one data byte message",
+         {0xC0, 0xF8, 3},
+         {{MidiEventType::PROGRAM_CHANGE, 0, 3, 0}}},
+        {"SysEx cancels running status",
+         {0x90, 60, 100, 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7, 62, 90},
+         {{ON, 0, 60, 100}}},
+        {"SysEx ended by a status byte",
+         {0xF0, 0x01, 0x02, 0x90, 60, 100},
+         {{ON, 0, 60, 100}}},
+        {"real-time bytes within SysEx",
+         {0xF0, 0x01, 0xF8, 0x02, 0xF7, 0x80, 60, 0},
+         {{OFF, 0, 60, 0}}},
+        {"system common messages cancel running status",
+         {0x90, 60, 100, 0xF2, 0x10, 0x20, 62, 90, 0xF3, 1, 62, 90, 0xF6, 62,
+          90},
+         {{ON, 0, 60, 100}}},
+        {"data bytes without status", {60, 100, 0xF7, 62}, {}},
+        {"status byte interrupting a message",
+         {0x90, 60, 0x80, 62, 0},
+         {{OFF, 0, 62, 0}}},
+    };
+
+    // More events than fit in a batch
+    Case batched{"batching", {0x90}, {}};
+    for (unsigned int i = 0; i < 3 * MidiParser::BATCH_SIZE + 1; i++) {
+        auto note = static_cast<uint8_t>(i % 128);
+        batched.stream.push_back(note);
+        batched.stream.push_back(100);
+        batched.events.push_back({ON, 0, note, 100});
+    }
+    cases.push_back(batched);
+
+    auto succeeded = true;
+    for (const auto &c : cases) {
+        for (std::size_t piece : {c.stream.size(), std::size_t{1}}) {
+            std::vector<std::size_t> batches;
+            auto events = parse(c.stream, piece, batches);
+            auto batchesFit = true;
+            for (auto count : batches) {
+                batchesFit &= count > 0 && count <= MidiParser::BATCH_SIZE;
+            }
+            if (events != c.events || !batchesFit)
+            {
+                std::cerr << c.description << " (pieces of " << piece
+                          << " bytes): " << events.size() << " events parsed"
+                          << " instead of " << c.events.size() << std::endl;
+                succeeded = false;
+            }
+        }
+    }
+
+    // Reset discards running status
+    MidiParser parser;
+    std::size_t parsed{0};
+    auto count = [&](const MidiEvent *, std::size_t n)
+    {
+        parsed += n;
+    };
+    const unsigned char first[] = {0x90, 60};
+    const unsigned char second[] = {100, 62, 90};
+    parser.parse(first, first + sizeof(first), count);
+    parser.reset();
+    parser.parse(second, second + sizeof(second), count);
+    if (parsed != 0)
+    {
+        std::cerr << "reset: " << parsed << " events parsed" << std::endl;
+        succeeded = false;
+    }
+
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
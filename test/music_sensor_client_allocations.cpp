@@ -0,0 +1,241 @@
+
+//
+// Check that Sensor::publish and the MusicSensorClient work without allocating
+// memory.
+//
+// Notes are published through a synchronous in-process transport, and every
+// allocation made by a counted thread is counted by a replaced global operator
+// new. Once a first series of notes has warmed up the serialization buffers,
+// publishing a second series on a channel without clients must not allocate
+// anything on the publishing thread. Likewise, once a first series of notes
+// has warmed up the scheduler pool and the message buffers, playing a second
+// series must not allocate anything on the thread running the client strand.
+//
+
+#include "MidiEndpointCommon.h"
+#include "MidiOutput.h"
+#include "MusicSensorClient.h"
+
+#include <bsf/InProcessTransport.h>
+#include <bsf/Sensor.h>
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+
+using namespace midiendpoints;
+
+typedef bsf::Sensor<bsf::InProcessTransport, TimeSpanNoteReading,
+                    TimeSpanNoteSerializer, TimeSpanNoteReadingFactory>
+    NoteSensor;
+
+static const unsigned int NOTES{2000};
+static const char *CHANNEL = "music";
+//! Channel without clients
+static const char *UNHEARD_CHANNEL = "music/unheard";
+
+//! Allocations made by the counted thread
+static std::atomic<unsigned long> allocationCount{0};
+//! Whether the allocations of the current thread are counted
+static thread_local bool countAllocations{false};
+
+void *operator new(std::size_t size)
+{
+    if (countAllocations)
+    {
+        allocationCount++;
+    }
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+//!
+//! \brief MIDI output counting the played notes.
+//!
+class CountingMidiOutput : public MidiOutput
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param noteOffCount Counter of the note off messages sent
+    //!
+    explicit CountingMidiOutput(std::atomic<unsigned long> &noteOffCount)
+    : m_noteOffCount(noteOffCount)
+    {
+    }
+
+    virtual void open(const std::string &)
+    {
+    }
+
+    virtual void close()
+    {
+    }
+
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point)
+    {
+        for (const auto &message : batch) {
+            if ((message.data[0] & 0xF0) == 0x80)
+            {
+                m_noteOffCount++;
+            }
+        }
+    }
+
+    virtual Clock::duration lookahead() const
+    {
+        return Clock::duration::zero();
+    }
+
+private:
+    //! Counter of the note off messages sent
+    std::atomic<unsigned long> &m_noteOffCount;
+};
+
+//!
+//! \brief Set a note reading.
+//!
+//! \param reading Note reading
+//! \param i Index of the note
+//!
+static void setNote(TimeSpanNoteReading &reading, unsigned int i)
+{
+    using namespace std::chrono;
+
+    auto now =
+        duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+    reading->set_timestamp(now.count());
+    reading->mutable_pitch()->set_octave(4);
+    reading->mutable_pitch()->set_note(static_cast<masmusic::Note>(i % 12));
+    reading->set_velocity(DEFAULT_VELOCITY);
+    reading->set_duration(1);
+    reading->set_instrument(0);
+}
+
+//!
+//! \brief Publish notes, counting the allocations made by the sensor.
+//!
+//! \param sensor Note sensor
+//! \return Number of allocations made by the sensor
+//!
+static unsigned long publishNotes(NoteSensor &sensor)
+{
+    auto reading = sensor.newDataReading();
+    auto before = allocationCount.load();
+    for (unsigned int i = 0; i < NOTES; i++) {
+        setNote(reading, i);
+        countAllocations = true;
+        sensor.publish(reading);
+        countAllocations = false;
+    }
+    return allocationCount - before;
+}
+
+//!
+//! \brief Publish notes and wait until they have all been played.
+//!
+//! \param sensor Note sensor
+//! \param played Counter of the notes played
+//! \return Whether every note was played
+//!
+static bool playNotes(NoteSensor &sensor,
+                      const std::atomic<unsigned long> &played)
+{
+    using namespace std::chrono;
+
+    auto expected = played + NOTES;
+    auto reading = sensor.newDataReading();
+    for (unsigned int i = 0; i < NOTES; i++) {
+        setNote(reading, i);
+        sensor.publish(reading);
+        std::this_thread::sleep_for(microseconds{100});
+    }
+
+    auto deadline = steady_clock::now() + seconds{10};
+    while (played < expected && steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(milliseconds{1});
+    }
+    return played >= expected;
+}
+
+int main()
+{
+    // Debug messages are formatted, and so allocate, when enabled
+    configureLogging();
+
+    std::atomic<unsigned long> played{0};
+    asio::io_service asio;
+    bsf::InProcessTransport transport;
+    MusicSensorClient<bsf::InProcessTransport> client(
+        transport, CHANNEL, "allocations",
+        std::unique_ptr<MidiOutput>(new CountingMidiOutput(played)), asio);
+    client.start();
+    transport.start();
+
+    // Published before the client thread is counted
+    NoteSensor unheardSensor(transport, UNHEARD_CHANNEL);
+    publishNotes(unheardSensor);
+    auto publishAllocations = publishNotes(unheardSensor);
+    if (publishAllocations != 0)
+    {
+        std::cerr << publishAllocations << " allocations made publishing "
+                  << NOTES << " notes" << std::endl;
+        transport.stop();
+        client.stop();
+        return EXIT_FAILURE;
+    }
+
+    // The client thread is the only one running the service
+    asio.post([]
+              {
+                  countAllocations = true;
+              });
+
+    NoteSensor sensor(transport, CHANNEL);
+    if (!playNotes(sensor, played))
+    {
+        std::cerr << "Warm-up notes were not played" << std::endl;
+        return EXIT_FAILURE;
+    }
+    allocationCount = 0;
+    if (!playNotes(sensor, played))
+    {
+        std::cerr << "Notes were not played" << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto allocations = allocationCount.load();
+
+    transport.stop();
+    client.stop();
+
+    if (allocations != 0 || client.getDroppedCount() != 0)
+    {
+        std::cerr << allocations << " allocations made playing " << NOTES
+                  << " notes (" << client.getDroppedCount() << " dropped)"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
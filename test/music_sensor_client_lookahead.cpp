@@ -0,0 +1,172 @@
+
+//
+// Check that the MusicSensorClient does not leave notes playing with an output
+// that takes messages ahead of their time.
+//
+// A note is scheduled far enough ahead for its note on to be handed to the
+// output before its note off, and then a note of the same pitch is scheduled
+// to start and end before it. Replaying the messages received by the output in
+// time order, as the output plays them, no note may be left playing.
+//
+
+#include "MidiEndpointCommon.h"
+#include "MidiOutput.h"
+#include "MusicSensorClient.h"
+
+#include <bsf/InProcessTransport.h>
+#include <bsf/Sensor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace midiendpoints;
+
+typedef bsf::Sensor<bsf::InProcessTransport, TimeSpanNoteReading,
+                    TimeSpanNoteSerializer, TimeSpanNoteReadingFactory>
+    NoteSensor;
+
+static const char *CHANNEL = "music";
+//! Lookahead of the output, as the ALSA sequencer output (milliseconds)
+static const int64_t LOOKAHEAD_MS{1000};
+//! Playout delay (milliseconds)
+static const int64_t DELAY_MS{900};
+
+//! \brief A MIDI message with the time at which it is due.
+struct TimedMessage
+{
+    //! Time at which the message is due
+    MidiOutput::Clock::time_point time;
+    //! Message
+    MidiMessage message;
+};
+
+//!
+//! \brief MIDI output recording the messages sent, with a lookahead.
+//!
+class RecordingMidiOutput : public MidiOutput
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param messages Recorded messages, in the order they are sent
+    //!
+    explicit RecordingMidiOutput(std::vector<TimedMessage> &messages)
+    : m_messages(messages)
+    {
+    }
+
+    virtual void open(const std::string &)
+    {
+    }
+
+    virtual void close()
+    {
+    }
+
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point time)
+    {
+        for (const auto &message : batch) {
+            m_messages.push_back({time, message});
+        }
+    }
+
+    virtual Clock::duration lookahead() const
+    {
+        return std::chrono::milliseconds{LOOKAHEAD_MS};
+    }
+
+private:
+    //! Recorded messages
+    std::vector<TimedMessage> &m_messages;
+};
+
+//!
+//! \brief Publish a note.
+//!
+//! \param sensor Note sensor
+//! \param age How long before now the note started
+//! \param duration Note duration
+//!
+static void publishNote(NoteSensor &sensor, std::chrono::milliseconds age,
+                        std::chrono::milliseconds duration)
+{
+    using namespace std::chrono;
+
+    auto now =
+        duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+    auto reading = sensor.newDataReading();
+    reading->set_timestamp((now - age).count());
+    reading->mutable_pitch()->set_octave(4);
+    reading->mutable_pitch()->set_note(masmusic::C);
+    reading->set_velocity(DEFAULT_VELOCITY);
+    reading->set_duration(duration.count());
+    reading->set_instrument(0);
+    sensor.publish(reading);
+}
+
+int main()
+{
+    using namespace std::chrono;
+
+    configureLogging();
+
+    std::vector<TimedMessage> messages;
+    bsf::InProcessTransport transport;
+    MusicSensorClient<bsf::InProcessTransport> client(
+        transport, CHANNEL, "lookahead",
+        std::unique_ptr<MidiOutput>(new RecordingMidiOutput(messages)),
+        PlayoutDelay(PlayoutDelay::Mode::FIXED, milliseconds{DELAY_MS}, 0));
+    client.start();
+    transport.start();
+
+    NoteSensor sensor(transport, CHANNEL);
+    // Played from 900 to 1500 ms; its note on is handed over at once
+    publishNote(sensor, milliseconds{0}, milliseconds{600});
+    std::this_thread::sleep_for(milliseconds{500});
+    // Played from 600 to 800 ms, before the first note starts
+    publishNote(sensor, milliseconds{DELAY_MS - 100}, milliseconds{200});
+    std::this_thread::sleep_for(milliseconds{1500});
+
+    transport.stop();
+    client.stop();
+
+    // Play the messages in time order, as the output does
+    std::stable_sort(messages.begin(), messages.end(),
+                     [](const TimedMessage &a, const TimedMessage &b)
+                     {
+                         return a.time < b.time;
+                     });
+    unsigned int noteOns{0};
+    bool playing[16][128] = {};
+    for (const auto &timed : messages) {
+        const auto &data = timed.message.data;
+        auto &note = playing[data[0] & 0x0F][data[1] & 0x7F];
+        if ((data[0] & 0xF0) == 0x90)
+        {
+            noteOns++;
+            note = true;
+        }
+        else if ((data[0] & 0xF0) == 0x80)
+        {
+            note = false;
+        }
+    }
+    auto stuck = 0;
+    for (const auto &channel : playing) {
+        stuck += static_cast<int>(std::count(channel, channel + 128, true));
+    }
+
+    if (noteOns != 2 || stuck != 0)
+    {
+        std::cerr << noteOns << " notes played, " << stuck
+                  << " left playing" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+
+//
+// Stress test of the hand-off of received notes to the MusicSensorClient
+// strand.
+//
+// Several producers publish notes through a synchronous in-process transport,
+// so the client decodes them on every producer thread at once and pushes them
+// into its lock-free queue, while its strand schedules and plays them. Some
+// rounds stop the client while notes are still being received. Meant to be run
+// under ThreadSanitizer.
+//
+
+#include "MidiEndpointCommon.h"
+#include "MidiOutput.h"
+#include "MusicSensorClient.h"
+
+#include <bsf/InProcessTransport.h>
+#include <bsf/Sensor.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace midiendpoints;
+
+typedef bsf::Sensor<bsf::InProcessTransport, TimeSpanNoteReading,
+                    TimeSpanNoteSerializer, TimeSpanNoteReadingFactory>
+    NoteSensor;
+
+static const unsigned int ROUNDS{8};
+static const unsigned int PRODUCERS{4};
+static const unsigned int NOTES_PER_PRODUCER{2000};
+static const char *CHANNEL = "music";
+
+//!
+//! \brief MIDI output counting the played notes.
+//!
+class CountingMidiOutput : public MidiOutput
+{
+public:
+    //!
+    //! \brief Constructor.
+    //!
+    //! \param noteOnCount Counter of the note on messages sent
+    //!
+    explicit CountingMidiOutput(std::atomic<unsigned long> &noteOnCount)
+    : m_noteOnCount(noteOnCount)
+    {
+    }
+
+    virtual void open(const std::string &)
+    {
+    }
+
+    virtual void close()
+    {
+    }
+
+    virtual void send(const MidiMessageBatch &batch, Clock::time_point)
+    {
+        for (const auto &message : batch) {
+            if ((message.data[0] & 0xF0) == 0x90)
+            {
+                m_noteOnCount++;
+            }
+        }
+    }
+
+    virtual Clock::duration lookahead() const
+    {
+        return Clock::duration::zero();
+    }
+
+private:
+    //! Counter of the note on messages sent
+    std::atomic<unsigned long> &m_noteOnCount;
+};
+
+//!
+//! \brief Publish notes as fast as possible.
+//!
+//! \param transport Transport
+//! \param producer Producer number
+//!
+static void produce(const bsf::InProcessTransport &transport,
+                    unsigned int producer)
+{
+    using namespace std::chrono;
+
+    NoteSensor sensor(transport, CHANNEL);
+    auto reading = sensor.newDataReading();
+    for (unsigned int i = 0; i < NOTES_PER_PRODUCER; i++) {
+        auto now = duration_cast<milliseconds>(
+            system_clock::now().time_since_epoch());
+        reading->set_timestamp(now.count());
+        reading->mutable_pitch()->set_octave(4);
+        reading->mutable_pitch()->set_note(
+            static_cast<masmusic::Note>((producer + i) % 12));
+        reading->set_velocity(DEFAULT_VELOCITY);
+        reading->set_duration(1);
+        reading->set_instrument(producer);
+        sensor.publish(reading);
+    }
+}
+
+//!
+//! \brief Wait until a condition holds, for ten seconds at most.
+//!
+//! \param condition Condition
+//!
+template <typename F>
+static void waitFor(F condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    while (!condition() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds{100});
+    }
+}
+
+//!
+//! \brief Run a round of the test.
+//!
+//! \param stopEarly Stop the client while notes are being received
+//! \return Whether the round succeeded
+//!
+static bool runRound(bool stopEarly)
+{
+    std::atomic<unsigned long> played{0};
+    bsf::InProcessTransport transport;
+    MusicSensorClient<bsf::InProcessTransport> client(
+        transport, CHANNEL, "stress",
+        std::unique_ptr<MidiOutput>(new CountingMidiOutput(played)));
+    client.start();
+    transport.start();
+
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&transport, p]
+                               {
+                                   produce(transport, p);
+                               });
+    }
+    if (stopEarly)
+    {
+        // Stop while notes are being received and played
+        waitFor([&played]
+                {
+                    return played > 0;
+                });
+        client.stop();
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    // Every note received while started is either played or dropped
+    unsigned long total{PRODUCERS * NOTES_PER_PRODUCER};
+    if (!stopEarly)
+    {
+        waitFor([&]
+                {
+                    return played + client.getDroppedCount() >= total;
+                });
+    }
+    transport.stop();
+    client.stop();
+
+    auto accounted = played + client.getDroppedCount();
+    if (stopEarly ? accounted > total : accounted != total)
+    {
+        std::cerr << "Round " << (stopEarly ? "stopping early" : "to the end")
+                  << ": " << played << " notes played and "
+                  << client.getDroppedCount() << " dropped out of " << total
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    configureLogging();
+
+    auto succeeded = true;
+    for (unsigned int round = 0; round < ROUNDS; round++) {
+        succeeded = runRound(round % 2 == 1) && succeeded;
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+
+//
+// Check the overflow policies of the queue of messages published while the
+// MQTT transport is disconnected.
+//
+// The queue is checked on its own for the order of the kept messages, and
+// through a transport whose broker cannot be reached for the queued and
+// dropped counts.
+//
+
+#include <bsf/AsyncMqttTransport.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef bsf::AsyncMqttTransport::OverflowPolicy OverflowPolicy;
+
+static const char *CHANNEL = "offline";
+//! Port where no MQTT broker is listening
+static const unsigned int CLOSED_PORT{1};
+
+//!
+//! \brief Check a condition.
+//!
+//! \param condition Condition
+//! \param description Description of the condition
+//! \return The condition
+//!
+static bool check(bool condition, const char *description)
+{
+    if (!condition)
+    {
+        std::cerr << "Failed: " << description << std::endl;
+    }
+    return condition;
+}
+
+//!
+//! \brief Pop every message of a queue.
+//!
+//! \param queue Queue
+//! \return The first byte of every message, oldest first
+//!
+static std::vector<unsigned char> popAll(bsf::detail::OfflineQueue &queue)
+{
+    std::vector<unsigned char> contents;
+    std::string channel;
+    std::vector<unsigned char> message;
+    while (queue.pop(channel, message))
+    {
+        contents.push_back(message.at(0));
+    }
+    return contents;
+}
+
+//!
+//! \brief Check the queue on its own.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkQueue()
+{
+    auto succeeded = true;
+    std::vector<unsigned char> message{0};
+
+    bsf::detail::OfflineQueue oldest(3);
+    for (unsigned char i = 0; i < 5; i++) {
+        message[0] = i;
+        succeeded &= check(oldest.push(CHANNEL, message,
+                                       OverflowPolicy::DROP_OLDEST) == (i < 3),
+                           "drop-oldest push reports drops");
+    }
+    succeeded &= check(popAll(oldest) == std::vector<unsigned char>{2, 3, 4},
+                       "drop-oldest keeps the newest messages in order");
+
+    bsf::detail::OfflineQueue newest(3);
+    for (unsigned char i = 0; i < 5; i++) {
+        message[0] = i;
+        succeeded &= check(newest.push(CHANNEL, message,
+                                       OverflowPolicy::DROP_NEWEST) == (i < 3),
+                           "drop-newest push reports drops");
+    }
+    succeeded &= check(popAll(newest) == std::vector<unsigned char>{0, 1, 2},
+                       "drop-newest keeps the oldest messages in order");
+
+    // Wrap the ring around before shrinking it
+    bsf::detail::OfflineQueue resized(3);
+    for (unsigned char i = 0; i < 5; i++) {
+        message[0] = i;
+        resized.push(CHANNEL, message, OverflowPolicy::DROP_OLDEST);
+    }
+    succeeded &= check(resized.resize(2) == 1, "shrinking drops the oldest");
+    succeeded &= check(resized.size() == 2, "shrinking keeps the newest");
+    succeeded &= check(resized.resize(4) == 0, "growing drops nothing");
+    message[0] = 5;
+    resized.push(CHANNEL, message, OverflowPolicy::DROP_NEWEST);
+    succeeded &= check(popAll(resized) == std::vector<unsigned char>{3, 4, 5},
+                       "resizing keeps the order");
+
+    bsf::detail::OfflineQueue empty(0);
+    succeeded &= check(!empty.push(CHANNEL, message,
+                                   OverflowPolicy::DROP_OLDEST),
+                       "a queue without capacity drops every message");
+    succeeded &= check(empty.size() == 0, "a queue without capacity is empty");
+    return succeeded;
+}
+
+//!
+//! \brief Check the counts of a disconnected transport.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkTransport()
+{
+    auto succeeded = true;
+    std::vector<unsigned char> message{0};
+
+    bsf::AsyncMqttTransport transport("offline_queue", "127.0.0.1",
+                                      CLOSED_PORT, 0);
+    transport.setOfflineQueue(3, OverflowPolicy::DROP_NEWEST);
+    transport.start();
+    for (auto i = 0; i < 5; i++) {
+        transport.publish(message, CHANNEL);
+    }
+    succeeded &= check(transport.getQueuedCount() == 3 &&
+                           transport.getDroppedCount() == 2,
+                       "drop-newest counts");
+
+    transport.setOfflineQueue(1, OverflowPolicy::DROP_OLDEST);
+    succeeded &= check(transport.getQueuedCount() == 1 &&
+                           transport.getDroppedCount() == 4,
+                       "shrinking counts the dropped messages");
+    for (auto i = 0; i < 2; i++) {
+        transport.publish(message, CHANNEL);
+    }
+    succeeded &= check(transport.getQueuedCount() == 1 &&
+                           transport.getDroppedCount() == 6,
+                       "drop-oldest counts");
+    transport.stop();
+    return succeeded;
+}
+
+int main()
+{
+    auto succeeded = checkQueue();
+    succeeded &= checkTransport();
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
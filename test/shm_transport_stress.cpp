@@ -0,0 +1,242 @@
+
+//
+// Stress test of the shared memory ring with several publishing processes.
+//
+// Child processes publish messages of varying size into a small ring as fast
+// as possible, so that publishers keep lapping each other, while the parent
+// receives them. Every message carries its publisher, its number and a payload
+// derived from both, so the parent detects any message mixing the data of two
+// publications. Once the publishers are done, a final message checks that the
+// receiver did not get stuck on a dropped publication.
+//
+
+#include <bsf/ShmTransport.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const unsigned int PUBLISHERS{4};
+static const unsigned int MESSAGES_PER_PUBLISHER{200000};
+static const std::size_t SLOT_COUNT{8};
+static const std::size_t SLOT_SIZE{256};
+static const char *CHANNEL = "stress";
+//! Publisher number of the final message
+static const uint32_t FINAL{0xFFFFFFFF};
+
+//!
+//! \brief Payload byte of a message.
+//!
+//! \param publisher Publisher number
+//! \param number Message number
+//! \param index Byte index
+//! \return The byte
+//!
+static unsigned char payloadByte(uint32_t publisher, uint32_t number,
+                                 std::size_t index)
+{
+    return static_cast<unsigned char>(publisher * 31 + number + index);
+}
+
+//!
+//! \brief Build a message.
+//!
+//! \param publisher Publisher number
+//! \param number Message number
+//! \return The message
+//!
+static std::vector<unsigned char> makeMessage(uint32_t publisher,
+                                              uint32_t number)
+{
+    auto size = 2 * sizeof(uint32_t) + number * 7 % (SLOT_SIZE - 7);
+    std::vector<unsigned char> message(size);
+    std::memcpy(&message[0], &publisher, sizeof(publisher));
+    std::memcpy(&message[sizeof(publisher)], &number, sizeof(number));
+    for (auto i = 2 * sizeof(uint32_t); i < size; i++) {
+        message[i] = payloadByte(publisher, number, i);
+    }
+    return message;
+}
+
+//!
+//! \brief Check a received message.
+//!
+//! \param message Message
+//! \param publisher Set to the publisher number
+//! \param number Set to the message number
+//! \return Whether the message is intact
+//!
+static bool checkMessage(bsf::ByteSpan message, uint32_t &publisher,
+                         uint32_t &number)
+{
+    if (message.size() < 2 * sizeof(uint32_t))
+    {
+        return false;
+    }
+    std::memcpy(&publisher, message.data(), sizeof(publisher));
+    std::memcpy(&number, message.data() + sizeof(publisher), sizeof(number));
+    if (publisher == FINAL)
+    {
+        return message.size() == 2 * sizeof(uint32_t);
+    }
+    if (publisher >= PUBLISHERS ||
+        message.size() != makeMessage(publisher, number).size())
+    {
+        return false;
+    }
+    for (auto i = 2 * sizeof(uint32_t); i < message.size(); i++) {
+        if (message.data()[i] != payloadByte(publisher, number, i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief Publish the messages of a child process.
+//!
+//! \param name Transport namespace
+//! \param publisher Publisher number
+//! \param go Pipe closed by the parent once it is receiving
+//! \param dropped Shared counter of the dropped messages
+//!
+static void publish(const std::string &name, uint32_t publisher, int go,
+                    std::atomic<uint64_t> *dropped)
+{
+    bsf::ShmTransport transport(name, SLOT_COUNT, SLOT_SIZE);
+    transport.start();
+    char byte;
+    while (read(go, &byte, 1) < 0 && errno == EINTR)
+    {
+    }
+    for (uint32_t number = 0; number < MESSAGES_PER_PUBLISHER; number++) {
+        transport.publish(makeMessage(publisher, number), CHANNEL);
+    }
+    *dropped += transport.getDroppedCount();
+    transport.stop();
+}
+
+int main()
+{
+    auto name = "bsfstress" + std::to_string(getpid());
+    int go[2];
+    if (pipe(go) != 0)
+    {
+        std::cerr << "Could not create pipe" << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto dropped = static_cast<std::atomic<uint64_t> *>(
+        mmap(nullptr, sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (dropped == MAP_FAILED)
+    {
+        std::cerr << "Could not map counter" << std::endl;
+        return EXIT_FAILURE;
+    }
+    new (dropped) std::atomic<uint64_t>(0);
+
+    // The publishers are forked before any thread is started
+    std::vector<pid_t> children;
+    for (uint32_t p = 0; p < PUBLISHERS; p++) {
+        auto pid = fork();
+        if (pid == 0)
+        {
+            close(go[1]);
+            publish(name, p, go[0], dropped);
+            _exit(EXIT_SUCCESS);
+        }
+        children.push_back(pid);
+    }
+    close(go[0]);
+
+    std::atomic<unsigned long> received{0};
+    std::atomic<unsigned long> torn{0};
+    std::atomic<unsigned long> reordered{0};
+    std::atomic<bool> finished{false};
+    std::vector<int64_t> last(PUBLISHERS, -1);
+    bsf::ShmTransport transport(name, SLOT_COUNT, SLOT_SIZE);
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 uint32_t publisher;
+                                 uint32_t number;
+                                 if (!checkMessage(message, publisher, number))
+                                 {
+                                     torn++;
+                                 }
+                                 else if (publisher == FINAL)
+                                 {
+                                     finished = true;
+                                 }
+                                 else
+                                 {
+                                     received++;
+                                     // Publications of a process are ordered
+                                     if (number <= last[publisher])
+                                     {
+                                         reordered++;
+                                     }
+                                     last[publisher] = number;
+                                 }
+                             },
+                             CHANNEL);
+    transport.start();
+    // The receiver only gets the messages published after it started
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    close(go[1]);
+
+    auto succeeded = true;
+    for (auto pid : children) {
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS)
+        {
+            std::cerr << "Publisher " << pid << " failed" << std::endl;
+            succeeded = false;
+        }
+    }
+
+    std::vector<unsigned char> final(2 * sizeof(uint32_t));
+    std::memcpy(&final[0], &FINAL, sizeof(FINAL));
+    transport.publish(final, CHANNEL);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    while (!finished && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    transport.stop();
+    shm_unlink(("/" + name + "." + CHANNEL).c_str());
+
+    if (!finished)
+    {
+        std::cerr << "Final message not received" << std::endl;
+        succeeded = false;
+    }
+    if (torn != 0 || reordered != 0)
+    {
+        std::cerr << torn << " torn and " << reordered
+                  << " reordered messages out of " << received << " received"
+                  << std::endl;
+        succeeded = false;
+    }
+    unsigned long published{PUBLISHERS * MESSAGES_PER_PUBLISHER};
+    if (received + dropped->load() > published)
+    {
+        std::cerr << received << " messages received and " << *dropped
+                  << " dropped out of " << published << std::endl;
+        succeeded = false;
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+
+//
+// Unit test of the MQTT-style topic filters of TopicTrie and of the wildcard
+// channels of AbstractTransport.
+//
+// Every topic is matched against a set of filters and the matching ones are
+// compared with the expected ones. The filters cover '+' and '#' levels, empty
+// levels, and topics starting with '$', which first-level wildcards do not
+// match. Through a transport, removing the handlers of a wildcard channel must
+// stop the delivery of the matching messages.
+//
+
+#include <bsf/AbstractTransport.h>
+#include <bsf/TopicTrie.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//!
+//! \brief A topic and the filters it must match.
+//!
+struct Case
+{
+    //! Topic
+    std::string topic;
+    //! Expected matching filters, sorted
+    std::vector<std::string> filters;
+};
+
+//!
+//! \brief Transport delivering the published messages synchronously.
+//!
+class DirectTransport : public bsf::AbstractTransport<std::string>
+{
+public:
+    virtual void publish(const std::vector<unsigned char> &message,
+                         const std::string &channel)
+    {
+        callHandlers(bsf::ByteSpan(message), channel.c_str());
+    }
+};
+
+//!
+//! \brief Check a condition.
+//!
+//! \param condition Condition
+//! \param description Description of the condition
+//! \return The condition
+//!
+static bool check(bool condition, const std::string &description)
+{
+    if (!condition)
+    {
+        std::cerr << "Failed: " << description << std::endl;
+    }
+    return condition;
+}
+
+//!
+//! \brief Check matching topics against filters.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkMatching()
+{
+    std::vector<std::string> filters{
+        "#",          "+",         "a",         "a/#",      "a/+",
+        "a/b",        "a/+/c",     "a/b/#",     "+/b/c",    "+/+/+",
+        "a//c",       "a/+/#",     "$SYS/#",    "$SYS/+",   "+/monitor",
+        "x/y/z/#",
+    };
+    bsf::TopicTrie trie;
+    for (std::size_t i = 0; i < filters.size(); i++) {
+        trie.add(filters[i], static_cast<bsf::ChannelId>(i));
+    }
+
+    std::vector<Case> cases{
+        {"a", {"#", "+", "a", "a/#"}},
+        {"a/b", {"#", "a/#", "a/+", "a/+/#", "a/b", "a/b/#"}},
+        {"a/b/c",
+         {"#", "+/+/+", "+/b/c", "a/#", "a/+/#", "a/+/c", "a/b/#"}},
+        {"a//c", {"#", "+/+/+", "a/#", "a/+/#", "a/+/c", "a//c"}},
+        {"a/x/c", {"#", "+/+/+", "a/#", "a/+/#", "a/+/c"}},
+        {"a/b/c/d", {"#", "a/#", "a/+/#", "a/b/#"}},
+        {"b", {"#", "+"}},
+        {"b/monitor", {"#", "+/monitor"}},
+        {"", {"#", "+"}},
+        {"/", {"#"}},
+        {"x/y/z", {"#", "+/+/+", "x/y/z/#"}},
+        {"x/y", {"#"}},
+        {"$SYS/broker", {"$SYS/#", "$SYS/+"}},
+        {"$SYS", {"$SYS/#"}},
+        {"$SYS/monitor", {"$SYS/#", "$SYS/+"}},
+    };
+
+    auto succeeded = true;
+    for (const auto &c : cases) {
+        std::vector<std::string> matched;
+        trie.match(c.topic, [&](bsf::ChannelId id)
+                   {
+                       matched.push_back(filters[id]);
+                   });
+        std::sort(matched.begin(), matched.end());
+        succeeded &= check(matched == c.filters,
+                           "topic '" + c.topic + "' matches " +
+                               std::to_string(matched.size()) +
+                               " filters instead of " +
+                               std::to_string(c.filters.size()));
+
+        std::size_t matchedByPointer{0};
+        trie.match(c.topic.c_str(), [&](bsf::ChannelId)
+                   {
+                       matchedByPointer++;
+                   });
+        succeeded &= check(matchedByPointer == matched.size(),
+                           "null-terminated topic '" + c.topic + "'");
+    }
+    succeeded &= check(trie.size() == filters.size(), "filter count");
+
+    bsf::TopicTrie empty;
+    auto emptyMatched = false;
+    empty.match("a", [&](bsf::ChannelId)
+                {
+                    emptyMatched = true;
+                });
+    succeeded &= check(!emptyMatched, "an empty trie matches nothing");
+    return succeeded;
+}
+
+//!
+//! \brief Check telling filters from plain topics.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkIsFilter()
+{
+    auto succeeded = true;
+    for (const auto &filter : {"#", "+", "a/+", "+/a", "a/#", "a/+/b", "/+"}) {
+        succeeded &= check(bsf::TopicTrie::isFilter(filter),
+                           std::string("'") + filter + "' is a filter");
+    }
+    for (const auto &topic :
+         {"", "a", "a/b", "a+", "a/b#", "+a/b", "a/#b", "/", "a//b"}) {
+        succeeded &= check(!bsf::TopicTrie::isFilter(topic),
+                           std::string("'") + topic + "' is not a filter");
+    }
+    return succeeded;
+}
+
+//!
+//! \brief Check removing the handlers of wildcard channels.
+//!
+//! \return Whether the checks passed
+//!
+static bool checkRemoval()
+{
+    DirectTransport transport;
+    unsigned int exactCalls{0};
+    unsigned int wildcardCalls{0};
+    auto exact = transport.addSpanHandler([&](bsf::ByteSpan)
+                                          {
+                                              exactCalls++;
+                                          },
+                                          "music/notes");
+    auto wildcard = transport.addSpanHandler([&](bsf::ByteSpan)
+                                             {
+                                                 wildcardCalls++;
+                                             },
+                                             "music/#");
+    std::vector<unsigned char> message{0};
+    auto succeeded = true;
+
+    transport.publish(message, "music/notes");
+    transport.publish(message, "music/sync");
+    succeeded &= check(exactCalls == 1 && wildcardCalls == 2,
+                       "wildcard channels get the matching messages");
+
+    transport.removeHandler(wildcard, "music/#");
+    transport.publish(message, "music/notes");
+    succeeded &= check(exactCalls == 2 && wildcardCalls == 2,
+                       "removed wildcard handlers are not called");
+
+    transport.removeHandler(exact, "music/notes");
+    transport.addSpanHandler([&](bsf::ByteSpan)
+                             {
+                                 wildcardCalls++;
+                             },
+                             "music/#");
+    transport.publish(message, "music/notes");
+    succeeded &= check(exactCalls == 2 && wildcardCalls == 3,
+                       "wildcard channels may be used again");
+    return succeeded;
+}
+
+int main()
+{
+    auto succeeded = checkMatching();
+    succeeded &= checkIsFilter();
+    succeeded &= checkRemoval();
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
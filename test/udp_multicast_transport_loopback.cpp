@@ -0,0 +1,163 @@
+
+//
+// Check the accounting of lost and reordered messages of the UDP multicast
+// transport.
+//
+// Hand-crafted datagrams of a fake sender are sent to the transport through
+// the loopback interface, one at a time, and after each one the delivered
+// messages and the lost and reordered counts are compared with the expected
+// ones. The datagrams cover redundant records filling a gap, late duplicates,
+// out-of-order datagrams, and gaps around the 64 messages tracked behind the
+// last delivered one.
+//
+
+#include <bsf/UdpMulticastTransport.h>
+
+#include <asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char *GROUP = "239.255.77.0";
+static const unsigned short PORT{45124};
+static const char *INTERFACE = "127.0.0.1";
+static const char *CHANNEL = "loopback";
+//! Identifier of the fake sender
+static const uint32_t SENDER{7};
+//! Time given to the transport to process a datagram (milliseconds)
+static const int64_t PROCESS_WAIT_MS{50};
+
+//!
+//! \brief A datagram and its expected effect.
+//!
+struct Step
+{
+    //! Description of the step
+    const char *description;
+    //! Sequence numbers of the records, newest first
+    std::vector<uint32_t> records;
+    //! Sequence numbers of the messages to be delivered, in order
+    std::vector<uint32_t> delivered;
+    //! Expected number of lost messages after the datagram
+    uint64_t lost;
+    //! Expected number of reordered messages after the datagram
+    uint64_t reordered;
+};
+
+//!
+//! \brief Append a big endian integer to a datagram.
+//!
+//! \param datagram Datagram
+//! \param value Integer
+//! \param size Size of the integer (bytes)
+//!
+static void writeInteger(std::vector<unsigned char> &datagram, uint32_t value,
+                         std::size_t size)
+{
+    for (auto i = size; i > 0; i--) {
+        datagram.push_back(static_cast<unsigned char>(value >> (8 * (i - 1))));
+    }
+}
+
+//!
+//! \brief Build a datagram of the fake sender.
+//!
+//! Every message holds its own sequence number.
+//!
+//! \param records Sequence numbers of the records, newest first
+//! \return The datagram
+//!
+static std::vector<unsigned char> makeDatagram(
+    const std::vector<uint32_t> &records)
+{
+    std::string channel(CHANNEL);
+    std::vector<unsigned char> datagram;
+    writeInteger(datagram, 0x424d, 2);
+    writeInteger(datagram, 1, 1);
+    writeInteger(datagram, static_cast<uint32_t>(records.size()), 1);
+    writeInteger(datagram, SENDER, 4);
+    writeInteger(datagram, static_cast<uint32_t>(channel.size()), 2);
+    datagram.insert(datagram.end(), channel.begin(), channel.end());
+    for (auto sequence : records) {
+        writeInteger(datagram, sequence, 4);
+        writeInteger(datagram, 4, 2);
+        writeInteger(datagram, sequence, 4);
+    }
+    return datagram;
+}
+
+int main()
+{
+    std::vector<Step> steps{
+        {"first datagram", {1}, {1}, 0, 0},
+        {"redundant records filling a gap", {4, 3, 2}, {2, 3, 4}, 0, 0},
+        {"late duplicate", {3}, {}, 0, 0},
+        {"gap", {6}, {6}, 1, 0},
+        {"out-of-order datagram", {5}, {}, 0, 1},
+        {"duplicate of the out-of-order datagram", {5}, {}, 0, 1},
+        {"redundant records partly filling a gap", {9, 8}, {8, 9}, 1, 1},
+        {"70 messages skipped", {80}, {80}, 71, 1},
+        {"skipped message 65 behind", {15}, {}, 71, 1},
+        {"skipped message 64 behind", {16}, {}, 70, 2},
+        {"skipped message 1 behind", {79}, {}, 69, 3},
+        {"63 messages skipped", {144}, {144}, 132, 3},
+        {"delivered message 64 behind", {80}, {}, 132, 3},
+        {"skipped message 63 behind", {81}, {}, 131, 4},
+    };
+
+    std::mutex mutex;
+    std::vector<uint32_t> received;
+    bsf::UdpMulticastTransport transport(GROUP, 1, PORT, INTERFACE);
+    transport.addSpanHandler([&](bsf::ByteSpan message)
+                             {
+                                 uint32_t sequence{0};
+                                 for (auto byte : message) {
+                                     sequence = sequence << 8 | byte;
+                                 }
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 received.push_back(sequence);
+                             },
+                             CHANNEL);
+    transport.start();
+
+    asio::io_service asio;
+    asio::ip::udp::socket socket(asio);
+    socket.open(asio::ip::udp::v4());
+    socket.set_option(asio::ip::multicast::outbound_interface(
+        asio::ip::address_v4::from_string(INTERFACE)));
+    asio::ip::udp::endpoint endpoint(asio::ip::address::from_string(GROUP),
+                                     PORT);
+
+    auto succeeded = true;
+    for (const auto &step : steps) {
+        socket.send_to(asio::buffer(makeDatagram(step.records)), endpoint);
+        std::this_thread::sleep_for(std::chrono::milliseconds{PROCESS_WAIT_MS});
+
+        std::vector<uint32_t> delivered;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            delivered.swap(received);
+        }
+        auto lost = transport.getLostCount();
+        auto reordered = transport.getReorderedCount();
+        if (delivered != step.delivered || lost != step.lost ||
+            reordered != step.reordered)
+        {
+            std::cerr << step.description << ": " << delivered.size()
+                      << " messages delivered, " << lost << " lost and "
+                      << reordered << " reordered instead of "
+                      << step.delivered.size() << ", " << step.lost << " and "
+                      << step.reordered << std::endl;
+            succeeded = false;
+        }
+    }
+
+    transport.stop();
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}